@@ -0,0 +1,123 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "Arena.hpp"
+
+
+/*
+ * Monotonic arena for load-time data that is built up in many pieces and
+ * then dropped all together (a model's face normals and adjacency, the
+ * working state of one simplification). Allocation is a pointer bump in
+ * the last block; a full block is left as is and a new one, at least
+ * block_size bytes, is added. Callers that know roughly how much they will
+ * need reserve it up front, so everything lands in one block.
+ */
+namespace Arena {
+
+    Monotonic::Monotonic(size_t block_size) : block_size(block_size) {
+    }
+
+
+    Monotonic::Monotonic(Monotonic &&other) : blocks(std::move(other.blocks)), block_size(other.block_size) {
+        other.blocks.clear();
+    }
+
+
+    Monotonic &Monotonic::operator=(Monotonic &&other) {
+        if (this != &other) {
+            release();
+            blocks.swap(other.blocks);
+            block_size = other.block_size;
+        }
+        return *this;
+    }
+
+
+    Monotonic::~Monotonic() {
+        release();
+    }
+
+
+    /*
+     * Returns bytes of memory aligned to alignment (a power of two, at most
+     * that of operator new), valid until the arena is reset or released.
+     */
+    void *Monotonic::allocate(size_t bytes, size_t alignment) {
+        size_t start = 0;
+
+        if (!blocks.empty()) start = (blocks.back().used + alignment - 1) & ~(alignment - 1);
+
+        if (blocks.empty() || start + bytes > blocks.back().size) {
+            addBlock(std::max(bytes + alignment, block_size));
+            start = 0;
+        }
+
+        Block &block = blocks.back();
+        block.used = start + bytes;
+        return block.data + start;
+    }
+
+
+    /*
+     * Makes sure the next allocations, up to bytes in all (plus a little
+     * alignment padding), fit in the last block, adding a block of just that
+     * size if they don't.
+     */
+    void Monotonic::reserve(size_t bytes) {
+        bytes += 64;
+
+        if (!blocks.empty()) {
+            const Block &block = blocks.back();
+            if (block.size - block.used >= bytes) return;
+        }
+
+        addBlock(bytes);
+    }
+
+
+    void Monotonic::addBlock(size_t size) {
+        Block block;
+        block.size = size;
+        block.data = new char[size];
+        block.used = 0;
+        blocks.push_back(block);
+    }
+
+
+    /*
+     * Frees everything allocated, keeping the largest block for reuse.
+     */
+    void Monotonic::reset() {
+        if (blocks.empty()) return;
+
+        std::vector<Block>::iterator largest = std::max_element(blocks.begin(), blocks.end(),
+            [](const Block &a, const Block &b) { return a.size < b.size; });
+        std::swap(*largest, blocks.front());
+
+        for (size_t i = 1; i < blocks.size(); i++) delete[] blocks[i].data;
+        blocks.resize(1);
+        blocks[0].used = 0;
+    }
+
+
+    /*
+     * Frees everything allocated, and the blocks themselves.
+     */
+    void Monotonic::release() {
+        for (size_t i = 0; i < blocks.size(); i++) delete[] blocks[i].data;
+        std::vector<Block>().swap(blocks);
+    }
+
+
+    /*
+     * Returns the total size of the arena's blocks, in bytes.
+     */
+    size_t Monotonic::capacity() const {
+        size_t total = 0;
+        for (size_t i = 0; i < blocks.size(); i++) total += blocks[i].size;
+        return total;
+    }
+
+}
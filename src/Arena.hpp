@@ -0,0 +1,102 @@
+#pragma once
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace Arena {
+
+    /* Monotonic allocator: hands out memory from a few large blocks, and
+     * only frees it all at once, in reset or release (or when destroyed).
+     * Not thread safe; each thread needs its own. */
+    class Monotonic {
+    public:
+        explicit Monotonic(size_t block_size = 1 << 20);
+        Monotonic(Monotonic &&other);
+        Monotonic &operator=(Monotonic &&other);
+        ~Monotonic();
+
+        void *allocate(size_t bytes, size_t alignment);
+        void reserve(size_t bytes);
+        void reset();
+        void release();
+        size_t capacity() const;
+
+        template <typename T>
+        T *allocate(size_t count) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+            return (T *)allocate(count * sizeof(T), alignof(T));
+        }
+
+        Monotonic(const Monotonic &) = delete;
+        Monotonic &operator=(const Monotonic &) = delete;
+
+    private:
+        struct Block {
+            char *data;
+            size_t size, used;
+        };
+
+        void addBlock(size_t size);
+
+        std::vector<Block> blocks;
+        size_t block_size;
+    };
+
+
+    /* Array in a Monotonic arena; only the pointer and size are held, so it
+     * is copied or swapped as cheaply as a pointer and never frees. Growing
+     * it moves it to new memory in the arena. */
+    template <typename T>
+    class Array {
+    public:
+        Array() : ptr(NULL), count(0), room(0) {}
+
+        /* Makes the array n elements long, keeping its contents if it
+         * already has room for them */
+        void resize(Monotonic &arena, size_t n) {
+            if (n > room) {
+                T *moved = arena.allocate<T>(n);
+                std::copy(ptr, ptr + count, moved);
+                ptr = moved;
+                room = n;
+            }
+            count = n;
+        }
+
+        void assign(Monotonic &arena, size_t n, const T &value) {
+            resize(arena, n);
+            std::fill(ptr, ptr + n, value);
+        }
+
+        /* Forgets the array; its memory stays in the arena */
+        void clear() {
+            ptr = NULL;
+            count = room = 0;
+        }
+
+        T *data() { return ptr; }
+        const T *data() const { return ptr; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        T *begin() { return ptr; }
+        T *end() { return ptr + count; }
+        const T *begin() const { return ptr; }
+        const T *end() const { return ptr + count; }
+
+        T &operator[](size_t i) { return ptr[i]; }
+        const T &operator[](size_t i) const { return ptr[i]; }
+
+    private:
+        T *ptr;
+        size_t count, room;
+    };
+
+}
+
+#endif
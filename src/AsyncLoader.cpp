@@ -0,0 +1,271 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+
+#include "AsyncLoader.hpp"
+#include "Camera.hpp"
+#include "Constants.hpp"
+#include "Display.hpp"
+#include "MeshPool.hpp"
+#include "ObjectLoader.hpp"
+#include "Profiler.hpp"
+#include "ShaderLoader.hpp"
+
+
+/*
+ * Model changes in the background. The new model is parsed and processed
+ * (normals, clusters, levels of detail, vertex packing) on a persistent
+ * loader thread while the current model keeps being drawn. Its GPU buffers
+ * are then filled on the GL thread by a timer, at most
+ * Constants::upload_bytes_per_frame per tick, and the model is swapped in
+ * once they are complete, joining the resident models in MeshPool.
+ *
+ * Only the last requested model is ever shown: loads and uploads that have
+ * been superseded by a newer request are dropped.
+ */
+namespace AsyncLoader {
+
+    const bool DEBUG(false);
+
+    typedef std::unique_ptr<ObjectLoader::Model> ModelPtr;
+
+    /* Shared with the loader thread, under state_mutex */
+    static char wanted[100] = "";           // model to show next ("" if none)
+    static bool request_pending = false;    // wanted is not loading yet
+    static bool loading = false;
+    static bool stopping = false;
+    static ModelPtr ready;                  // loaded, waiting for its upload
+    static std::vector<ModelPtr> retired;   // to be freed on the loader thread
+    static std::atomic<unsigned> load_progress(0);
+
+    static std::thread loader;
+    static std::mutex state_mutex;
+    static std::condition_variable wake;
+
+    /* GL thread only */
+    static ModelPtr uploading;
+    static bool polling = false;
+
+
+    /*
+     * Loads requested models and frees retired ones until shutdown.
+     */
+    static void loaderLoop() {
+        Profiler::nameThread("loader");
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+
+        while (true) {
+            wake.wait(lock, []() { return stopping || request_pending || !retired.empty(); });
+            if (stopping) return;
+
+            std::vector<ModelPtr> garbage;
+            garbage.swap(retired);
+
+            char path[100] = "";
+            if (request_pending) {
+                strcpy(path, wanted);
+                request_pending = false;
+                loading = true;
+                load_progress = 0;
+            }
+
+            lock.unlock();
+
+            for (size_t i = 0; i < garbage.size(); i++) ObjectLoader::releaseModel(*garbage[i]);
+            garbage.clear();
+
+            ModelPtr model;
+            bool loaded = false;
+
+            if (path[0] != '\0') {
+                model.reset(new ObjectLoader::Model);
+                loaded = ObjectLoader::loadModel(path, *model, &load_progress);
+            }
+
+            lock.lock();
+
+            if (path[0] == '\0') continue;
+            loading = false;
+
+            if (loaded && !strcmp(path, wanted)) {
+                if (ready) retired.push_back(std::move(ready));
+                ready = std::move(model);
+            } else {
+                /* A failed load leaves the current model in place */
+                if (!strcmp(path, wanted) && !request_pending) wanted[0] = '\0';
+                retired.push_back(std::move(model));
+            }
+        }
+    }
+
+
+    /*
+     * Starts the GL-side timer if it isn't already running.
+     */
+    static void startPolling() {
+        if (polling) return;
+
+        polling = true;
+        glutTimerFunc((unsigned int)(1000.0 / Constants::framerate), poll, 0);
+    }
+
+
+    /*
+     * Asks for the model at filepath to be loaded in the background and
+     * shown once ready. A model still resident in MeshPool is shown at
+     * once instead. Either way, any pending change is cancelled.
+     */
+    void request(const char *filepath) {
+        bool shown = !strcmp(filepath, Display::current_model);
+        bool resident = !shown && MeshPool::find(filepath) != NULL;
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+
+            if (!strcmp(filepath, wanted)) return; // ignore redundant loads
+
+            if (shown || resident) {
+                wanted[0] = '\0';
+                request_pending = false;
+            } else {
+                strncpy(wanted, filepath, sizeof(wanted) - 1);
+                request_pending = true;
+
+                if (!loader.joinable()) {
+                    loader = std::thread(loaderLoop);
+                    atexit(shutdown);
+                }
+            }
+        }
+
+        if (resident) {
+            MeshPool::show(filepath);
+            Camera::resetCamera();
+            Display::invalidate();
+        } else if (!shown) {
+            wake.notify_one();
+        }
+
+        /* Also lets poll drop anything a cancelled request left behind */
+        startPolling();
+    }
+
+
+    /*
+     * Returns true while a model is being loaded or uploaded.
+     */
+    bool busy() {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        return wanted[0] != '\0' || ready || uploading;
+    }
+
+
+    /*
+     * Writes the state of the load in progress to text for the window
+     * titles, e.g. "loading models\cactus.obj 40%".
+     *
+     * Returns false (leaving text untouched) if nothing is loading.
+     */
+    bool describe(char *text, size_t size) {
+        std::lock_guard<std::mutex> lock(state_mutex);
+
+        if (uploading) {
+            snprintf(text, size, "uploading %s %u%%", uploading->path, ShaderLoader::uploadPercent());
+        } else if (ready) {
+            snprintf(text, size, "uploading %s 0%%", ready->path);
+        } else if (wanted[0] != '\0') {
+            snprintf(text, size, "loading %s %u%%", wanted, loading ? (unsigned)load_progress : 0);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+
+    /*
+     * GL-side timer, running while busy. Starts the upload of a loaded
+     * model, continues the upload in progress, and swaps the model in once
+     * its buffers are complete. Keeps the titles up to date meanwhile.
+     */
+    void poll(int t) {
+        int window = glutGetWindow();
+
+        /* The model's buffers belong to the windows' shared context */
+        glutSetWindow(Display::window_shaders);
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+
+            /* Drop an upload a newer request has made useless */
+            if (uploading && strcmp(uploading->path, wanted) != 0) {
+                if (DEBUG) printf("Cancelled upload of \"%s\"\n", uploading->path);
+                ShaderLoader::cancelUpload();
+                retired.push_back(std::move(uploading));
+                wake.notify_one();
+            }
+
+            if (!uploading && ready) {
+                if (!strcmp(ready->path, wanted)) {
+                    uploading = std::move(ready);
+                    ShaderLoader::beginUpload(*uploading);
+                } else {
+                    retired.push_back(std::move(ready));
+                    wake.notify_one();
+                }
+            }
+        }
+
+        if (uploading && ShaderLoader::continueUpload(Constants::upload_bytes_per_frame)) {
+            MeshPool::GpuMesh mesh;
+            ShaderLoader::finishUpload(mesh);
+            MeshPool::add(*uploading, mesh);
+
+            Camera::resetCamera();
+            Display::invalidate();
+
+            std::lock_guard<std::mutex> lock(state_mutex);
+            if (!strcmp(wanted, Display::current_model)) wanted[0] = '\0';
+            retired.push_back(std::move(uploading));
+            wake.notify_one();
+        }
+
+        if (window) glutSetWindow(window);
+
+        Display::updateTitles();
+
+        if (busy()) {
+            glutTimerFunc((unsigned int)(1000.0 / Constants::framerate), poll, 0);
+        } else {
+            polling = false;
+        }
+    }
+
+
+    /*
+     * Stops and joins the loader thread, after the load in progress (if
+     * any) has finished. Registered with atexit when the thread is started.
+     */
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+
+        if (loader.joinable()) loader.join();
+    }
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#ifndef ASYNCLOADER_H
+#define ASYNCLOADER_H
+
+#include <stddef.h>
+
+namespace AsyncLoader {
+
+    void request(const char *filepath);
+    bool busy();
+    bool describe(char *text, size_t size);
+    void poll(int t);
+    void shutdown();
+
+}
+
+#endif
@@ -0,0 +1,590 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "ObjectLoader.hpp"
+#include "ObjParser.hpp"
+#include "Profiler.hpp"
+#include "ShaderLoader.hpp"
+#include "VertexPacking.hpp"
+#include "WorkerPool.hpp"
+
+
+/********************************************************************************
+ *                            ALLOCATION COUNTING                               *
+ ********************************************************************************/
+
+/* Every allocation through operator new is counted, for the whole process,
+ * so each benchmarked stage can report how many it makes. Costs one relaxed
+ * atomic add per allocation, which only the benchmark program pays: this
+ * file is its main, and isn't part of the viewer. */
+static std::atomic<size_t> allocation_count(0), allocation_bytes(0);
+
+void *operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    try { return operator new(size); } catch (...) { return NULL; }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    try { return operator new(size); } catch (...) { return NULL; }
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+
+
+/*
+ * Times the loader and the CPU side of the upload on the sample models and
+ * on procedurally generated meshes, and writes the results as JSON so runs
+ * of different versions can be compared. Every stage is run on the same
+ * input each repeat, with its outputs freed beforehand, so repeats do the
+ * same work (and the same allocations).
+ *
+ * Built as its own program, from every source file but Main.cpp.
+ */
+namespace Benchmark {
+
+    const bool DEBUG(false);
+
+    /* Allocations made through operator new since startup */
+    struct Allocations {
+        size_t count, bytes;
+    };
+
+    /* Physical memory of the process around one run of a stage. The peak is
+     * the most used during the run, or 0 where the high-water mark can't be
+     * reset first (it would then be the whole process's so far). */
+    struct Memory {
+        size_t rss_before, rss_after, peak_rss;
+    };
+
+    /* Timings of one stage over all repeats; throughput counts items (and
+     * bytes, if not 0) per run. Allocations and memory are those of the
+     * last run. */
+    struct StageResult {
+        const char *name;
+        const char *unit;
+        double items, bytes;
+        double best, mean;
+        Allocations allocated;
+        Memory memory;
+    };
+
+    struct MeshResult {
+        std::string path;
+        bool synthetic;
+        bool packing_ok;        // packed vertices within VertexPacking's error bounds
+        size_t file_bytes;
+        GLuint vertices, faces;
+        std::vector<StageResult> stages;
+    };
+
+    /* Synthetic meshes run by default, in millions of faces */
+    static const unsigned default_synthetic[] = { 1, 10, 20, 50 };
+
+
+    /*
+     * Returns the number and total size of allocations so far.
+     */
+    static Allocations allocations() {
+        Allocations a = { allocation_count.load(), allocation_bytes.load() };
+        return a;
+    }
+
+
+    /*
+     * Returns the physical memory the process uses now, in bytes, or 0 if
+     * it can't be read.
+     */
+    static size_t currentRss() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return counters.WorkingSetSize;
+#else
+        /* Linux only: the second field of statm is the resident page count */
+        FILE *fp = fopen("/proc/self/statm", "r");
+        if (fp == NULL) return 0;
+
+        unsigned long long size, resident;
+        bool read = (fscanf(fp, "%llu %llu", &size, &resident) == 2);
+        fclose(fp);
+
+        return read ? (size_t)(resident * sysconf(_SC_PAGESIZE)) : 0;
+#endif
+    }
+
+
+    /*
+     * Resets the process's high-water mark of physical memory to what it
+     * uses now (Linux only).
+     *
+     * Returns true if it was reset; false otherwise.
+     */
+    static bool resetPeakRss() {
+#ifdef _WIN32
+        return false;
+#else
+        FILE *fp = fopen("/proc/self/clear_refs", "w");
+        if (fp == NULL) return false;
+
+        bool reset = (fputs("5", fp) >= 0);
+        return (fclose(fp) == 0) && reset;
+#endif
+    }
+
+
+    /*
+     * Returns the most physical memory the process has used since startup,
+     * or since resetPeakRss, in bytes (Linux only; 0 otherwise).
+     */
+    static size_t peakRss() {
+#ifdef _WIN32
+        return 0;
+#else
+        FILE *fp = fopen("/proc/self/status", "r");
+        if (fp == NULL) return 0;
+
+        char line[256];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+        }
+        fclose(fp);
+
+        return (size_t)kb * 1024;
+#endif
+    }
+
+
+    /*
+     * Writes a deterministic bumpy square height field with about the given
+     * number of faces to path, as an OBJ file.
+     *
+     * Returns true if the file was written; false otherwise.
+     */
+    static bool writeSynthetic(const char *path, unsigned faces) {
+        unsigned cells = std::max(1u, (unsigned)(sqrt(faces / 2.0) + 0.5));
+        unsigned side = cells + 1;
+
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL) {
+            printf("Can't write \"%s\"\n", path);
+            return false;
+        }
+
+        std::vector<char> buffer(1 << 20);
+        setvbuf(fp, buffer.data(), _IOFBF, buffer.size());
+
+        for (unsigned y = 0; y < side; y++) {
+            GLfloat fy = (GLfloat)y / cells;
+            for (unsigned x = 0; x < side; x++) {
+                GLfloat fx = (GLfloat)x / cells;
+                GLfloat z = 0.05f * sinf(fx * 18.85f) * cosf(fy * 18.85f);
+                fprintf(fp, "v %.6f %.6f %.6f\n", fx - 0.5f, fy - 0.5f, z);
+            }
+        }
+
+        /* Two faces per cell, counter-clockwise seen from +z; OBJ indices start at 1 */
+        for (unsigned y = 0; y < cells; y++) {
+            for (unsigned x = 0; x < cells; x++) {
+                unsigned a = y * side + x + 1, b = a + 1;
+                unsigned c = a + side, d = c + 1;
+                fprintf(fp, "f %u %u %u\nf %u %u %u\n", a, b, d, a, d, c);
+            }
+        }
+
+        bool ok = !ferror(fp);
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) printf("Can't write \"%s\"\n", path);
+        return ok;
+    }
+
+
+    /*
+     * Runs a stage repeat times, calling reset before each run (untimed),
+     * and prints a summary line.
+     */
+    static StageResult timeStage(const char *name, const char *unit, double items, double bytes,
+        unsigned repeat, const std::function<void()> &reset, const std::function<void()> &run) {
+
+        StageResult result = { name, unit, items, bytes, 1e30, 0.0, { 0, 0 }, { 0, 0, 0 } };
+
+        for (unsigned i = 0; i < repeat; i++) {
+            reset();
+
+            Memory memory = { currentRss(), 0, 0 };
+            bool peak_reset = resetPeakRss();
+
+            Allocations before = allocations();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            run();
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            Allocations after = allocations();
+
+            memory.rss_after = currentRss();
+            if (peak_reset) memory.peak_rss = peakRss();
+
+            result.best = std::min(result.best, seconds);
+            result.mean += seconds / repeat;
+            result.allocated.count = after.count - before.count;
+            result.allocated.bytes = after.bytes - before.bytes;
+            result.memory = memory;
+        }
+
+        if (result.best <= 0.0) result.best = 1e-9;
+
+        printf("  %-24s %9.4f s best, %9.4f s mean, %12.0f %s/sec, %9u allocations (%.1f MB), RSS %+.0f MB",
+            name, result.best, result.mean, items / result.best, unit,
+            (unsigned)result.allocated.count, result.allocated.bytes / 1e6,
+            ((double)result.memory.rss_after - (double)result.memory.rss_before) / 1e6);
+        if (result.memory.peak_rss > 0) printf(" (stage peak %.0f MB)", result.memory.peak_rss / 1e6);
+        printf("\n");
+
+        return result;
+    }
+
+
+    /*
+     * Frees the current model, so the next one is loaded into empty memory.
+     */
+    static void unloadCurrent() {
+        ObjectLoader::Model empty;
+        ObjectLoader::installModel(empty);
+        ObjectLoader::releaseModel(empty);
+    }
+
+
+    /*
+     * Parses filepath into model's vectors and bounds, as loadModel does.
+     */
+    static bool parseModel(const char *filepath, ObjectLoader::Model &model) {
+        MappedFile::File file;
+        if (!MappedFile::open(filepath, file)) {
+            printf("Can't open \"%s\"\n", filepath);
+            return false;
+        }
+
+        int line_count = 0;
+        ObjParser::resetBounds(model.bounds);
+        bool parsed = ObjParser::parse(file.data, file.data + file.size,
+            model.vertexCoords, model.vertexNormals, model.vertexTexCoords, model.faceVertices,
+            model.groups, model.bounds, line_count);
+
+        MappedFile::close(file);
+        return parsed;
+    }
+
+
+    template <typename T>
+    static void freeVector(std::vector<T> &v) {
+        std::vector<T>().swap(v);
+    }
+
+
+    /*
+     * Runs every stage on one model file.
+     *
+     * Returns true if the model could be loaded; false otherwise.
+     */
+    static bool benchmarkMesh(const char *filepath, bool synthetic, unsigned repeat, MeshResult &result) {
+        result.path = filepath;
+        result.synthetic = synthetic;
+        result.packing_ok = true;
+
+        int64_t mtime;
+        uint64_t size;
+        if (!MeshCache::sourceStat(filepath, mtime, size)) {
+            printf("Can't open \"%s\"\n", filepath);
+            return false;
+        }
+        result.file_bytes = (size_t)size;
+
+        printf("%s (%.1f MB)\n", filepath, size / 1e6);
+
+        /* The stages of loadModel and the upload, on a parsed model */
+        ObjectLoader::Model model;
+        if (!parseModel(filepath, model)) return false;
+
+        result.vertices = model.vertexCoords.size() / 3;
+        result.faces = model.faceVertices.size() / 3;
+        double vertices = result.vertices, faces = result.faces;
+
+        result.stages.push_back(timeStage("ObjParser::parse", "faces", faces, (double)size, repeat,
+            [&]() {
+                freeVector(model.vertexCoords); freeVector(model.vertexNormals);
+                freeVector(model.vertexTexCoords); freeVector(model.faceVertices);
+            },
+            [&]() { parseModel(filepath, model); }));
+
+        result.stages.push_back(timeStage("processFaces", "faces", faces, 0.0, repeat,
+            [&]() {
+                model.arena.release();
+                model.faceNormals.clear(); model.faceAreas.clear();
+                model.faceOffsets.clear(); model.memberFaces.clear();
+                freeVector(model.vertexNormals);
+            },
+            [&]() { ObjectLoader::processFaces(model); }));
+
+        result.stages.push_back(timeStage("calculateVertexNormals", "vertices", vertices, 0.0, repeat,
+            [&]() { freeVector(model.vertexNormals); },
+            [&]() { ObjectLoader::calculateVertexNormals(model); }));
+
+        /* The buffer preparation of initBufferObject (see ShaderLoader::beginUpload) */
+        model.vertexData = model.vertexCoords.data();
+        model.normalData = model.vertexNormals.data();
+        model.numVertices = result.vertices;
+
+        result.stages.push_back(timeStage("prepareVertices", "vertices", vertices, 0.0, repeat,
+            [&]() { freeVector(model.packedVertices); },
+            [&]() { ShaderLoader::prepareVertices(model); }));
+
+        result.packing_ok = VertexPacking::checkRoundTrip(model.vertexData, model.normalData,
+            model.numVertices, model.packMin, model.packExtent, model.packedData);
+
+        ObjectLoader::releaseModel(model);
+
+        /* The whole load, parsed from scratch, then from the mesh cache it wrote */
+        std::vector<char> path(filepath, filepath + strlen(filepath) + 1);
+        std::string cache_path = MeshCache::cachePath(filepath);
+        bool loaded = true;
+
+        result.stages.push_back(timeStage("loadObject", "faces", faces, (double)size, repeat,
+            [&]() { unloadCurrent(); if (Constants::USE_MESH_CACHE) remove(cache_path.c_str()); },
+            [&]() { loaded = ObjectLoader::loadObject(path.data()) && loaded; }));
+
+        if (Constants::USE_MESH_CACHE) {
+            result.stages.push_back(timeStage("loadObject (cached)", "faces", faces, (double)size, repeat,
+                [&]() { unloadCurrent(); },
+                [&]() { loaded = ObjectLoader::loadObject(path.data()) && loaded; }));
+
+            /* The packed vertices uploaded straight from the cache */
+            const ObjectLoader::Model &cached = ObjectLoader::current;
+            if (cached.packedData != NULL) {
+                result.packing_ok = VertexPacking::checkRoundTrip(cached.vertexData, cached.normalData,
+                    cached.numVertices, cached.packMin, cached.packExtent, cached.packedData) && result.packing_ok;
+            }
+        }
+
+        unloadCurrent();
+        return loaded;
+    }
+
+
+    /*
+     * Writes s as a JSON string.
+     */
+    static void writeString(FILE *fp, const char *s) {
+        fputc('"', fp);
+        for (; *s != '\0'; s++) {
+            if (*s == '"' || *s == '\\') fputc('\\', fp);
+            fputc(*s, fp);
+        }
+        fputc('"', fp);
+    }
+
+
+    /*
+     * Writes the configuration and every result to path.
+     *
+     * Returns true if the file was written; false otherwise.
+     */
+    static bool writeResults(const char *path, unsigned repeat, const std::vector<MeshResult> &results) {
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+            printf("Can't write \"%s\"\n", path);
+            return false;
+        }
+
+        fprintf(fp, "{\n  \"config\": {\"threads\": %u, \"repeat\": %u, \"mesh_cache\": %s, "
+            "\"optimize_mesh\": %s, \"frustum_culling\": %s, \"build_lod\": %s, \"packed_vertices\": %s},\n",
+            WorkerPool::threadCount(), repeat,
+            Constants::USE_MESH_CACHE ? "true" : "false", Constants::OPTIMIZE_MESH ? "true" : "false",
+            Constants::FRUSTUM_CULLING ? "true" : "false", Constants::BUILD_LOD ? "true" : "false",
+            Constants::PACKED_VERTICES ? "true" : "false");
+
+        fprintf(fp, "  \"meshes\": [");
+
+        for (size_t m = 0; m < results.size(); m++) {
+            const MeshResult &mesh = results[m];
+
+            fprintf(fp, "%s\n    {\"model\": ", m ? "," : "");
+            writeString(fp, mesh.path.c_str());
+            fprintf(fp, ", \"synthetic\": %s, \"file_bytes\": %llu, \"vertices\": %u, \"faces\": %u, "
+                "\"packing_ok\": %s,\n     \"stages\": [", mesh.synthetic ? "true" : "false",
+                (unsigned long long)mesh.file_bytes, mesh.vertices, mesh.faces, mesh.packing_ok ? "true" : "false");
+
+            for (size_t s = 0; s < mesh.stages.size(); s++) {
+                const StageResult &stage = mesh.stages[s];
+
+                fprintf(fp, "%s\n       {\"stage\": ", s ? "," : "");
+                writeString(fp, stage.name);
+                fprintf(fp, ", \"best_seconds\": %.6f, \"mean_seconds\": %.6f, \"%s_per_sec\": %.0f, ",
+                    stage.best, stage.mean, stage.unit, stage.items / stage.best);
+                if (stage.bytes > 0.0) fprintf(fp, "\"mb_per_sec\": %.2f, ", stage.bytes / 1e6 / stage.best);
+                fprintf(fp, "\"allocations\": %llu, \"allocated_bytes\": %llu, "
+                    "\"rss_before_bytes\": %llu, \"rss_after_bytes\": %llu",
+                    (unsigned long long)stage.allocated.count, (unsigned long long)stage.allocated.bytes,
+                    (unsigned long long)stage.memory.rss_before, (unsigned long long)stage.memory.rss_after);
+                if (stage.memory.peak_rss > 0) {
+                    fprintf(fp, ", \"stage_peak_rss_bytes\": %llu", (unsigned long long)stage.memory.peak_rss);
+                }
+                fprintf(fp, "}");
+            }
+
+            fprintf(fp, "\n     ]}");
+        }
+
+        fprintf(fp, "\n  ]\n}\n");
+
+        bool ok = (fclose(fp) == 0);
+        if (ok) printf("Wrote \"%s\"\n", path);
+        else printf("Can't write \"%s\"\n", path);
+        return ok;
+    }
+
+
+    /*
+     * Runs the benchmarks, for the arguments of main:
+     *
+     *   <results.json> [--model <file.obj>]... [--synthetic <millions>[,...]] [--repeat <n>]
+     *   [--trace <trace.json>]
+     *
+     * Runs bunny.obj, cactus.obj and synthetic meshes of 1, 10, 20 and 50
+     * million faces by default; --synthetic 0 runs none. Synthetic meshes
+     * are written to the working directory and deleted afterwards (the
+     * largest takes a few GB of disk, and more of memory).
+     *
+     * Every model's packed vertices, both freshly packed and read back from
+     * the mesh cache, are checked against its float vertices; the run fails
+     * if any are out of VertexPacking's error bounds.
+     *
+     * Returns the process exit status: 0 if every model loaded and passed
+     * the packing check, and the results were written; 1 otherwise.
+     */
+    static int benchmarkMain(int argc, char **argv) {
+        const char *output = NULL;
+        unsigned repeat = 3;
+
+        std::vector<std::string> models;
+        std::vector<unsigned> synthetic(default_synthetic, default_synthetic + 4);
+        bool default_models = true;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg(argv[i]);
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--model" && has_value) {
+                if (default_models) models.clear();
+                default_models = false;
+                models.push_back(argv[++i]);
+            } else if (arg == "--synthetic" && has_value) {
+                synthetic.clear();
+                char *next = argv[++i];
+                while (true) {
+                    unsigned millions = (unsigned)strtoul(next, &next, 10);
+                    if (millions > 0) synthetic.push_back(millions);
+                    if (*next != ',') break;
+                    next++;
+                }
+            } else if (arg == "--repeat" && has_value) {
+                repeat = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--trace" && has_value) {
+                Profiler::traceOnExit(argv[++i]);
+            } else if (output == NULL && arg.compare(0, 2, "--") != 0) {
+                output = argv[i];
+            } else {
+                printf("Unknown argument \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }
+
+        if (output == NULL) {
+            printf("Usage: benchmark <results.json> [--model <file.obj>]... [--synthetic <millions>[,...]]\n"
+                "       [--repeat <n>] [--trace <trace.json>]\n");
+            return 1;
+        }
+
+        if (default_models) {
+            models.push_back("models\\bunny.obj");
+            models.push_back("models\\cactus.obj");
+        }
+
+        std::vector<MeshResult> results;
+        bool ok = true;
+
+        for (size_t i = 0; i < models.size(); i++) {
+            MeshResult result;
+            if (benchmarkMesh(models[i].c_str(), false, repeat, result)) results.push_back(result);
+            else ok = false;
+            if (!result.packing_ok) ok = false;
+        }
+
+        for (size_t i = 0; i < synthetic.size(); i++) {
+            char path[100];
+            snprintf(path, sizeof(path), "synthetic_%uM.obj", synthetic[i]);
+
+            if (!writeSynthetic(path, synthetic[i] * 1000000u)) {
+                ok = false;
+                continue;
+            }
+
+            MeshResult result;
+            if (benchmarkMesh(path, true, repeat, result)) results.push_back(result);
+            else ok = false;
+            if (!result.packing_ok) ok = false;
+
+            remove(path);
+            remove(MeshCache::cachePath(path).c_str());
+        }
+
+        return writeResults(output, repeat, results) && ok ? 0 : 1;
+    }
+
+}
+
+
+int main(int argc, char **argv) {
+    Profiler::nameThread("main");
+    return Benchmark::benchmarkMain(argc, argv);
+}
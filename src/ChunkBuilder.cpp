@@ -0,0 +1,567 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "ChunkBuilder.hpp"
+#include "Constants.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "ObjParser.hpp"
+#include "Profiler.hpp"
+
+
+/*
+ * Splits an .obj file too large for memory into spatial chunks on disk
+ * (.mvc files, written next to the .obj), for ChunkStream to page in.
+ *
+ * Nothing proportional to the model is held in memory: the model is read
+ * once into flat scratch files (positions and faces), which are then mapped
+ * and left to the OS to page. Face centroids are counted into a fixed grid,
+ * and the grid is split recursively at the median face along its longest
+ * axis until every box holds about Constants::stream_chunk_faces faces.
+ * The faces are then scattered into per-chunk runs (accumulating vertex
+ * normals over the whole mesh, so there are no seams between chunks), and
+ * each chunk is written with its own vertices and local indices.
+ */
+namespace ChunkBuilder {
+
+    const bool DEBUG(false);
+
+    const uint32_t VERSION = 1;
+
+    /* Cells of the counting grid along the longest axis of the model */
+    static const int GRID = 128;
+
+    /* Records buffered before each write to the scratch files */
+    static const size_t WRITE_BATCH = 1 << 16;
+
+    /* Uniform grid over the model's bounds */
+    struct Grid {
+        GLfloat min[3];
+        GLfloat inv_cell;
+        int dims[3];
+    };
+
+    /* Box of grid cells [lo, hi), split until it is small enough for a chunk */
+    struct CellBox {
+        int lo[3], hi[3];
+    };
+
+    /* Scratch file of one build; unmapped and deleted when done */
+    struct Scratch {
+        std::string path;
+        MappedFile::File file;
+        bool mapped;
+
+        Scratch(const std::string &scratch_path) : path(scratch_path), mapped(false) {}
+
+        ~Scratch() {
+            if (mapped) MappedFile::close(file);
+            remove(path.c_str());
+        }
+
+        bool open() {
+            return mapped = MappedFile::open(path.c_str(), file);
+        }
+
+        bool create(size_t size) {
+            return mapped = MappedFile::create(path.c_str(), size, file);
+        }
+    };
+
+
+    /*
+     * Returns the chunk file path for a model: its extension replaced by .mvc.
+     */
+    std::string chunkPath(const char *filepath) {
+        std::string path = MeshCache::cachePath(filepath);
+        path.replace(path.size() - 4, 4, ".mvc");
+        return path;
+    }
+
+
+    /*
+     * Returns the size of a chunk's data in the file, and in memory once
+     * loaded.
+     */
+    uint64_t chunkBytes(const ChunkInfo &chunk) {
+        return chunk.num_vertices * 6ULL * sizeof(GLfloat) + chunk.num_indices * (uint64_t)sizeof(GLuint);
+    }
+
+
+    /*
+     * Returns true if the chunk file for the model at filepath exists and was
+     * built from the model as it is now.
+     */
+    bool upToDate(const char *filepath) {
+        int64_t mtime;
+        uint64_t size;
+        if (!MeshCache::sourceStat(filepath, mtime, size)) return false;
+
+        FILE *fp = fopen(chunkPath(filepath).c_str(), "rb");
+        if (fp == NULL) return false;
+
+        Header header;
+        bool valid = fread(&header, sizeof(header), 1, fp) == 1
+            && memcmp(header.magic, "MVC1", 4) == 0
+            && header.version == VERSION
+            && header.source_mtime == mtime
+            && header.source_size == size;
+
+        fclose(fp);
+        return valid;
+    }
+
+
+    /*
+     * Reads the 'v' and 'f' records of the mapped .obj file, appending
+     * positions and (zero-based) face indices to the scratch files. Faces
+     * keep only the position of each corner, and polygons are split into
+     * fans of triangles, as ObjParser::parseGeneral does; 'vt' and 'vn'
+     * records are only counted so that face indices can be checked.
+     *
+     * Returns true for a successful parse; false otherwise.
+     */
+    static bool scan(const MappedFile::File &obj, FILE *positions, FILE *faces,
+        uint64_t &num_vertices, uint64_t &num_faces, ObjParser::Bounds &bounds) {
+
+        std::vector<GLfloat> coords;
+        std::vector<GLuint> indices;
+        coords.reserve(WRITE_BATCH * 3);
+        indices.reserve(WRITE_BATCH * 3);
+
+        std::vector<ObjParser::Corner> corners;
+        uint64_t num_texcoords = 0, num_normals = 0;
+
+        const char *p = obj.data, *end = obj.data + obj.size;
+        uint64_t line_count = 0;
+        num_vertices = num_faces = 0;
+
+        while (p < end) {
+            line_count++;
+
+            const char *line_end = (const char *)memchr(p, '\n', end - p);
+            if (line_end == NULL) line_end = end;
+
+            bool record = (p + 1 < line_end && (p[1] == ' ' || p[1] == '\t'));
+
+            if (*p == 'v' && record) {
+                GLfloat v[3];
+                const char *q = ObjParser::parseFloat(p + 1, line_end, v[0]);
+                if (q) q = ObjParser::parseFloat(q, line_end, v[1]);
+                if (q) q = ObjParser::parseFloat(q, line_end, v[2]);
+
+                if (q == NULL) {
+                    printf("Malformed vertex on line %llu\n", (unsigned long long)line_count);
+                    return false;
+                }
+
+                coords.insert(coords.end(), v, v + 3);
+                num_vertices++;
+
+                if (v[0] > bounds.maxx) bounds.maxx = v[0];
+                if (v[1] > bounds.maxy) bounds.maxy = v[1];
+                if (v[2] > bounds.maxz) bounds.maxz = v[2];
+
+                if (v[0] < bounds.minx) bounds.minx = v[0];
+                if (v[1] < bounds.miny) bounds.miny = v[1];
+                if (v[2] < bounds.minz) bounds.minz = v[2];
+
+            } else if (*p == 'v' && p + 2 < line_end && (p[2] == ' ' || p[2] == '\t')) {
+                if (p[1] == 't') num_texcoords++;
+                else if (p[1] == 'n') num_normals++;
+
+            } else if (*p == 'f' && record) {
+                const char *error = NULL;
+                const char *q = ObjParser::parseFace(p + 1, line_end,
+                    num_vertices, num_texcoords, num_normals, corners, error);
+
+                if (q == NULL) {
+                    printf("Malformed face on line %llu: %s\n", (unsigned long long)line_count, error);
+                    return false;
+                }
+
+                /* Fan triangulation, which keeps the polygon's winding */
+                for (size_t i = 1; i + 1 < corners.size(); i++) {
+                    indices.push_back(corners[0].v);
+                    indices.push_back(corners[i].v);
+                    indices.push_back(corners[i + 1].v);
+                    num_faces++;
+                }
+            }
+
+            if (coords.size() >= WRITE_BATCH * 3) {
+                if (fwrite(coords.data(), sizeof(GLfloat), coords.size(), positions) != coords.size()) return false;
+                coords.clear();
+            }
+            if (indices.size() >= WRITE_BATCH * 3) {
+                if (fwrite(indices.data(), sizeof(GLuint), indices.size(), faces) != indices.size()) return false;
+                indices.clear();
+            }
+
+            p = line_end + 1;
+        }
+
+        if (num_vertices >= 0xFFFFFFFFULL) {
+            printf("Too many vertices to chunk (%llu)\n", (unsigned long long)num_vertices);
+            return false;
+        }
+
+        return fwrite(coords.data(), sizeof(GLfloat), coords.size(), positions) == coords.size()
+            && fwrite(indices.data(), sizeof(GLuint), indices.size(), faces) == indices.size();
+    }
+
+
+    /*
+     * Returns the grid cell holding the centroid of a face, or -1 if the
+     * face refers to vertices that don't exist.
+     */
+    static inline int64_t faceCell(const Grid &grid, const GLfloat *positions,
+        uint64_t num_vertices, const GLuint *face) {
+
+        if (face[0] >= num_vertices || face[1] >= num_vertices || face[2] >= num_vertices) return -1;
+
+        int cell[3];
+        for (int k = 0; k < 3; k++) {
+            GLfloat centroid = (positions[face[0] * 3ULL + k] + positions[face[1] * 3ULL + k]
+                + positions[face[2] * 3ULL + k]) / 3;
+            cell[k] = (int)((centroid - grid.min[k]) * grid.inv_cell);
+            cell[k] = std::max(0, std::min(grid.dims[k] - 1, cell[k]));
+        }
+
+        return ((int64_t)cell[2] * grid.dims[1] + cell[1]) * grid.dims[0] + cell[0];
+    }
+
+
+    /*
+     * Returns the number of faces in a box of cells, from the summed-area
+     * table of the grid counts.
+     */
+    static uint64_t boxFaces(const std::vector<uint64_t> &sums, const Grid &grid, const CellBox &box) {
+        size_t sx = grid.dims[0] + 1, sy = grid.dims[1] + 1;
+        uint64_t total = 0;
+
+        /* Inclusion-exclusion over the eight corners */
+        for (int corner = 0; corner < 8; corner++) {
+            int x = corner & 1 ? box.hi[0] : box.lo[0];
+            int y = corner & 2 ? box.hi[1] : box.lo[1];
+            int z = corner & 4 ? box.hi[2] : box.lo[2];
+            int lows = !(corner & 1) + !(corner & 2) + !(corner & 4);
+
+            uint64_t value = sums[((size_t)z * sy + y) * sx + x];
+            if (lows % 2 == 0) total += value;
+            else total -= value;
+        }
+
+        return total;
+    }
+
+
+    /*
+     * Splits the grid into boxes of at most Constants::stream_chunk_faces
+     * faces (or single cells), at the median face along each box's longest
+     * axis, and numbers the non-empty boxes as chunks in cell_chunks.
+     *
+     * Returns the number of chunks.
+     */
+    static uint32_t splitGrid(const std::vector<uint32_t> &counts, const Grid &grid,
+        std::vector<uint32_t> &cell_chunks) {
+
+        size_t sx = grid.dims[0] + 1, sy = grid.dims[1] + 1, sz = grid.dims[2] + 1;
+        std::vector<uint64_t> sums(sx * sy * sz, 0);
+
+        for (int z = 1; z <= grid.dims[2]; z++) {
+            for (int y = 1; y <= grid.dims[1]; y++) {
+                for (int x = 1; x <= grid.dims[0]; x++) {
+                    size_t cell = ((size_t)(z - 1) * grid.dims[1] + (y - 1)) * grid.dims[0] + (x - 1);
+                    sums[((size_t)z * sy + y) * sx + x] = counts[cell]
+                        + sums[((size_t)(z - 1) * sy + y) * sx + x]
+                        + sums[((size_t)z * sy + (y - 1)) * sx + x]
+                        + sums[((size_t)z * sy + y) * sx + (x - 1)]
+                        - sums[((size_t)(z - 1) * sy + (y - 1)) * sx + x]
+                        - sums[((size_t)(z - 1) * sy + y) * sx + (x - 1)]
+                        - sums[((size_t)z * sy + (y - 1)) * sx + (x - 1)]
+                        + sums[((size_t)(z - 1) * sy + (y - 1)) * sx + (x - 1)];
+                }
+            }
+        }
+
+        cell_chunks.assign(counts.size(), 0);
+        uint32_t num_chunks = 0;
+
+        std::vector<CellBox> stack;
+        CellBox all = { { 0, 0, 0 }, { grid.dims[0], grid.dims[1], grid.dims[2] } };
+        stack.push_back(all);
+
+        while (!stack.empty()) {
+            CellBox box = stack.back();
+            stack.pop_back();
+
+            uint64_t faces = boxFaces(sums, grid, box);
+            if (faces == 0) continue;
+
+            int axis = 0;
+            for (int k = 1; k < 3; k++) {
+                if (box.hi[k] - box.lo[k] > box.hi[axis] - box.lo[axis]) axis = k;
+            }
+
+            if (faces > Constants::stream_chunk_faces && box.hi[axis] - box.lo[axis] > 1) {
+                /* First plane with at least half the faces below it */
+                int lo = box.lo[axis] + 1, hi = box.hi[axis] - 1;
+                while (lo < hi) {
+                    int mid = (lo + hi) / 2;
+                    CellBox below = box;
+                    below.hi[axis] = mid;
+                    if (boxFaces(sums, grid, below) * 2 >= faces) hi = mid;
+                    else lo = mid + 1;
+                }
+
+                CellBox left = box, right = box;
+                left.hi[axis] = lo;
+                right.lo[axis] = lo;
+                stack.push_back(right);
+                stack.push_back(left);
+                continue;
+            }
+
+            for (int z = box.lo[2]; z < box.hi[2]; z++) {
+                for (int y = box.lo[1]; y < box.hi[1]; y++) {
+                    for (int x = box.lo[0]; x < box.hi[0]; x++) {
+                        cell_chunks[((size_t)z * grid.dims[1] + y) * grid.dims[0] + x] = num_chunks;
+                    }
+                }
+            }
+            num_chunks++;
+        }
+
+        return num_chunks;
+    }
+
+
+    /*
+     * Writes one chunk (its faces' vertices, normalized vertex normals and
+     * local indices) at the current end of fp, and fills in info.
+     *
+     * Returns true if it was written; false otherwise.
+     */
+    static bool writeChunk(FILE *fp, uint64_t offset, const GLuint *faces, uint64_t num_faces,
+        const GLfloat *positions, const GLfloat *normals, ChunkInfo &info) {
+
+        static std::vector<GLuint> vertices, indices;
+        static std::vector<GLfloat> data;
+
+        vertices.assign(faces, faces + num_faces * 3);
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+        indices.resize(num_faces * 3);
+        for (size_t i = 0; i < indices.size(); i++) {
+            indices[i] = std::lower_bound(vertices.begin(), vertices.end(), faces[i]) - vertices.begin();
+        }
+
+        for (int k = 0; k < 3; k++) {
+            info.min[k] = positions[vertices[0] * 3ULL + k];
+            info.max[k] = info.min[k];
+        }
+
+        data.resize(vertices.size() * 6);
+        GLfloat *chunk_positions = data.data(), *chunk_normals = data.data() + vertices.size() * 3;
+
+        for (size_t v = 0; v < vertices.size(); v++) {
+            const GLfloat *p = positions + vertices[v] * 3ULL;
+            const GLfloat *n = normals + vertices[v] * 3ULL;
+            GLfloat length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length == 0.0f) length = 1.0f;
+
+            for (int k = 0; k < 3; k++) {
+                chunk_positions[v * 3 + k] = p[k];
+                chunk_normals[v * 3 + k] = n[k] / length;
+                info.min[k] = std::min(info.min[k], p[k]);
+                info.max[k] = std::max(info.max[k], p[k]);
+            }
+        }
+
+        info.num_vertices = vertices.size();
+        info.num_indices = indices.size();
+        info.offset = offset;
+
+        return fwrite(data.data(), sizeof(GLfloat), data.size(), fp) == data.size()
+            && fwrite(indices.data(), sizeof(GLuint), indices.size(), fp) == indices.size();
+    }
+
+
+    /*
+     * Builds the chunk file for the model at filepath (see above). Scratch
+     * files are written next to it and deleted on return; the chunk file is
+     * written under a temporary name and renamed once complete.
+     *
+     * Returns true if the chunk file was written; false otherwise.
+     */
+    bool build(const char *filepath) {
+        Profiler::Scope scope("build chunks", "load");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::string path = chunkPath(filepath);
+        std::string temp_path = path + ".tmp";
+
+        Scratch positions_file(path + ".positions.tmp"), faces_file(path + ".faces.tmp");
+        Scratch sorted_file(path + ".sorted.tmp"), normals_file(path + ".normals.tmp");
+
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "MVC1", 4);
+        header.version = VERSION;
+
+        if (!MeshCache::sourceStat(filepath, header.source_mtime, header.source_size)) {
+            printf("Can't open \"%s\"\n", filepath);
+            return false;
+        }
+
+        /* Positions and faces to flat scratch files */
+        MappedFile::File obj;
+        if (!MappedFile::open(filepath, obj)) {
+            printf("Can't open \"%s\"\n", filepath);
+            return false;
+        }
+
+        FILE *positions_fp = fopen(positions_file.path.c_str(), "wb");
+        FILE *faces_fp = fopen(faces_file.path.c_str(), "wb");
+
+        ObjParser::Bounds bounds;
+        ObjParser::resetBounds(bounds);
+        uint64_t num_vertices = 0, num_faces = 0;
+
+        bool ok = positions_fp != NULL && faces_fp != NULL
+            && scan(obj, positions_fp, faces_fp, num_vertices, num_faces, bounds);
+
+        if (positions_fp != NULL) ok = (fclose(positions_fp) == 0) && ok;
+        if (faces_fp != NULL) ok = (fclose(faces_fp) == 0) && ok;
+        MappedFile::close(obj);
+
+        ok = ok && num_faces > 0
+            && positions_file.open() && faces_file.open()
+            && positions_file.file.size == num_vertices * 3 * sizeof(GLfloat)
+            && faces_file.file.size == num_faces * 3 * sizeof(GLuint);
+
+        const GLfloat *positions = (const GLfloat *)positions_file.file.data;
+        const GLuint *faces = (const GLuint *)faces_file.file.data;
+
+        if (DEBUG && ok) printf("Chunking: scanned %llu vertices, %llu faces\n",
+            (unsigned long long)num_vertices, (unsigned long long)num_faces);
+
+        /* Face counts per grid cell, split into chunks */
+        Grid grid;
+        std::vector<uint32_t> counts, cell_chunks;
+        uint32_t num_chunks = 0;
+
+        if (ok) {
+            GLfloat extent[3] = { bounds.maxx - bounds.minx, bounds.maxy - bounds.miny, bounds.maxz - bounds.minz };
+            GLfloat cell = std::max(extent[0], std::max(extent[1], extent[2])) / GRID;
+            if (cell <= 0.0f) cell = 1.0f;
+
+            grid.min[0] = bounds.minx; grid.min[1] = bounds.miny; grid.min[2] = bounds.minz;
+            grid.inv_cell = 1.0f / cell;
+            for (int k = 0; k < 3; k++) grid.dims[k] = std::max(1, std::min(GRID, (int)std::ceil(extent[k] / cell)));
+
+            counts.assign((size_t)grid.dims[0] * grid.dims[1] * grid.dims[2], 0);
+
+            for (uint64_t f = 0; f < num_faces; f++) {
+                int64_t cell_index = faceCell(grid, positions, num_vertices, faces + f * 3);
+                if (cell_index >= 0) counts[cell_index]++;
+            }
+
+            num_chunks = splitGrid(counts, grid, cell_chunks);
+        }
+
+        /* Faces scattered into per-chunk runs; vertex normals accumulated */
+        std::vector<uint64_t> chunk_first(num_chunks + 1, 0);
+
+        ok = ok && sorted_file.create(num_faces * 3 * sizeof(GLuint))
+            && normals_file.create(num_vertices * 3 * sizeof(GLfloat));
+
+        if (ok) {
+            for (size_t c = 0; c < counts.size(); c++) chunk_first[cell_chunks[c] + 1] += counts[c];
+            for (uint32_t c = 0; c < num_chunks; c++) chunk_first[c + 1] += chunk_first[c];
+
+            std::vector<uint64_t> cursor(chunk_first.begin(), chunk_first.end() - 1);
+            GLuint *sorted = (GLuint *)sorted_file.file.data;
+            GLfloat *normals = (GLfloat *)normals_file.file.data;
+
+            for (uint64_t f = 0; f < num_faces; f++) {
+                const GLuint *face = faces + f * 3;
+                int64_t cell_index = faceCell(grid, positions, num_vertices, face);
+                if (cell_index < 0) continue;
+
+                memcpy(sorted + cursor[cell_chunks[cell_index]]++ * 3, face, 3 * sizeof(GLuint));
+
+                /* Area-weighted face normal */
+                const GLfloat *a = positions + face[0] * 3ULL;
+                const GLfloat *b = positions + face[1] * 3ULL;
+                const GLfloat *c = positions + face[2] * 3ULL;
+                GLfloat u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                GLfloat v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                GLfloat n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+
+                for (int i = 0; i < 3; i++) {
+                    for (int k = 0; k < 3; k++) normals[face[i] * 3ULL + k] += n[k];
+                }
+            }
+        }
+
+        /* Each chunk with its own vertices, then the chunk table */
+        std::vector<ChunkInfo> chunks(num_chunks);
+        FILE *fp = ok ? fopen(temp_path.c_str(), "wb") : NULL;
+        ok = ok && fp != NULL && fwrite(&header, sizeof(header), 1, fp) == 1;
+
+        uint64_t offset = sizeof(header);
+        for (uint32_t c = 0; c < num_chunks && ok; c++) {
+            ok = writeChunk(fp, offset, (const GLuint *)sorted_file.file.data + chunk_first[c] * 3,
+                chunk_first[c + 1] - chunk_first[c], positions, (const GLfloat *)normals_file.file.data, chunks[c]);
+
+            offset += chunkBytes(chunks[c]);
+            header.num_vertices += chunks[c].num_vertices;
+            header.num_faces += chunks[c].num_indices / 3;
+        }
+
+        if (ok) {
+            header.num_chunks = num_chunks;
+            header.chunks_offset = offset;
+            header.minx = bounds.minx; header.miny = bounds.miny; header.minz = bounds.minz;
+            header.maxx = bounds.maxx; header.maxy = bounds.maxy; header.maxz = bounds.maxz;
+            header.max_xy = std::max(bounds.maxx - bounds.minx, bounds.maxy - bounds.miny);
+
+            ok = fwrite(chunks.data(), sizeof(ChunkInfo), num_chunks, fp) == num_chunks
+                && fseek(fp, 0, SEEK_SET) == 0
+                && fwrite(&header, sizeof(header), 1, fp) == 1;
+        }
+
+        if (fp != NULL) ok = (fclose(fp) == 0) && ok;
+
+        if (ok) {
+            remove(path.c_str());
+            ok = rename(temp_path.c_str(), path.c_str()) == 0;
+        }
+
+        if (!ok) {
+            printf("Can't build chunks for \"%s\"\n", filepath);
+            remove(temp_path.c_str());
+            return false;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Chunked \"%s\": %llu faces into %u chunks (%.1f MB) in %.1f s\n", filepath,
+            (unsigned long long)header.num_faces, num_chunks, offset / 1048576.0, seconds);
+
+        return true;
+    }
+
+}
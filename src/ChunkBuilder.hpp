@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef CHUNKBUILDER_H
+#define CHUNKBUILDER_H
+
+#include <stdint.h>
+#include <string>
+
+#include "GL/freeglut.h"
+
+namespace ChunkBuilder {
+
+    /* On-disk layout of a .mvc file: the header, the chunk table at
+     * chunks_offset, then each chunk's data at its own offset */
+    struct Header {
+        char magic[4];
+        uint32_t version;
+
+        uint32_t num_chunks;
+        uint32_t reserved;
+        uint64_t num_vertices;
+        uint64_t num_faces;
+
+        GLfloat minx, miny, minz;
+        GLfloat maxx, maxy, maxz;
+        GLfloat max_xy;
+        uint32_t reserved2;
+
+        int64_t source_mtime;
+        uint64_t source_size;
+
+        uint64_t chunks_offset;
+    };
+
+    /* One spatial chunk: positions, then normals (3 floats per vertex each),
+     * then local indices, from offset */
+    struct ChunkInfo {
+        GLfloat min[3], max[3];
+        uint32_t num_vertices, num_indices;
+        uint64_t offset;
+    };
+
+    extern const uint32_t VERSION;
+
+    std::string chunkPath(const char *filepath);
+    uint64_t chunkBytes(const ChunkInfo &chunk);
+    bool upToDate(const char *filepath);
+    bool build(const char *filepath);
+
+}
+
+#endif
@@ -0,0 +1,542 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+
+#include "Camera.hpp"
+#include "ChunkBuilder.hpp"
+#include "ChunkStream.hpp"
+#include "Constants.hpp"
+#include "Display.hpp"
+#include "MeshClusters.hpp"
+#include "MeshPool.hpp"
+#include "ObjectLoader.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
+#include "ShaderLoader.hpp"
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+
+/*
+ * Out-of-core rendering of a model split into spatial chunks on disk (see
+ * ChunkBuilder), for models larger than memory.
+ *
+ * Every redraw of the shader window ranks the chunks: those in the view
+ * frustum first, then the rest, each nearest to Camera::camera first. The
+ * highest ranked chunks that fit Constants::stream_host_budget_mb are kept
+ * in memory, read by a prefetch thread from a priority queue; the highest
+ * ranked that fit Constants::stream_gpu_budget_mb are uploaded, at most
+ * Constants::upload_bytes_per_frame per redraw. Everything else is freed.
+ * Visible chunks are drawn front to back, in both windows, as soon as
+ * they are on the GPU.
+ */
+namespace ChunkStream {
+
+    const bool DEBUG(false);
+
+    enum State { ON_DISK, LOADING, IN_HOST };
+
+    struct Chunk {
+        ChunkBuilder::ChunkInfo info;
+        uint64_t bytes;
+
+        /* Under state_mutex. Only the GL thread frees host data, so it may
+         * read it without the lock once it has seen IN_HOST */
+        State state;
+        bool wanted;
+        std::unique_ptr<char[]> host;
+
+        /* GL thread only */
+        MeshPool::GpuMesh mesh;
+        bool visible;
+        GLfloat priority;
+    };
+
+    /* Queued read, highest priority first */
+    struct Request {
+        GLfloat priority;
+        uint32_t chunk;
+
+        bool operator<(const Request &other) const {
+            return priority < other.priority;
+        }
+    };
+
+    static bool is_active = false;
+    static char stream_path[100] = "";
+    static ChunkBuilder::Header header;
+
+    /* Never destroyed at exit, since their buffers can only be deleted while
+     * the GL context is alive */
+    static std::vector<Chunk> &chunks = *new std::vector<Chunk>();
+
+    /* Shared with the prefetch thread, under state_mutex */
+    static std::priority_queue<Request> queue;
+    static size_t host_bytes = 0;           // loaded and being loaded
+    static unsigned loading = 0;
+    static unsigned arrived = 0;            // loaded since the last update
+    static unsigned dropped = 0;            // read but no longer wanted since the last update
+    static bool stopping = false;
+
+    static FILE *file = NULL;               // prefetch thread only, while it runs
+    static std::thread prefetcher;
+    static std::mutex state_mutex;
+    static std::condition_variable wake;
+
+    /* GL thread only */
+    static std::vector<uint32_t> order;     // chunks by priority, as of the last update
+    static size_t gpu_bytes = 0;
+    static bool uploads_pending = false;
+    static bool polling = false;
+
+
+    /*
+     * Reads queued chunks into memory, within the host budget, until
+     * stopped. A chunk that doesn't fit is skipped: only reads of chunks no
+     * longer wanted can hold its memory, and once they are dropped, the
+     * next update (see poll) queues it again.
+     */
+    static void prefetchLoop() {
+        Profiler::nameThread("prefetch");
+
+        const size_t budget = (size_t)Constants::stream_host_budget_mb << 20;
+        std::unique_lock<std::mutex> lock(state_mutex);
+
+        while (true) {
+            wake.wait(lock, []() { return stopping || !queue.empty(); });
+            if (stopping) return;
+
+            Chunk &chunk = chunks[queue.top().chunk];
+            queue.pop();
+
+            if (chunk.state != ON_DISK || !chunk.wanted) continue;
+            if (host_bytes + chunk.bytes > budget) continue; // requeued once a read is dropped
+
+            chunk.state = LOADING;
+            host_bytes += chunk.bytes;
+            loading++;
+
+            lock.unlock();
+
+            double start = Profiler::now();
+
+            std::unique_ptr<char[]> data(new char[chunk.bytes]);
+            bool ok = fseek64(file, chunk.info.offset, SEEK_SET) == 0
+                && fread(data.get(), 1, chunk.bytes, file) == chunk.bytes;
+
+            Profiler::record("chunk read", "load", start, Profiler::now() - start);
+
+            lock.lock();
+
+            loading--;
+            if (ok && chunk.wanted) {
+                chunk.host = std::move(data);
+                chunk.state = IN_HOST;
+                arrived++;
+            } else {
+                if (!ok) printf("Can't read chunk at %llu of \"%s\"\n", (unsigned long long)chunk.info.offset, stream_path);
+                if (ok) dropped++;
+                chunk.state = ON_DISK;
+                host_bytes -= chunk.bytes;
+            }
+        }
+    }
+
+
+    /*
+     * Starts the GL-side timer if it isn't already running.
+     */
+    static void startPolling() {
+        if (polling) return;
+
+        polling = true;
+        glutTimerFunc((unsigned int)(1000.0 / Constants::framerate), poll, 0);
+    }
+
+
+    /*
+     * Opens the chunk file of the model at filepath, building it first if it
+     * is missing or out of date, and starts streaming it in place of the
+     * current model.
+     *
+     * Returns true if streaming started; false otherwise.
+     */
+    bool open(const char *filepath) {
+        close();
+
+        if (!ChunkBuilder::upToDate(filepath) && !ChunkBuilder::build(filepath)) return false;
+
+        std::string path = ChunkBuilder::chunkPath(filepath);
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (fp == NULL) {
+            printf("Can't open \"%s\"\n", path.c_str());
+            return false;
+        }
+
+        std::vector<ChunkBuilder::ChunkInfo> infos;
+        bool ok = fread(&header, sizeof(header), 1, fp) == 1
+            && memcmp(header.magic, "MVC1", 4) == 0
+            && header.version == ChunkBuilder::VERSION;
+
+        if (ok) {
+            infos.resize(header.num_chunks);
+            ok = fseek64(fp, header.chunks_offset, SEEK_SET) == 0
+                && fread(infos.data(), sizeof(ChunkBuilder::ChunkInfo), infos.size(), fp) == infos.size();
+        }
+
+        if (!ok) {
+            printf("Invalid chunk file \"%s\"\n", path.c_str());
+            fclose(fp);
+            return false;
+        }
+
+        chunks = std::vector<Chunk>(infos.size());
+        for (size_t c = 0; c < chunks.size(); c++) {
+            chunks[c].info = infos[c];
+            chunks[c].bytes = ChunkBuilder::chunkBytes(infos[c]);
+            chunks[c].state = ON_DISK;
+            chunks[c].wanted = false;
+            chunks[c].visible = false;
+            chunks[c].priority = 0.0f;
+        }
+
+        file = fp;
+        strncpy(stream_path, filepath, sizeof(stream_path) - 1);
+        is_active = true;
+
+        stopping = false;
+        prefetcher = std::thread(prefetchLoop);
+
+        static bool registered = false;
+        if (!registered) {
+            atexit(shutdown);
+            registered = true;
+        }
+
+        Display::minx = header.minx; Display::miny = header.miny; Display::minz = header.minz;
+        Display::maxx = header.maxx; Display::maxy = header.maxy; Display::maxz = header.maxz;
+        Display::max_xy = header.max_xy;
+        Camera::resetCamera();
+
+        printf("Streaming \"%s\": %llu faces in %u chunks, %u MB in memory, %u MB on the GPU\n", filepath,
+            (unsigned long long)header.num_faces, header.num_chunks,
+            Constants::stream_host_budget_mb, Constants::stream_gpu_budget_mb);
+
+        Display::invalidate();
+        return true;
+    }
+
+
+    /*
+     * Stops streaming and frees every chunk, going back to the current
+     * model. Must be called with the shader window current.
+     */
+    void close() {
+        if (!is_active) return;
+
+        shutdown();
+
+        chunks.clear();
+        order.clear();
+        queue = std::priority_queue<Request>();
+        host_bytes = gpu_bytes = 0;
+        loading = arrived = dropped = 0;
+        uploads_pending = false;
+        is_active = false;
+
+        Scene::updateBounds();
+        Camera::resetCamera();
+        Display::invalidate();
+    }
+
+
+    /*
+     * Returns true while a model is being streamed.
+     */
+    bool active() {
+        return is_active;
+    }
+
+
+    /*
+     * Returns true if a box is at least partly inside the frustum planes.
+     */
+    static bool boxVisible(const GLfloat planes[6][4], const GLfloat *min, const GLfloat *max) {
+        for (int i = 0; i < 6; i++) {
+            const GLfloat *plane = planes[i];
+            GLfloat farthest = plane[3];
+            for (int k = 0; k < 3; k++) farthest += std::max(plane[k] * min[k], plane[k] * max[k]);
+
+            if (farthest < 0.0f) return false;
+        }
+        return true;
+    }
+
+
+    /*
+     * Returns the distance from the camera to the nearest point of a box.
+     */
+    static GLfloat boxDistance(const GLfloat *min, const GLfloat *max) {
+        GLfloat squared = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            GLfloat d = std::max(min[k] - Camera::camera[k], std::max(0.0f, Camera::camera[k] - max[k]));
+            squared += d * d;
+        }
+        return std::sqrt(squared);
+    }
+
+
+    /*
+     * Creates the VAO and buffers of a chunk in memory.
+     */
+    static void uploadChunk(Chunk &chunk) {
+        const char *data = chunk.host.get();
+        GLsizeiptr vertex_bytes = chunk.info.num_vertices * 3 * sizeof(GLfloat);
+
+        chunk.mesh.create();
+        glBindVertexArray(chunk.mesh.VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.mesh.pVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertex_bytes, data, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.mesh.nVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertex_bytes, data + vertex_bytes, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.mesh.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, chunk.info.num_indices * sizeof(GLuint),
+            data + 2 * vertex_bytes, GL_STATIC_DRAW);
+
+        Scene::bindInstances(0);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        chunk.mesh.bytes = chunk.bytes;
+        gpu_bytes += chunk.bytes;
+    }
+
+
+    /*
+     * Ranks the chunks for the given camera matrices, then frees, queues for
+     * reading, uploads and deletes chunks to match the budgets (see above).
+     * Called by the shader window before drawing.
+     */
+    void update(const GLfloat *projection, const GLfloat *modelview) {
+        if (!is_active) return;
+
+        Profiler::Scope scope("stream", "shaders");
+
+        GLfloat planes[6][4];
+        MeshClusters::extractPlanes(projection, modelview, planes);
+
+        GLfloat scale = header.max_xy > 0.0f ? header.max_xy : 1.0f;
+
+        /* Visible chunks always outrank the others */
+        order.resize(chunks.size());
+        for (uint32_t c = 0; c < chunks.size(); c++) {
+            Chunk &chunk = chunks[c];
+            chunk.visible = boxVisible(planes, chunk.info.min, chunk.info.max);
+            chunk.priority = (chunk.visible ? 1.0f : 0.0f)
+                + 1.0f / (1.0f + boxDistance(chunk.info.min, chunk.info.max) / scale);
+            order[c] = c;
+        }
+
+        std::sort(order.begin(), order.end(), [](uint32_t a, uint32_t b) {
+            return chunks[a].priority > chunks[b].priority;
+        });
+
+        const size_t host_budget = (size_t)Constants::stream_host_budget_mb << 20;
+        const size_t gpu_budget = (size_t)Constants::stream_gpu_budget_mb << 20;
+
+        size_t wanted_bytes = 0, gpu_wanted_bytes = 0, upload_bytes = 0;
+        bool queued = false;
+        uploads_pending = false;
+
+        static std::vector<Chunk *> uploads;
+        uploads.clear();
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+
+        std::priority_queue<Request> requests;
+
+        for (size_t i = 0; i < order.size(); i++) {
+            Chunk &chunk = chunks[order[i]];
+
+            chunk.wanted = wanted_bytes + chunk.bytes <= host_budget;
+            if (chunk.wanted) wanted_bytes += chunk.bytes;
+
+            if (!chunk.wanted && chunk.state == IN_HOST) {
+                chunk.host.reset();
+                chunk.state = ON_DISK;
+                host_bytes -= chunk.bytes;
+            }
+
+            if (chunk.wanted && chunk.state == ON_DISK) {
+                Request request = { chunk.priority, order[i] };
+                requests.push(request);
+                queued = true;
+            }
+
+            /* Same ranking on the GPU, within its own budget */
+            bool gpu_wanted = chunk.wanted && gpu_wanted_bytes + chunk.bytes <= gpu_budget;
+            if (gpu_wanted) gpu_wanted_bytes += chunk.bytes;
+
+            if (!gpu_wanted && chunk.mesh.VAO != 0) {
+                gpu_bytes -= chunk.mesh.bytes;
+                chunk.mesh.reset();
+            }
+
+            if (gpu_wanted && chunk.mesh.VAO == 0 && chunk.state == IN_HOST) {
+                if (upload_bytes < Constants::upload_bytes_per_frame) {
+                    uploads.push_back(&chunk);
+                    upload_bytes += chunk.bytes;
+                } else {
+                    uploads_pending = true;
+                }
+            }
+        }
+
+        queue.swap(requests);
+        arrived = dropped = 0;
+        bool busy = queued || loading > 0 || uploads_pending;
+
+        lock.unlock();
+
+        if (queued) wake.notify_one();
+
+        for (size_t i = 0; i < uploads.size(); i++) uploadChunk(*uploads[i]);
+
+        if (busy) startPolling();
+    }
+
+
+    /*
+     * Draws the visible chunks on the GPU, front to back, with the shader
+     * program in use. Leaves ShaderLoader on the current model.
+     */
+    void drawShaders(Stats &stats) {
+        memset(&stats, 0, sizeof(stats));
+        stats.chunks_total = chunks.size();
+        stats.gpu_bytes = gpu_bytes;
+
+        bool first = true;
+
+        for (size_t i = 0; i < order.size(); i++) {
+            const Chunk &chunk = chunks[order[i]];
+            if (!chunk.visible) break; // visible chunks come first
+            stats.chunks_visible++;
+
+            if (chunk.mesh.VAO == 0) continue;
+
+            glBindVertexArray(chunk.mesh.VAO);
+
+            if (first) {
+                ShaderLoader::useMesh(chunk.mesh);
+                ShaderLoader::uploadUniforms();
+                Scene::useIdentity();
+                first = false;
+            }
+
+            glDrawElements(GL_TRIANGLES, chunk.info.num_indices, GL_UNSIGNED_INT, NULL);
+            stats.chunks_drawn++;
+        }
+
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stats.host_bytes = host_bytes;
+
+        MeshPool::Entry *current = MeshPool::find(ObjectLoader::current.path);
+        if (current != NULL) ShaderLoader::useMesh(current->mesh);
+        glBindVertexArray(ShaderLoader::VAO);
+    }
+
+
+    /*
+     * Draws the visible chunks on the GPU, front to back, in the fixed
+     * pipeline window, from the buffers drawShaders uses.
+     */
+    void drawFixed(GLenum mode, Stats &stats) {
+        memset(&stats, 0, sizeof(stats));
+        stats.chunks_total = chunks.size();
+        stats.gpu_bytes = gpu_bytes;
+
+        for (size_t i = 0; i < order.size(); i++) {
+            const Chunk &chunk = chunks[order[i]];
+            if (!chunk.visible) break; // visible chunks come first
+            stats.chunks_visible++;
+
+            if (chunk.mesh.VAO == 0) continue;
+
+            Display::bindFixedMesh(chunk.mesh);
+            glDrawElements(mode, chunk.info.num_indices, GL_UNSIGNED_INT, NULL);
+            stats.chunks_drawn++;
+        }
+
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stats.host_bytes = host_bytes;
+    }
+
+
+    /*
+     * GL-side timer, running while chunks are being read or uploaded.
+     * Redraws (and so updates) once chunks have arrived, or once dropped
+     * reads have freed memory that skipped chunks can now use.
+     */
+    void poll(int t) {
+        bool redraw, busy;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            redraw = is_active && (arrived > 0 || dropped > 0 || uploads_pending);
+            busy = redraw || (is_active && (loading > 0 || !queue.empty()));
+        }
+
+        if (redraw) Display::invalidate();
+
+        if (busy) {
+            glutTimerFunc((unsigned int)(1000.0 / Constants::framerate), poll, 0);
+        } else {
+            polling = false;
+        }
+    }
+
+
+    /*
+     * Stops and joins the prefetch thread, after the read in progress (if
+     * any), and closes the chunk file. Registered with atexit.
+     */
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+
+        if (prefetcher.joinable()) prefetcher.join();
+
+        if (file != NULL) fclose(file);
+        file = NULL;
+    }
+
+}
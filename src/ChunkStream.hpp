@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef CHUNKSTREAM_H
+#define CHUNKSTREAM_H
+
+#include <stddef.h>
+
+#include "GL/freeglut.h"
+
+namespace ChunkStream {
+
+    /* Chunks drawn in one redraw, and the memory held for chunks */
+    struct Stats {
+        GLuint chunks_visible, chunks_drawn, chunks_total;
+        size_t host_bytes, gpu_bytes;
+    };
+
+    bool open(const char *filepath);
+    void close();
+    bool active();
+    void update(const GLfloat *projection, const GLfloat *modelview);
+    void drawShaders(Stats &stats);
+    void drawFixed(GLenum mode, Stats &stats);
+    void poll(int t);
+    void shutdown();
+
+}
+
+#endif
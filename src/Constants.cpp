@@ -25,13 +25,71 @@ namespace Constants {
     extern const GLfloat mat_sp[] = { 0.3f, 0.3f, 0.3f, 1.0f }; // specular
     extern const GLfloat mat_sh[] = { 50.0f }; // shininess
 
+    /* Model loading */
+    extern const unsigned loader_threads = 0;                   // parser threads (0 = one per core)
+    extern const unsigned parallel_parse_bytes = 8 << 20;       // smaller files are parsed serially
+
+    /* Read/write processed models as .mvb files next to the .obj files */
+    extern const bool USE_MESH_CACHE = true;
+
+    /* Reorder faces/vertices for the GPU vertex cache after loading */
+    extern const bool OPTIMIZE_MESH = true;
+    extern const unsigned vertex_cache_size = 16;               // simulated FIFO entries
+
+    /* Split models into clusters at load time and only draw those in view */
+    extern const bool FRUSTUM_CULLING = true;
+    extern const unsigned cluster_faces = 4096;                 // max faces per cluster
+
+    /* Build simplified levels of detail at load time, drawn when the model is far away */
+    extern const bool BUILD_LOD = true;
+    extern const int lod_levels = 3;
+    extern const GLfloat lod_ratios[] = { 0.5f, 0.25f, 0.1f };  // fraction of faces kept per level
+    extern const GLfloat lod_faces_per_pixel = 0.5f;            // minimum faces per covered pixel
+
+    /* Load models on a background thread while the current one is still drawn */
+    extern const bool ASYNC_LOADING = true;
+    extern const unsigned upload_bytes_per_frame = 16 << 20;    // GPU upload per timer tick
+    extern const unsigned gpu_mesh_budget = 256 << 20;          // GPU memory kept for recently viewed models
+    extern const unsigned host_mesh_budget = 1024u << 20;       // CPU memory kept for them (and the current model)
+
+    /* Instanced grids of the current model, cycled with the I key */
+    extern const int instance_layouts = 3;
+    extern const int instance_grid_sizes[] = { 1, 10, 100 };   // copies per row and column
+    extern const GLfloat instance_spacing = 1.5f;               // grid pitch, in model widths
+
+    /* Models too large for memory, split into chunks on disk and paged in (--stream) */
+    extern const unsigned stream_chunk_faces = 1 << 16;         // faces per chunk, roughly
+    extern const unsigned stream_host_budget_mb = 8192;         // chunk data kept in memory
+    extern const unsigned stream_gpu_budget_mb = 2048;          // chunk data kept on the GPU
+
+    /* Time the load, upload and draw stages, for the overlay ('o') and --trace */
+    extern const bool PROFILING = true;
+    extern const unsigned trace_max_events = 1 << 20;          // later events are dropped
+
+    /* Shader sources, rebuilt in the background when they change on disk */
+    extern const char vertex_shader_path[] = "vertexshader.txt";
+    extern const char fragment_shader_path[] = "fragmentshader.txt";
+    extern const bool SHADER_HOT_RELOAD = true;
+    extern const unsigned shader_poll_ms = 250;                 // reload check interval
+
+    /* Keep linked shader programs as driver binaries, so warm starts skip compiling */
+    extern const bool SHADER_BINARY_CACHE = true;
+    extern const char shader_cache_dir[] = "shadercache";
+
+    /* Upload 12-byte quantized vertices instead of 24-byte float vertices */
+    extern const bool PACKED_VERTICES = true;
+
     /* Print transfomation matrices to stdout (reduce framerate if used) */
     extern const bool DEBUG_MATRICES = false;
 
-    /* Render world/camera axes */
-    extern const bool RENDER_AXES = false;
+    /* Debug lines shown at startup (toggled with the X, V, C and K keys; see DebugDraw) */
+    extern const bool RENDER_AXES = false;          // world/camera axes
+    extern const bool RENDER_NORMALS = false;       // vertex normals
+    extern const bool RENDER_FACE_NORMALS = false;  // face normals
+    extern const bool RENDER_BOUNDS = false;        // model and cluster bounding boxes
+    extern const GLfloat normal_scale = 0.02f;      // normal line length, in model widths
 
-    /* Render vertex normals for all vertices */
-    extern const bool RENDER_NORMALS = false;
+    /* Show redraws/sec (and culling stats) of each window in its title bar */
+    extern const bool SHOW_REDRAW_RATE = true;
 
 }
\ No newline at end of file
@@ -28,9 +28,56 @@ namespace Constants {
     extern const GLfloat mat_sp[];
     extern const GLfloat mat_sh[];
 
+    /* Model loading */
+    extern const unsigned loader_threads;
+    extern const unsigned parallel_parse_bytes;
+    extern const bool USE_MESH_CACHE;
+    extern const bool OPTIMIZE_MESH;
+    extern const unsigned vertex_cache_size;
+    extern const bool FRUSTUM_CULLING;
+    extern const unsigned cluster_faces;
+    extern const bool BUILD_LOD;
+    extern const int lod_levels;
+    extern const GLfloat lod_ratios[];
+    extern const GLfloat lod_faces_per_pixel;
+    extern const bool ASYNC_LOADING;
+    extern const unsigned upload_bytes_per_frame;
+    extern const unsigned gpu_mesh_budget;
+    extern const unsigned host_mesh_budget;
+
+    /* Scene */
+    extern const int instance_layouts;
+    extern const int instance_grid_sizes[];
+    extern const GLfloat instance_spacing;
+
+    /* Out-of-core streaming */
+    extern const unsigned stream_chunk_faces;
+    extern const unsigned stream_host_budget_mb;
+    extern const unsigned stream_gpu_budget_mb;
+
+    /* Profiling */
+    extern const bool PROFILING;
+    extern const unsigned trace_max_events;
+
+    /* Shaders */
+    extern const char vertex_shader_path[];
+    extern const char fragment_shader_path[];
+    extern const bool SHADER_HOT_RELOAD;
+    extern const unsigned shader_poll_ms;
+
+    extern const bool SHADER_BINARY_CACHE;
+    extern const char shader_cache_dir[];
+
+    /* GPU vertex format */
+    extern const bool PACKED_VERTICES;
+
     extern const bool DEBUG_MATRICES;
     extern const bool RENDER_AXES;
     extern const bool RENDER_NORMALS;
+    extern const bool RENDER_FACE_NORMALS;
+    extern const bool RENDER_BOUNDS;
+    extern const GLfloat normal_scale;
+    extern const bool SHOW_REDRAW_RATE;
 
 }
 
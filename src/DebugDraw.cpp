@@ -0,0 +1,415 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+#include "glm/glm.hpp"
+
+#include "Camera.hpp"
+#include "ChunkStream.hpp"
+#include "Constants.hpp"
+#include "DebugDraw.hpp"
+#include "Display.hpp"
+#include "MeshClusters.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
+#include "ShaderLoader.hpp"
+
+
+/*
+ * Debug lines: world and camera axes, vertex normals, face normals, and the
+ * bounding boxes of the model and its clusters. The model's lines are built
+ * once whenever the model or the selection changes, and kept in one VBO
+ * that both windows draw from, after a small block for the axes (which
+ * follow the camera, and are rewritten when it moves). Everything shown is
+ * drawn with a single glDrawArrays(GL_LINES) call: through client state
+ * pointers into the VBO in the fixed window, and with a minimal line
+ * program, sharing the frame block of the model's shaders, in the shader
+ * window.
+ */
+namespace DebugDraw {
+
+    const bool DEBUG(false);
+
+    bool show_axes = Constants::RENDER_AXES;
+    bool show_normals = Constants::RENDER_NORMALS;
+    bool show_face_normals = Constants::RENDER_FACE_NORMALS;
+    bool show_bounds = Constants::RENDER_BOUNDS;
+
+    struct LineVertex {
+        GLfloat position[3];
+        GLfloat color[3];
+    };
+
+    /* Three world and three camera axes, at the start of the VBO */
+    static const GLsizei AXIS_VERTICES = 12;
+
+    /* Everything the model's lines are built from; they are rebuilt when
+     * any of it changes */
+    struct ModelKey {
+        const GLfloat *vertices, *normals;
+        const GLuint *indices;
+        GLuint num_vertices, num_indices;
+        const MeshClusters::Cluster *clusters;
+        GLuint num_clusters;
+        GLfloat length;
+        bool normals_shown, face_normals_shown, bounds_shown;
+    };
+
+    /* GL objects of the lines, shared by both windows */
+    struct LineBuffers {
+        GLuint vbo, vao;
+        size_t capacity;
+        unsigned version;
+        GLsizei model_vertices;
+        LineVertex axes[AXIS_VERTICES];
+    };
+
+    static std::vector<LineVertex> model_lines;
+    static ModelKey built_key;
+    static unsigned built_version = 0;
+
+    static LineBuffers buffers;
+    static GLuint program = 0;
+
+    static const char *VERTEX_SHADER =
+        "#version 330 core\n"
+        "layout (std140) uniform FrameBlock {\n"
+        "    mat4 modelViewMatrix;\n"
+        "    mat4 projectionMatrix;\n"
+        "    vec4 currentColor;\n"
+        "    vec4 lightDirection;\n"
+        "    vec4 halfVector;\n"
+        "};\n"
+        "layout (location = 0) in vec3 position;\n"
+        "layout (location = 1) in vec3 color;\n"
+        "out vec3 lineColor;\n"
+        "void main() {\n"
+        "    lineColor = color;\n"
+        "    gl_Position = projectionMatrix * modelViewMatrix * vec4(position, 1.0);\n"
+        "}\n";
+
+    static const char *FRAGMENT_SHADER =
+        "#version 330 core\n"
+        "in vec3 lineColor;\n"
+        "out vec4 fragColor;\n"
+        "void main() {\n"
+        "    fragColor = vec4(lineColor, 1.0);\n"
+        "}\n";
+
+
+    /*
+     * Returns true if anything is to be drawn.
+     */
+    bool enabled() {
+        return show_axes || show_normals || show_face_normals || show_bounds;
+    }
+
+
+    static void setVertex(LineVertex &vertex, const GLfloat *position, const GLfloat *color) {
+        memcpy(vertex.position, position, sizeof(vertex.position));
+        memcpy(vertex.color, color, sizeof(vertex.color));
+    }
+
+
+    static void addLine(const GLfloat *from, const GLfloat *to, const GLfloat *color) {
+        LineVertex line[2];
+        setVertex(line[0], from, color);
+        setVertex(line[1], to, color);
+        model_lines.insert(model_lines.end(), line, line + 2);
+    }
+
+
+    /*
+     * Adds the 12 edges of the box from min to max.
+     */
+    static void addBox(const GLfloat *min, const GLfloat *max, const GLfloat *color) {
+        for (int edge = 0; edge < 12; edge++) {
+            /* Each edge runs along one axis, at one of four corners of the other two */
+            int axis = edge / 4, a = (axis + 1) % 3, b = (axis + 2) % 3;
+            GLfloat from[3], to[3];
+
+            from[a] = to[a] = (edge & 1) ? max[a] : min[a];
+            from[b] = to[b] = (edge & 2) ? max[b] : min[b];
+            from[axis] = min[axis];
+            to[axis] = max[axis];
+
+            addLine(from, to, color);
+        }
+    }
+
+
+    /*
+     * Fills in the key of the current model and selection.
+     */
+    static void currentKey(ModelKey &key) {
+        memset(&key, 0, sizeof(key));
+
+        key.vertices = Display::vertexData;
+        key.normals = Display::normalData;
+        key.indices = Display::indexData;
+        key.num_vertices = Display::numVertices;
+        key.num_indices = Display::numIndices;
+        key.clusters = MeshClusters::clusterData;
+        key.num_clusters = MeshClusters::numClusters;
+        key.length = Constants::normal_scale * Display::max_xy;
+        key.normals_shown = show_normals;
+        key.face_normals_shown = show_face_normals;
+        key.bounds_shown = show_bounds;
+    }
+
+
+    /*
+     * Rebuilds the model's lines if the model or the selection changed
+     * since they were last built.
+     */
+    static void updateModelLines() {
+        ModelKey key;
+        currentKey(key);
+        if (built_version > 0 && memcmp(&key, &built_key, sizeof(key)) == 0) return;
+
+        Profiler::Scope scope("debug lines", "load");
+
+        static const GLfloat NORMAL_COLOR[3] = { 1.0f, 0.0f, 0.0f };
+        static const GLfloat FACE_NORMAL_COLOR[3] = { 1.0f, 1.0f, 0.0f };
+        static const GLfloat MODEL_BOX_COLOR[3] = { 1.0f, 1.0f, 1.0f };
+        static const GLfloat CLUSTER_BOX_COLOR[3] = { 0.0f, 0.8f, 0.8f };
+
+        std::vector<LineVertex>().swap(model_lines);
+
+        size_t count = 0;
+        if (key.normals_shown) count += key.num_vertices * 2;
+        if (key.face_normals_shown) count += key.num_indices / 3 * 2;
+        if (key.bounds_shown) count += (key.num_clusters + 1) * 24;
+        model_lines.reserve(count);
+
+        if (key.normals_shown && key.normals != NULL) {
+            for (GLuint v = 0; v < key.num_vertices; v++) {
+                const GLfloat *p = key.vertices + v * 3, *n = key.normals + v * 3;
+                GLfloat tip[3] = { p[0] + n[0] * key.length, p[1] + n[1] * key.length, p[2] + n[2] * key.length };
+                addLine(p, tip, NORMAL_COLOR);
+            }
+        }
+
+        /* Face normals start from each face's centroid */
+        if (key.face_normals_shown) {
+            for (GLuint i = 0; i + 2 < key.num_indices; i += 3) {
+                const GLfloat *a = key.vertices + key.indices[i] * 3;
+                const GLfloat *b = key.vertices + key.indices[i + 1] * 3;
+                const GLfloat *c = key.vertices + key.indices[i + 2] * 3;
+
+                GLfloat e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                GLfloat e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                GLfloat n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+                GLfloat norm = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (norm == 0.0f) continue;
+
+                GLfloat scale = key.length / norm;
+                GLfloat center[3], tip[3];
+                for (int j = 0; j < 3; j++) {
+                    center[j] = (a[j] + b[j] + c[j]) / 3.0f;
+                    tip[j] = center[j] + n[j] * scale;
+                }
+                addLine(center, tip, FACE_NORMAL_COLOR);
+            }
+        }
+
+        if (key.bounds_shown) {
+            GLfloat min[3] = { Display::minx, Display::miny, Display::minz };
+            GLfloat max[3] = { Display::maxx, Display::maxy, Display::maxz };
+            addBox(min, max, MODEL_BOX_COLOR);
+
+            for (GLuint c = 0; key.clusters != NULL && c < key.num_clusters; c++) {
+                addBox(key.clusters[c].min, key.clusters[c].max, CLUSTER_BOX_COLOR);
+            }
+        }
+
+        built_key = key;
+        built_version++;
+
+        if (DEBUG) printf("Built %u debug line vertices\n", (unsigned)model_lines.size());
+    }
+
+
+    /*
+     * Fills in the world axes and the camera's axes, as of now.
+     */
+    static void buildAxes(LineVertex *axes) {
+        static const GLfloat ORIGIN[3] = { 0.0f, 0.0f, 0.0f };
+        static const GLfloat WORLD[3][3] = { { 0.5f, 0.0f, 0.0f }, { 0.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.5f } };
+        static const GLfloat WORLD_COLORS[3][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+        static const GLfloat CAMERA_COLORS[3][3] = { { 0.5f, 0.0f, 0.0f }, { 0.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.5f } };
+
+        Camera::updateCameraAxes();
+        const glm::vec3 *camera_axes[3] = { &Camera::u_axis, &Camera::v_axis, &Camera::n_axis };
+
+        for (int i = 0; i < 3; i++) {
+            setVertex(axes[i * 2], ORIGIN, WORLD_COLORS[i]);
+            setVertex(axes[i * 2 + 1], WORLD[i], WORLD_COLORS[i]);
+
+            GLfloat tip[3];
+            for (int j = 0; j < 3; j++) tip[j] = (*camera_axes[i])[j] - Camera::camera[j];
+
+            setVertex(axes[6 + i * 2], ORIGIN, CAMERA_COLORS[i]);
+            setVertex(axes[6 + i * 2 + 1], tip, CAMERA_COLORS[i]);
+        }
+    }
+
+
+    /*
+     * Compiles the line program, with the model shaders' frame block
+     * binding.
+     */
+    static void createProgram() {
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(vs, 1, &VERTEX_SHADER, NULL);
+        glShaderSource(fs, 1, &FRAGMENT_SHADER, NULL);
+        glCompileShader(vs);
+        glCompileShader(fs);
+
+        program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            char log[1024] = "";
+            glGetProgramInfoLog(program, sizeof(log), NULL, log);
+            printf("Debug line program failed to link:\n%s\n", log);
+        }
+
+        GLuint blockIndex = glGetUniformBlockIndex(program, "FrameBlock");
+        if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(program, blockIndex, ShaderLoader::FRAME_BINDING);
+    }
+
+
+    /*
+     * Creates the buffer, the shader window's VAO and the line program on
+     * first use, and brings the buffer's contents up to date.
+     */
+    static void updateBuffers(bool with_model) {
+        if (buffers.vbo == 0) {
+            createProgram();
+
+            glGenBuffers(1, &buffers.vbo);
+            glGenVertexArrays(1, &buffers.vao);
+            glBindVertexArray(buffers.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers.vbo);
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex),
+                (GLvoid *)offsetof(LineVertex, position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex),
+                (GLvoid *)offsetof(LineVertex, color));
+
+            glBindVertexArray(0);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.vbo);
+
+        /* Model lines, after the axes block; the axes are rewritten below */
+        if (with_model && buffers.version != built_version) {
+            size_t size = (AXIS_VERTICES + model_lines.size()) * sizeof(LineVertex);
+
+            /* A new store loses the axes too */
+            if (size > buffers.capacity) {
+                glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+                buffers.capacity = size;
+                memset(buffers.axes, 0, sizeof(buffers.axes));
+            }
+            glBufferSubData(GL_ARRAY_BUFFER, AXIS_VERTICES * sizeof(LineVertex),
+                model_lines.size() * sizeof(LineVertex), model_lines.data());
+
+            buffers.model_vertices = (GLsizei)model_lines.size();
+            buffers.version = built_version;
+        }
+
+        if (buffers.capacity == 0) {
+            glBufferData(GL_ARRAY_BUFFER, sizeof(buffers.axes), NULL, GL_STATIC_DRAW);
+            buffers.capacity = sizeof(buffers.axes);
+        }
+
+        if (show_axes) {
+            LineVertex axes[AXIS_VERTICES];
+            buildAxes(axes);
+
+            if (memcmp(axes, buffers.axes, sizeof(axes)) != 0) {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(axes), axes);
+                memcpy(buffers.axes, axes, sizeof(axes));
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+
+    /*
+     * Returns the GPU memory held by the lines, in bytes.
+     */
+    size_t gpuBytes() {
+        return buffers.capacity;
+    }
+
+
+    /*
+     * Draws the selected lines over the current window's frame, with its
+     * camera matrices already set up. Model lines are only drawn for a
+     * single model; with a scene of instances or while streaming, only the
+     * axes are.
+     */
+    void draw(Profiler::View view) {
+        if (!enabled()) return;
+
+        Profiler::Scope scope("debug", view == Profiler::FIXED_VIEW ? "fixed" : "shaders");
+
+        bool with_model = Scene::isSingle() && !ChunkStream::active() &&
+            (show_normals || show_face_normals || show_bounds);
+        if (with_model) updateModelLines();
+
+        updateBuffers(with_model);
+
+        /* The axes come first, so whatever is shown is one range */
+        GLint first = show_axes ? 0 : AXIS_VERTICES;
+        GLsizei count = (show_axes ? AXIS_VERTICES : 0) + (with_model ? buffers.model_vertices : 0);
+        if (count == 0) return;
+
+        if (view == Profiler::FIXED_VIEW) {
+            glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+            glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+            glDisable(GL_LIGHTING);
+
+            glBindBuffer(GL_ARRAY_BUFFER, buffers.vbo);
+            glDisableClientState(GL_NORMAL_ARRAY);
+            glEnableClientState(GL_VERTEX_ARRAY);
+            glEnableClientState(GL_COLOR_ARRAY);
+            glVertexPointer(3, GL_FLOAT, sizeof(LineVertex), (GLvoid *)offsetof(LineVertex, position));
+            glColorPointer(3, GL_FLOAT, sizeof(LineVertex), (GLvoid *)offsetof(LineVertex, color));
+
+            glDrawArrays(GL_LINES, first, count);
+
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glPopClientAttrib();
+            glPopAttrib();
+        } else {
+            glUseProgram(program);
+            glBindVertexArray(buffers.vao);
+            glDrawArrays(GL_LINES, first, count);
+            glBindVertexArray(0);
+            glUseProgram(ShaderLoader::pID);
+        }
+    }
+
+}
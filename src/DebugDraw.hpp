@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef DEBUGDRAW_H
+#define DEBUGDRAW_H
+
+#include <stddef.h>
+
+#include "GL/freeglut.h"
+
+#include "Profiler.hpp"
+
+namespace DebugDraw {
+
+    /* What is drawn; toggled with the X, V, C and K keys */
+    extern bool show_axes;
+    extern bool show_normals;
+    extern bool show_face_normals;
+    extern bool show_bounds;
+
+    bool enabled();
+    size_t gpuBytes();
+    void draw(Profiler::View view);
+
+}
+
+#endif
@@ -1,7 +1,10 @@
 #define GLM_ENABLE_EXPERIMENTAL
 
+#include <float.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 
 #include "GL/glew.h"
@@ -11,13 +14,22 @@
 #include "glm/gtc/type_ptr.hpp"
 #include "glm/gtx/rotate_vector.hpp"
 
+#include "AsyncLoader.hpp"
 #include "Camera.hpp"
+#include "ChunkStream.hpp"
 #include "Constants.hpp"
+#include "DebugDraw.hpp"
 #include "Display.hpp"
 #include "ObjectLoader.hpp"
 #include "Keyboard.hpp"
+#include "MeshClusters.hpp"
+#include "MeshLod.hpp"
+#include "MeshPool.hpp"
 #include "Mouse.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
 #include "ShaderLoader.hpp"
+#include "VertexPacking.hpp"
 
 
 namespace Display {
@@ -28,13 +40,16 @@ namespace Display {
 
     char current_model[100] = "models\\bunny.obj";
 
-    std::vector<GLfloat> vertexCoords;
-    std::vector<GLuint> faceVertices;
-    std::vector<GLfloat> vertexNormals;
+    /* Arrays actually drawn; point into ObjectLoader::current, either into
+     * its vectors or into its mapped mesh cache */
+    const GLfloat *vertexData = NULL;
+    const GLfloat *normalData = NULL;
+    const GLuint *indexData = NULL;
+    GLuint numVertices = 0, numIndices = 0;
 
     /* Bounding coordinates of model */
-    GLfloat maxx = -10000, maxy = -10000, maxz = -10000;
-    GLfloat minx = 10000, miny = 10000, minz = 10000;
+    GLfloat maxx = -FLT_MAX, maxy = -FLT_MAX, maxz = -FLT_MAX;
+    GLfloat minx = FLT_MAX, miny = FLT_MAX, minz = FLT_MAX;
     GLfloat max_xy = 0;
 
     /* Light colors (synced between all light components) */
@@ -55,6 +70,42 @@ namespace Display {
     /* Addresses for each display window */
     int window_fixed, window_shaders;
 
+    /* Whether the input timer is scheduled; it only runs while input is held */
+    bool timer_active = false;
+
+    /* Redraws of each window since the last redraw rate update, and over
+     * the last full second */
+    unsigned redraws_fixed = 0, redraws_shaders = 0;
+    unsigned rate_fixed = 0, rate_shaders = 0;
+
+    /* Frustum culling results of the last redraw of each window */
+    MeshClusters::Stats culled_fixed, culled_shaders;
+
+    /* Level of detail of the last redraw (0 is the full mesh) */
+    GLuint lod_level = 0;
+
+    /* Instances drawn and culled in the last redraw of each window, when
+     * the Scene is more than the current model */
+    Scene::Stats scene_fixed, scene_shaders;
+
+    /* Chunks drawn in the last redraw of each window, while streaming */
+    ChunkStream::Stats stream_fixed, stream_shaders;
+
+    /* Everything the fixed window's lighting list is compiled from; it is
+     * compiled again when any of it changes */
+    struct LightingKey {
+        GLfloat red, green, blue;
+        GLfloat light_position[4];
+        unsigned light_on;
+        bool smooth_shading;
+    };
+
+    static GLuint lighting_list = 0;
+    static LightingKey lighting_key;
+
+    /* Views that are not redrawn on input (see cyclePausedView) */
+    bool view_paused[Profiler::NUM_VIEWS] = { false, false };
+
 
     /********************************************************************************
      *                              DISPLAY FUNCTIONS                               *
@@ -64,10 +115,17 @@ namespace Display {
       * Main display method for the fixed function pipeline rendering.
       *
       * Sets up the projection and modelview matrices based on camera variables.
-      * Calls glDrawElements once color, polygon mode, and viewing parameters have
-      * been accounted for. Uses glFrustum() and gluLookAt() to define the camera.
+      * Draws the model (see drawMesh) once color, polygon mode, and viewing parameters
+      * have been accounted for. Uses glFrustum() and gluLookAt() to define the camera.
+      * The model is drawn from the same buffers as in the shader window (see
+      * bindFixedMesh), and the lighting comes from a display list.
       */
     void displayFixed() {
+        Profiler::Scope scope("frame", "fixed");
+
+        /* The shader window's program stays bound in the shared context */
+        glUseProgram(0);
+
         /* Update the projection matrix */
         glMatrixMode(GL_PROJECTION);
         glLoadIdentity();
@@ -86,14 +144,259 @@ namespace Display {
             Camera::target[0], Camera::target[1], Camera::target[2],
             Camera::up[0], Camera::up[1], Camera::up[2]);
 
-        glColor3f(red, green, blue);
+        /* The same matrices in Camera's layout, for frustum culling */
+        if (Constants::FRUSTUM_CULLING || !Scene::isSingle() || ChunkStream::active()) {
+            Camera::calcProjectionMat();
+            Camera::calcModelViewMat();
+        }
+
         setPolygonMode();
+        callLightingList();
+
+        double draw_start = Profiler::now();
+        Profiler::beginGpu(Profiler::FIXED_VIEW);
+
+        if (ChunkStream::active()) {
+            ChunkStream::drawFixed(primitive_type, stream_fixed);
+        } else if (Scene::isSingle()) {
+            MeshPool::Entry *current = MeshPool::find(ObjectLoader::current.path);
+            if (current != NULL) {
+                bindFixedMesh(current->mesh);
+                pushDequantize(current->mesh);
+                drawMesh(primitive_type, culled_fixed);
+                popDequantize(current->mesh);
+            }
+        } else {
+            Scene::drawFixed(primitive_type, ShaderLoader::projectionMat, ShaderLoader::modelViewMat, scene_fixed);
+        }
+        unbindFixedMesh();
 
-        glVertexPointer(3, GL_FLOAT, 3 * sizeof(GL_FLOAT), &vertexCoords[0]);
-        glEnableClientState(GL_VERTEX_ARRAY);
+        Profiler::endGpu(Profiler::FIXED_VIEW);
+        Profiler::record("draw", "fixed", draw_start, Profiler::now() - draw_start);
+
+        DebugDraw::draw(Profiler::FIXED_VIEW);
+        if (Constants::DEBUG_MATRICES) Camera::printProjectionMatrix();
+        if (Constants::DEBUG_MATRICES) Camera::printModelViewMatrix();
+
+        Profiler::drawOverlay(Profiler::FIXED_VIEW, glutGet(GLUT_WINDOW_HEIGHT));
+
+        double swap_start = Profiler::now();
+        glFlush();
+        glutSwapBuffers();
+        Profiler::record("swap", "fixed", swap_start, Profiler::now() - swap_start);
+
+        redraws_fixed++;
+    }
+
+
+    /*
+     * Main display method for the custom GLSL shader rendering.
+     *
+     * Uses the program, shaders, and VAO set up in ShaderLoader to render in the second
+     * window using. Calls functions in Camera to calculate the projection and modelview
+     * matrices, based on the current parameters used by glFrustum and gluLookAt, as in
+     * the displayFixed function for the first window.
+     */
+    void displayShaders() {
+        Profiler::Scope scope("frame", "shaders");
+
+        /* The variant specialized for the current shading, lighting and render modes */
+        ShaderLoader::useVariant();
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+
+        Camera::calcProjectionMat();
+        Camera::calcModelViewMat();
+        updateHalfVector();
+
+        /* Only uniforms that changed since the last frame are sent */
+        ShaderLoader::uploadUniforms();
+
+        setPolygonMode();
+
+        double draw_start = Profiler::now();
+        Profiler::beginGpu(Profiler::SHADERS_VIEW);
+
+        glBindVertexArray(ShaderLoader::VAO);
+        if (ChunkStream::active()) {
+            ChunkStream::update(ShaderLoader::projectionMat, ShaderLoader::modelViewMat);
+            ChunkStream::drawShaders(stream_shaders);
+        } else if (Scene::isSingle()) {
+            Scene::useIdentity();
+            drawMesh(GL_TRIANGLES, culled_shaders);
+        } else {
+            Scene::drawShaders(ShaderLoader::projectionMat, ShaderLoader::modelViewMat, scene_shaders);
+        }
+        glBindVertexArray(0);
+
+        DebugDraw::draw(Profiler::SHADERS_VIEW);
+
+        Profiler::endGpu(Profiler::SHADERS_VIEW);
+        Profiler::record("draw", "shaders", draw_start, Profiler::now() - draw_start);
+
+        ShaderLoader::drawErrors();
+
+        Profiler::drawOverlay(Profiler::SHADERS_VIEW, glutGet(GLUT_WINDOW_HEIGHT));
+
+        double swap_start = Profiler::now();
+        glutSwapBuffers();
+        Profiler::record("swap", "shaders", swap_start, Profiler::now() - swap_start);
+
+        redraws_shaders++;
+    }
+
+
+    /*
+     * Draws the current model's faces from the bound element buffer, at the
+     * level of detail picked by MeshLod::selectLevel. With
+     * Constants::FRUSTUM_CULLING, only the clusters inside the frustum of
+     * the current camera matrices are drawn, in one glMultiDrawElements
+     * call, and stats receives what was culled.
+     */
+    void drawMesh(GLenum mode, MeshClusters::Stats &stats) {
+        lod_level = MeshLod::selectLevel();
+
+        const GLvoid *indices = NULL;
+        const MeshClusters::Cluster *clusters = MeshClusters::clusterData;
+        GLuint first = 0, count = numIndices;
+
+        /* Simplified levels follow the full mesh in the element buffer */
+        if (lod_level > 0) {
+            indices = (const GLvoid *)(numIndices * sizeof(GLuint));
+            clusters = MeshLod::levelClusters(lod_level);
+            first = MeshLod::levelData[lod_level - 1].first_index;
+            count = MeshLod::levelData[lod_level - 1].num_indices;
+        }
+
+        if (!Constants::FRUSTUM_CULLING || MeshClusters::numNodes == 0 || clusters == NULL) {
+            memset(&stats, 0, sizeof(stats));
+            glDrawElements(mode, count, GL_UNSIGNED_INT, (const char *)indices + first * sizeof(GLuint));
+            return;
+        }
+
+        static std::vector<GLsizei> counts;
+        static std::vector<const GLvoid *> offsets;
+
+        GLfloat planes[6][4];
+        MeshClusters::extractPlanes(ShaderLoader::projectionMat, ShaderLoader::modelViewMat, planes);
+        MeshClusters::cull(planes, clusters, indices, counts, offsets, stats);
+
+        if (!counts.empty()) {
+            glMultiDrawElements(mode, counts.data(), GL_UNSIGNED_INT, offsets.data(), counts.size());
+        }
+    }
+
+
+    /*
+     * Points the fixed pipeline's arrays at a mesh's buffers, the ones the
+     * shader window draws from too, and binds its element buffer; no VAO is
+     * bound, so this is the default VAO's state. Packed positions are fed
+     * through generic attribute 0, which stands in for the vertex position
+     * in the compatibility profile (see pushDequantize).
+     */
+    void bindFixedMesh(const MeshPool::GpuMesh &mesh) {
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.pVBO);
+
+        if (mesh.packed) {
+            GLsizei stride = sizeof(VertexPacking::PackedVertex);
+
+            glDisableClientState(GL_VERTEX_ARRAY);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                (GLvoid*)offsetof(VertexPacking::PackedVertex, position));
+            glNormalPointer(GL_INT_2_10_10_10_REV, stride,
+                (GLvoid*)offsetof(VertexPacking::PackedVertex, normal));
+        } else {
+            glDisableVertexAttribArray(0);
+            glEnableClientState(GL_VERTEX_ARRAY);
+            glVertexPointer(3, GL_FLOAT, 3 * sizeof(GLfloat), (GLvoid*)0);
+
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.nVBO);
+            glNormalPointer(GL_FLOAT, 3 * sizeof(GLfloat), (GLvoid*)0);
+        }
 
-        glNormalPointer(GL_FLOAT, 3 * sizeof(GL_FLOAT), &vertexNormals[0]);
         glEnableClientState(GL_NORMAL_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+    }
+
+
+    /*
+     * Undoes bindFixedMesh.
+     */
+    void unbindFixedMesh() {
+        glDisableVertexAttribArray(0);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+
+    /*
+     * Packed positions arrive in [0, 1] of the mesh's bounds. Scaling them
+     * in the modelview matrix would scale the normals too, so for a packed
+     * mesh the dequantization D goes into the projection matrix instead,
+     * as P * MV * D * inverse(MV): vertices end up in the same place, and
+     * normals only see the modelview. Lighting then sees eye space positions
+     * that are off, which makes no difference with a directional light and
+     * an infinite viewer. Call with the final modelview loaded; undone by
+     * popDequantize.
+     */
+    void pushDequantize(const MeshPool::GpuMesh &mesh) {
+        if (!mesh.packed) return;
+
+        glm::mat4 projection, modelview;
+        glGetFloatv(GL_PROJECTION_MATRIX, glm::value_ptr(projection));
+        glGetFloatv(GL_MODELVIEW_MATRIX, glm::value_ptr(modelview));
+
+        glm::mat4 dequantize = glm::scale(glm::translate(glm::mat4(1.0f),
+            glm::make_vec3(mesh.positionOffset)), glm::make_vec3(mesh.positionScale));
+
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadMatrixf(glm::value_ptr(projection * modelview * dequantize * glm::inverse(modelview)));
+        glMatrixMode(GL_MODELVIEW);
+    }
+
+
+    void popDequantize(const MeshPool::GpuMesh &mesh) {
+        if (!mesh.packed) return;
+
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+    }
+
+
+    /*
+     * Sets the fixed window's color, lights, material and shading model by
+     * calling a display list, which is compiled again only when one of them
+     * has changed. Call with the camera's modelview loaded, as the light
+     * position is transformed when the list is called.
+     */
+    void callLightingList() {
+        LightingKey key;
+        memset(&key, 0, sizeof(key));
+        key.red = red;
+        key.green = green;
+        key.blue = blue;
+        memcpy(key.light_position, light_position, sizeof(key.light_position));
+        key.light_on = light_on;
+        key.smooth_shading = smooth_shading;
+
+        if (lighting_list != 0 && memcmp(&key, &lighting_key, sizeof(key)) == 0) {
+            glCallList(lighting_list);
+            return;
+        }
+
+        if (lighting_list == 0) lighting_list = glGenLists(1);
+        lighting_key = key;
+
+        glNewList(lighting_list, GL_COMPILE_AND_EXECUTE);
+
+        glColor3f(red, green, blue);
 
         if (light_on) {
             glEnable(GL_LIGHTING);
@@ -134,62 +437,14 @@ namespace Display {
             glShadeModel(GL_FLAT);
         }
 
-        glDrawElements(primitive_type, faceVertices.size(),
-            GL_UNSIGNED_INT, &faceVertices[0]);
-
-        if (Constants::RENDER_AXES) renderAxes();
-        if (Constants::RENDER_NORMALS) renderNormals();
-        if (Constants::DEBUG_MATRICES) Camera::printProjectionMatrix();
-        if (Constants::DEBUG_MATRICES) Camera::printModelViewMatrix();
-
-        glFlush();
-        glutSwapBuffers();
-    }
-
-
-    /*
-     * Main display method for the custom GLSL shader rendering.
-     *
-     * Uses the program, shaders, and VAO set up in ShaderLoader to render in the second
-     * window using. Calls functions in Camera to calculate the projection and modelview
-     * matrices, based on the current parameters used by glFrustum and gluLookAt, as in
-     * the displayFixed function for the first window.
-     */
-    void displayShaders() {
-        glUseProgram(ShaderLoader::pID);
-
-        glValidateProgram(ShaderLoader::pID);
-        GLint validate = 0;
-        glGetProgramiv(ShaderLoader::pID, GL_VALIDATE_STATUS, &validate);
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-
-        Camera::calcProjectionMat();
-        Camera::calcModelViewMat();
-
-        GLint modelViewMatLocation = glGetUniformLocation(ShaderLoader::pID, "modelViewMatrix");
-        GLint projectionMatLocation = glGetUniformLocation(ShaderLoader::pID, "projectionMatrix");
-
-        glUniformMatrix4fv(modelViewMatLocation, 1, GL_FALSE, ShaderLoader::modelViewMat);
-        glUniformMatrix4fv(projectionMatLocation, 1, GL_FALSE, ShaderLoader::projectionMat);
-
-        setPolygonMode();
-        updateShadingUniform();
-        updateLightOnUniform();
-        updateHalfVector();
-
-        glBindVertexArray(ShaderLoader::VAO);
-        glDrawElements(GL_TRIANGLES, faceVertices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        glutSwapBuffers();
+        glEndList();
     }
 
 
     /* 
      * Handles input that should be executed simultaneously (such as translation in 
      * multiple directions), that can't be handled in the keyboard or mouse functions.
+     * Reschedules itself only while such input is held; see startTimer.
      */
     void timer(int t) {
 
@@ -219,148 +474,232 @@ namespace Display {
         if (Keyboard::keyPressed['n'] && !Keyboard::increase) Camera::near_clip -= Constants::clip_speed;
         if (Keyboard::keyPressed['f'] && !Keyboard::increase) Camera::decreaseFarClip();
 
-        /* Redraw renderings */
-        glutSetWindow(window_fixed);
-        glutPostRedisplay();
+        /* Redraw renderings, and keep polling while input is held */
+        if (inputActive()) {
+            invalidate();
+            glutTimerFunc((unsigned int)(1000.0 / Constants::framerate), timer, 0);
+        } else {
+            timer_active = false;
+        }
+    }
+
 
-        glutSetWindow(window_shaders);
-        glutPostRedisplay();
+    /*
+     * Returns true while any key or mouse button handled by timer is held.
+     */
+    bool inputActive() {
+        const char held[] = { 'w', 'a', 's', 'd', 'r', 'g', 'b', 'n', 'f' };
+        for (unsigned i = 0; i < sizeof(held); i++) {
+            if (Keyboard::keyPressed[(unsigned char)held[i]]) return true;
+        }
+        return Mouse::left_press || Mouse::right_press;
+    }
+
+
+    /*
+     * Schedules the input timer if it isn't already running. Called by the
+     * keyboard and mouse handlers whenever continuous input begins.
+     */
+    void startTimer() {
+        if (timer_active) return;
 
+        timer_active = true;
         glutTimerFunc((unsigned int)(1000.0 / Constants::framerate), timer, 0);
     }
 
 
     /*
-     * Sets the polygon mode (solid, wireframe, or points). 
+     * Marks both views as out of date, so each window is redrawn once on
+     * the next pass of the main loop. Nothing is redrawn until something
+     * calls this (or GLUT needs a window repainted).
      */
-    void setPolygonMode() {
-        if (render_mode == SOLID) {
-            primitive_type = GL_TRIANGLES;
-            glPolygonMode(GL_FRONT, GL_FILL);
-        } else if (render_mode == WIREFRAME) {
-            primitive_type = GL_TRIANGLES;
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        } else if (render_mode == POINTS) {
-            primitive_type = GL_POINTS;
-            glPolygonMode(GL_FRONT, GL_POINT);
+    void invalidate() {
+        int current = glutGetWindow();
+
+        if (!view_paused[Profiler::FIXED_VIEW]) {
+            glutSetWindow(window_fixed);
+            glutPostRedisplay();
         }
 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+        if (!view_paused[Profiler::SHADERS_VIEW]) {
+            glutSetWindow(window_shaders);
+            glutPostRedisplay();
+        }
+
+        if (current) glutSetWindow(current);
     }
 
 
     /*
-     * Optional method to render the world/camera axes.
+     * Pauses the fixed view, then the shader view, then neither, so that
+     * each view can be redrawn (and timed) on its own. A paused window keeps
+     * its last frame; it is still repainted when GLUT needs it to be.
      */
-    void renderAxes() {
-        glBegin(GL_LINES);
-
-        /* World axes */
-        glColor3f(1, 0, 0);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(0.5f, 0.0f, 0.0f);
-
-        glColor3f(0, 1, 0);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(0.0f, 0.5f, 0.0f);
-
-        glColor3f(0, 0, 1);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(0.0f, 0.0f, 0.5f);
-
-        /* Camera axes */
-        Camera::updateCameraAxes();
-
-        glColor3f(0.5, 0.0, 0.0);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(Camera::u_axis[0] - Camera::camera[0],
-            Camera::u_axis[1] - Camera::camera[1],
-            Camera::u_axis[2] - Camera::camera[2]);
-
-        glColor3f(0.0, 0.5, 0.0);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(Camera::v_axis[0] - Camera::camera[0],
-            Camera::v_axis[1] - Camera::camera[1],
-            Camera::v_axis[2] - Camera::camera[2]);
-
-        glColor3f(0.0, 0.0, 0.5);
-        glVertex3f(0.0f, 0.0f, 0.0f);
-        glVertex3f(Camera::n_axis[0] - Camera::camera[0],
-            Camera::n_axis[1] - Camera::camera[1],
-            Camera::n_axis[2] - Camera::camera[2]);
-
-        glEnd();
+    void cyclePausedView() {
+        if (view_paused[Profiler::FIXED_VIEW]) {
+            view_paused[Profiler::FIXED_VIEW] = false;
+            view_paused[Profiler::SHADERS_VIEW] = true;
+        } else if (view_paused[Profiler::SHADERS_VIEW]) {
+            view_paused[Profiler::SHADERS_VIEW] = false;
+        } else {
+            view_paused[Profiler::FIXED_VIEW] = true;
+        }
+
+        updateTitles();
+    }
+
+
+    /*
+     * Returns the GPU memory held for both windows, in bytes: the resident
+     * models, the streamed chunks and the debug lines, each uploaded once
+     * to the shared context.
+     */
+    static size_t gpuBytes() {
+        size_t bytes = MeshPool::residentBytes() + DebugDraw::gpuBytes();
+        if (ChunkStream::active()) bytes += stream_shaders.gpu_bytes;
+        return bytes;
     }
 
+
     /*
-     * Draws a line outwards from each vertex, along its vertex normal.
-     * Warning: may slow down rendering significantly, depending on vertex count.
+     * Formats a window title with the redraw rate, the average CPU and GPU
+     * time of a frame, the GPU memory in use, the level of detail and,
+     * when frustum culling is enabled, what was culled in the window's last
+     * redraw; or, for a scene of instances, how many were culled and drawn
+     * in how many draw calls; or, while streaming, the chunks drawn and the
+     * memory they hold. The progress of a background model load is appended.
      */
-    void renderNormals() {
-        for (unsigned int i = 0; i < vertexCoords.size(); i += 3) {
-            glBegin(GL_LINES);
+    static void formatTitle(char *title, const char *name, Profiler::View view, unsigned redraws,
+        const MeshClusters::Stats &culled, const Scene::Stats &scene,
+        const ChunkStream::Stats &stream) {
+
+        char loading[128];
+        bool is_loading = AsyncLoader::describe(loading, sizeof(loading));
+
+        if (!Constants::SHOW_REDRAW_RATE) {
+            if (is_loading) sprintf(title, "%s (%s)", name, loading);
+            else strcpy(title, name);
+            return;
+        }
 
-            glColor3f(1, 0, 0);
-            glVertex3f(vertexCoords[i], vertexCoords[i + 1], vertexCoords[i + 2]);
-            glVertex3f(vertexCoords[i] + vertexNormals[i] * 0.1f,
-                vertexCoords[i + 1] + vertexNormals[i + 1] * 0.1f,
-                vertexCoords[i + 2] + vertexNormals[i + 2] * 0.1f);
+        int length = sprintf(title, "%s (%u redraws/sec", name, redraws);
+
+        const char *category = view == Profiler::FIXED_VIEW ? "fixed" : "shaders";
+        double frame_time = Profiler::average("frame", category);
+        double gpu_time = Profiler::average("gpu", category);
+
+        if (frame_time > 0.0) length += sprintf(title + length, ", %.2f ms/frame", frame_time / 1000.0);
+        if (gpu_time > 0.0) length += sprintf(title + length, " (%.2f ms GPU)", gpu_time / 1000.0);
+        length += sprintf(title + length, ", %.1f MB on GPU", gpuBytes() / 1048576.0);
+
+        if (ChunkStream::active()) {
+            length += sprintf(title + length, ", %u/%u visible chunks drawn of %u, %.0f MB in memory, %.0f MB of chunks on GPU",
+                stream.chunks_drawn, stream.chunks_visible, stream.chunks_total,
+                stream.host_bytes / 1048576.0, stream.gpu_bytes / 1048576.0);
+        } else if (!Scene::isSingle()) {
+            length += sprintf(title + length, ", culled %u/%u instances, %u draws",
+                scene.instances_culled, scene.instances_total, scene.draw_calls);
+        } else if (MeshLod::numLevels > 0) {
+            length += sprintf(title + length, ", LOD %u", lod_level);
+        }
 
-            glEnd();
+        if (Scene::isSingle() && !ChunkStream::active() && Constants::FRUSTUM_CULLING && culled.clusters_total > 0) {
+            length += sprintf(title + length, ", culled %u/%u clusters, %u/%u triangles",
+                culled.clusters_culled, culled.clusters_total,
+                culled.triangles_culled, culled.triangles_total);
         }
+
+        if (is_loading) length += sprintf(title + length, ", %s", loading);
+        if (view_paused[view]) length += sprintf(title + length, ", paused");
+
+        sprintf(title + length, ")");
     }
 
 
-    /* 
-     * Increments specified color, enforcing 1.0 as the maximum value.
+    /*
+     * Shows the redraw rate (with frame times, GPU memory, the level of
+     * detail and culling stats) and any load in progress in each window's
+     * title bar. Titles are only touched when they change.
      */
-    void colorUp(GLfloat *color) {
-        if (*color >= 1.0) *color = 1.0;
-        else *color += Constants::color_speed;
-        updateColorUniform();
+    void updateTitles() {
+        static char shown_fixed[400], shown_shaders[400];
+        char title[400];
+        int current = glutGetWindow();
+
+        formatTitle(title, "Fixed Pipeline", Profiler::FIXED_VIEW, rate_fixed, culled_fixed, scene_fixed, stream_fixed);
+        if (strcmp(title, shown_fixed) != 0) {
+            glutSetWindow(window_fixed);
+            glutSetWindowTitle(title);
+            strcpy(shown_fixed, title);
+        }
+
+        formatTitle(title, "Custom Shaders", Profiler::SHADERS_VIEW, rate_shaders, culled_shaders, scene_shaders, stream_shaders);
+        if (strcmp(title, shown_shaders) != 0) {
+            glutSetWindow(window_shaders);
+            glutSetWindowTitle(title);
+            strcpy(shown_shaders, title);
+        }
+
+        if (current) glutSetWindow(current);
     }
 
 
-    /* 
-     * Decrements specified color, enforcing 0.0 as the minimum value.
+    /*
+     * Once a second, takes how many times each window was redrawn and
+     * updates the titles.
      */
-    void colorDown(GLfloat *color) {
-        if (*color <= 0.0) *color = 0.0;
-        else *color -= Constants::color_speed;
-        updateColorUniform();
+    void redrawRateTimer(int t) {
+        rate_fixed = redraws_fixed;
+        rate_shaders = redraws_shaders;
+        redraws_fixed = 0;
+        redraws_shaders = 0;
+
+        updateTitles();
+        glutTimerFunc(1000, redrawRateTimer, 0);
     }
 
 
-    /* 
-     * Updates the currentColor uniform of fragmentshader using the latest values.
+    /*
+     * Sets the polygon mode (solid, wireframe, or points). 
      */
-    void updateColorUniform() {
-        GLint currentColorLocation = glGetUniformLocation(ShaderLoader::pID, "currentColor");
-        glUniform4f(currentColorLocation, red, green, blue, 1.0);
+    void setPolygonMode() {
+        if (render_mode == SOLID) {
+            primitive_type = GL_TRIANGLES;
+            glPolygonMode(GL_FRONT, GL_FILL);
+        } else if (render_mode == WIREFRAME) {
+            primitive_type = GL_TRIANGLES;
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        } else if (render_mode == POINTS) {
+            primitive_type = GL_POINTS;
+            glPolygonMode(GL_FRONT, GL_POINT);
+        }
+
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
     }
 
 
     /* 
-     * Updates the smoothShading uniform of fragmentshader.
+     * Increments specified color, enforcing 1.0 as the maximum value.
      */
-    void updateShadingUniform() {
-        GLint smoothShadingLocation = glGetUniformLocation(ShaderLoader::pID, "smoothShading");
-        glUniform1i(smoothShadingLocation, Display::smooth_shading);
+    void colorUp(GLfloat *color) {
+        if (*color >= 1.0) *color = 1.0;
+        else *color += Constants::color_speed;
     }
 
 
     /* 
-     * Updates the lightOn uniform of fragmentshader.
+     * Decrements specified color, enforcing 0.0 as the minimum value.
      */
-    void updateLightOnUniform() {
-        GLint lightOnLocation = glGetUniformLocation(ShaderLoader::pID, "lightOn");
-        glUniform1i(lightOnLocation, light_on);
+    void colorDown(GLfloat *color) {
+        if (*color <= 0.0) *color = 0.0;
+        else *color -= Constants::color_speed;
     }
 
 
     /* 
-     * Calculates and updates the halfVector uniform of fragmentshader.
+     * Calculates the halfVector uniform of fragmentshader from the light
+     * direction and line of sight; uploaded with the frame block.
      */
     void updateHalfVector() {
         glm::vec3 L(light_position[0], light_position[1], light_position[2]);
@@ -373,72 +712,22 @@ namespace Display {
 
         glm::vec3 H = glm::normalize(V + L);
         halfVector[0] = H[0]; halfVector[1] = H[1]; halfVector[2] = H[2];
-
-        GLint halfVectorLocation = glGetUniformLocation(ShaderLoader::pID, "halfVector");
-        glUniform3fv(halfVectorLocation, 1, halfVector);
     }
 
 
-    /* 
-     * Called by ObjectLoader when the model is changed, and the VAO for the shaders
-     * needs to be updated.
+    /*
+     * Sets the arrays used for drawing the current model. Called by
+     * ObjectLoader when a model is installed.
      */
-    void reinitializeShaders() {
-        ShaderLoader::initBufferObject();
+    void setMeshArrays(const GLfloat *positions, const GLfloat *normals,
+        const GLuint *indices, GLuint num_vertices, GLuint num_indices) {
+
+        vertexData = positions;
+        normalData = normals;
+        indexData = indices;
+        numVertices = num_vertices;
+        numIndices = num_indices;
     }
 
 }
 
-
-void main(int argc, char **argv) {
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitContextFlags(GLUT_COMPATIBILITY_PROFILE);
-
-    if (!ObjectLoader::loadObject(Display::current_model)) {
-        exit(1);
-    }
-
-
-    /********************************************************************************
-     *                         Left window (fixed pipeline)                         *
-     ********************************************************************************/
-
-    glutInitWindowSize(Constants::window_w, Constants::window_h);
-    glutInitWindowPosition(Constants::window1_x, Constants::window1_y);
-    Display::window_fixed = glutCreateWindow("Fixed Pipeline");
-
-    Camera::resetCamera();
-    glutDisplayFunc(Display::displayFixed);
-
-
-    /********************************************************************************
-     *                         Right window (custom shaders)                        *
-     ********************************************************************************/
-
-    glutInitWindowSize(Constants::window_w, Constants::window_h);
-    glutInitWindowPosition(Constants::window2_x, Constants::window2_y);
-    Display::window_shaders = glutCreateWindow("Custom Shaders");
-    glewInit();
-
-    ShaderLoader::initBufferObject();
-    ShaderLoader::setShaders();
-
-    glutDisplayFunc(Display::displayShaders);
-
-    /* Assign all keyboard and mouse functions to the second window, including the
-     * cursor reset to its center; user input controls rendering in both windows */
-
-    glutSetCursor(GLUT_CURSOR_NONE);
-    glutWarpPointer(Constants::window_w / 2, Constants::window_h / 2);
-
-    glutMouseFunc(Mouse::mouseButton);
-    glutPassiveMotionFunc(Mouse::mouseMove);
-    glutKeyboardFunc(Keyboard::keyPress);
-    glutKeyboardUpFunc(Keyboard::keyRelease);
-
-    /* Begin timer function for changing most rendering variables */
-    glutTimerFunc((unsigned int) (1000.0 / Constants::framerate), Display::timer, 0);
-
-    glutMainLoop();
-}
\ No newline at end of file
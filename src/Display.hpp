@@ -7,6 +7,12 @@
 
 #include "GL/freeglut.h"
 
+#include "ChunkStream.hpp"
+#include "MeshClusters.hpp"
+#include "MeshPool.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
+
 namespace Display {
 
     /* Rendering modes */
@@ -21,9 +27,10 @@ namespace Display {
 
     extern char current_model[100];
 
-    extern std::vector<GLfloat> vertexCoords;
-    extern std::vector<GLuint> faceVertices;
-    extern std::vector<GLfloat> vertexNormals;
+    extern const GLfloat *vertexData;
+    extern const GLfloat *normalData;
+    extern const GLuint *indexData;
+    extern GLuint numVertices, numIndices;
 
     extern GLfloat maxx, maxy, maxz;
     extern GLfloat minx, miny, minz;
@@ -41,21 +48,34 @@ namespace Display {
     extern GLenum primitive_type;
 
     extern int window_fixed, window_shaders;
+    extern MeshClusters::Stats culled_fixed, culled_shaders;
+    extern GLuint lod_level;
+    extern Scene::Stats scene_fixed, scene_shaders;
+    extern ChunkStream::Stats stream_fixed, stream_shaders;
+    extern bool view_paused[Profiler::NUM_VIEWS];
 
 
     void displayFixed();
     void displayShaders();
     void timer(int t);
+    bool inputActive();
+    void startTimer();
+    void invalidate();
+    void cyclePausedView();
+    void updateTitles();
+    void redrawRateTimer(int t);
+    void drawMesh(GLenum mode, MeshClusters::Stats &stats);
+    void bindFixedMesh(const MeshPool::GpuMesh &mesh);
+    void unbindFixedMesh();
+    void pushDequantize(const MeshPool::GpuMesh &mesh);
+    void popDequantize(const MeshPool::GpuMesh &mesh);
+    void callLightingList();
     void setPolygonMode();
-    void renderAxes();
-    void renderNormals();
     void colorUp(GLfloat *color);
     void colorDown(GLfloat *color);
-    void updateColorUniform();
-    void updateShadingUniform();
-    void updateLightOnUniform();
     void updateHalfVector();
-    void reinitializeShaders();
+    void setMeshArrays(const GLfloat *positions, const GLfloat *normals,
+        const GLuint *indices, GLuint num_vertices, GLuint num_indices);
 
 }
 
@@ -1,8 +1,12 @@
 #include <stdlib.h>
 
+#include "DebugDraw.hpp"
 #include "Display.hpp"
 #include "ObjectLoader.hpp"
 #include "Camera.hpp"
+#include "ChunkStream.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
 
 namespace Keyboard {
 
@@ -58,8 +62,30 @@ namespace Keyboard {
         if (key == '9') ObjectLoader::changeModel("models\\bunny.obj");
         else if (key == '0') ObjectLoader::changeModel("models\\cactus.obj");
 
+        /* Cycle instanced grids of the model, and frame them */
+        if ((key == 'i' || key == 'I') && !ChunkStream::active()) {
+            Scene::cycleLayout();
+            Camera::resetCamera();
+        }
+
+        /* Toggle debug lines: axes, vertex normals, face normals, bounding boxes */
+        if (key == 'x' || key == 'X') DebugDraw::show_axes = !DebugDraw::show_axes;
+        if (key == 'v' || key == 'V') DebugDraw::show_normals = !DebugDraw::show_normals;
+        if (key == 'c' || key == 'C') DebugDraw::show_face_normals = !DebugDraw::show_face_normals;
+        if (key == 'k' || key == 'K') DebugDraw::show_bounds = !DebugDraw::show_bounds;
+
+        /* Toggle the stage timings overlay */
+        if (key == 'o' || key == 'O') Profiler::show_overlay = !Profiler::show_overlay;
+
+        /* Redraw both windows, or only one of them */
+        if (key == 'h' || key == 'H') Display::cyclePausedView();
+
         /* Space */
         if (key == ' ')	Camera::resetCamera();
+
+        /* Redraw for this key; held keys keep the timer polling until released */
+        Display::invalidate();
+        if (Display::inputActive()) Display::startTimer();
     }
 
 
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+
+#include "Camera.hpp"
+#include "ChunkBuilder.hpp"
+#include "ChunkStream.hpp"
+#include "Constants.hpp"
+#include "Display.hpp"
+#include "Keyboard.hpp"
+#include "Mouse.hpp"
+#include "ObjectLoader.hpp"
+#include "Profiler.hpp"
+#include "ShaderLoader.hpp"
+#include "SoftwareRenderer.hpp"
+
+
+/*
+ * Entry point of the viewer. The benchmarks are a separate program, with
+ * their own main in Benchmark.cpp; see the README.
+ */
+void main(int argc, char **argv) {
+    /* Write a trace of the timed stages on exit, for chrome://tracing */
+    Profiler::nameThread("main");
+    for (int i = 1; i + 1 < argc; i++) {
+        if (!strcmp(argv[i], "--trace")) Profiler::traceOnExit(argv[i + 1]);
+    }
+
+    /* Render a single image on the CPU, without creating any windows */
+    if (argc > 1 && !strcmp(argv[1], "--headless")) {
+        exit(SoftwareRenderer::headlessMain(argc, argv));
+    }
+
+    /* Only split a model into chunks on disk, for --stream */
+    if (argc > 2 && !strcmp(argv[1], "--build-chunks")) {
+        exit(ChunkBuilder::build(argv[2]) ? 0 : 1);
+    }
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+    glutInitContextFlags(GLUT_COMPATIBILITY_PROFILE);
+
+    if (!ObjectLoader::loadObject(Display::current_model)) {
+        exit(1);
+    }
+
+
+    /********************************************************************************
+     *                         Left window (fixed pipeline)                         *
+     ********************************************************************************/
+
+    glutInitWindowSize(Constants::window_w, Constants::window_h);
+    glutInitWindowPosition(Constants::window1_x, Constants::window1_y);
+    Display::window_fixed = glutCreateWindow("Fixed Pipeline");
+
+    Camera::resetCamera();
+    glutDisplayFunc(Display::displayFixed);
+
+
+    /********************************************************************************
+     *                         Right window (custom shaders)                        *
+     ********************************************************************************/
+
+    /* Both windows draw with the left window's context, so they share the
+     * model's buffers */
+    glutSetOption(GLUT_RENDERING_CONTEXT, GLUT_USE_CURRENT_CONTEXT);
+
+    glutInitWindowSize(Constants::window_w, Constants::window_h);
+    glutInitWindowPosition(Constants::window2_x, Constants::window2_y);
+    Display::window_shaders = glutCreateWindow("Custom Shaders");
+    glewInit();
+
+    ShaderLoader::initBufferObject();
+    ShaderLoader::setShaders();
+
+    /* View a model too large for memory by streaming its chunks */
+    if (argc > 2 && !strcmp(argv[1], "--stream") && !ChunkStream::open(argv[2])) {
+        exit(1);
+    }
+
+    glutDisplayFunc(Display::displayShaders);
+
+    /* Assign all keyboard and mouse functions to the second window, including the
+     * cursor reset to its center; user input controls rendering in both windows */
+
+    glutSetCursor(GLUT_CURSOR_NONE);
+    glutWarpPointer(Constants::window_w / 2, Constants::window_h / 2);
+
+    glutMouseFunc(Mouse::mouseButton);
+    glutPassiveMotionFunc(Mouse::mouseMove);
+    glutKeyboardFunc(Keyboard::keyPress);
+    glutKeyboardUpFunc(Keyboard::keyRelease);
+
+    /* The timer for changing most rendering variables is started by keyboard/mouse
+     * input as needed; windows are only redrawn when something changes */
+    if (Constants::SHOW_REDRAW_RATE) glutTimerFunc(1000, Display::redrawRateTimer, 0);
+
+    glutMainLoop();
+}
\ No newline at end of file
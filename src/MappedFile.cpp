@@ -0,0 +1,165 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+
+#include "MappedFile.hpp"
+
+
+/*
+ * Thin wrapper around the platform file mapping calls, so the loaders can
+ * read model files straight from the page cache instead of through stdio.
+ */
+namespace MappedFile {
+
+    /*
+     * Maps the whole file at filepath for reading. Empty files succeed with
+     * a NULL data pointer and a size of 0.
+     *
+     * Returns true for a successful mapping; false otherwise.
+     */
+    bool open(const char *filepath, File &file) {
+        file.data = NULL;
+        file.size = 0;
+
+    #ifdef _WIN32
+        file.mapping_handle = NULL;
+        file.file_handle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+        if (file.file_handle == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file.file_handle, &size)) {
+            close(file);
+            return false;
+        }
+
+        file.size = (size_t)size.QuadPart;
+        if (file.size == 0) return true;
+
+        file.mapping_handle = CreateFileMappingA(file.file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (file.mapping_handle == NULL) {
+            close(file);
+            return false;
+        }
+
+        file.data = (const char *)MapViewOfFile(file.mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (file.data == NULL) {
+            close(file);
+            return false;
+        }
+    #else
+        file.fd = ::open(filepath, O_RDONLY);
+        if (file.fd < 0) return false;
+
+        struct stat st;
+        if (fstat(file.fd, &st) != 0) {
+            close(file);
+            return false;
+        }
+
+        file.size = (size_t)st.st_size;
+        if (file.size == 0) return true;
+
+        void *addr = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+        if (addr == MAP_FAILED) {
+            close(file);
+            return false;
+        }
+
+        /* Model files are always read front to back */
+        madvise(addr, file.size, MADV_SEQUENTIAL);
+        file.data = (const char *)addr;
+    #endif
+
+        return true;
+    }
+
+
+    /*
+     * Creates (or truncates) the file at filepath with the given size, zero
+     * filled, and maps it for reading and writing. Writes go back to the
+     * file; data may be cast to a non-const pointer. Used for scratch files
+     * larger than memory (see ChunkBuilder).
+     *
+     * Returns true for a successful mapping; false otherwise.
+     */
+    bool create(const char *filepath, size_t size, File &file) {
+        file.data = NULL;
+        file.size = 0;
+
+    #ifdef _WIN32
+        file.mapping_handle = NULL;
+        file.file_handle = CreateFileA(filepath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+        if (file.file_handle == INVALID_HANDLE_VALUE) return false;
+        if (size == 0) return true;
+
+        ULARGE_INTEGER length;
+        length.QuadPart = size;
+        file.mapping_handle = CreateFileMappingA(file.file_handle, NULL, PAGE_READWRITE,
+            length.HighPart, length.LowPart, NULL);
+        if (file.mapping_handle == NULL) {
+            close(file);
+            return false;
+        }
+
+        file.data = (const char *)MapViewOfFile(file.mapping_handle, FILE_MAP_WRITE, 0, 0, 0);
+        if (file.data == NULL) {
+            close(file);
+            return false;
+        }
+    #else
+        file.fd = ::open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (file.fd < 0) return false;
+        if (size == 0) return true;
+
+        if (ftruncate(file.fd, (off_t)size) != 0) {
+            close(file);
+            return false;
+        }
+
+        void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+        if (addr == MAP_FAILED) {
+            close(file);
+            return false;
+        }
+        file.data = (const char *)addr;
+    #endif
+
+        file.size = size;
+        return true;
+    }
+
+
+    /*
+     * Unmaps the file and releases its handles. Safe to call on a File
+     * that failed to open.
+     */
+    void close(File &file) {
+    #ifdef _WIN32
+        if (file.data != NULL) UnmapViewOfFile(file.data);
+        if (file.mapping_handle != NULL) CloseHandle(file.mapping_handle);
+        if (file.file_handle != INVALID_HANDLE_VALUE) CloseHandle(file.file_handle);
+        file.mapping_handle = NULL;
+        file.file_handle = INVALID_HANDLE_VALUE;
+    #else
+        if (file.data != NULL) munmap((void *)file.data, file.size);
+        if (file.fd >= 0) ::close(file.fd);
+        file.fd = -1;
+    #endif
+
+        file.data = NULL;
+        file.size = 0;
+    }
+
+}
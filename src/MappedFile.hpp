@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+
+namespace MappedFile {
+
+    /* View of a whole file mapped into memory; read-only, except for files
+     * made with create */
+    struct File {
+        const char *data;
+        size_t size;
+
+    #ifdef _WIN32
+        void *file_handle;
+        void *mapping_handle;
+    #else
+        int fd;
+    #endif
+    };
+
+    bool open(const char *filepath, File &file);
+    bool create(const char *filepath, size_t size, File &file);
+    void close(File &file);
+
+}
+
+#endif
@@ -0,0 +1,375 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "MeshClusters.hpp"
+#include "MeshLod.hpp"
+#include "ObjectLoader.hpp"
+#include "Profiler.hpp"
+#include "VertexPacking.hpp"
+
+
+/*
+ * Binary cache of fully processed models (.mvb files written next to the
+ * .obj). A valid cache is mapped and drawn from directly, so no parsing,
+ * normal generation or copying happens on a warm load. With
+ * Constants::PACKED_VERTICES it also holds the packed GPU vertices, which
+ * are uploaded straight from the mapping.
+ */
+namespace MeshCache {
+
+    const bool DEBUG(false);
+
+    const uint32_t VERSION = 5;
+    static const size_t ALIGNMENT = 64;
+
+    static uint64_t alignOffset(uint64_t offset) {
+        return (offset + ALIGNMENT - 1) & ~(uint64_t)(ALIGNMENT - 1);
+    }
+
+
+    /*
+     * Returns the cache file path for a model: its extension replaced by .mvb.
+     */
+    std::string cachePath(const char *filepath) {
+        std::string path(filepath);
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of("/\\");
+
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+            path.erase(dot);
+        }
+        return path + ".mvb";
+    }
+
+
+    /*
+     * Reads the modification time and size of a file.
+     *
+     * Returns true if the file exists; false otherwise.
+     */
+    bool sourceStat(const char *filepath, int64_t &mtime, uint64_t &size) {
+    #ifdef _WIN32
+        struct _stat64 st;
+        if (_stat64(filepath, &st) != 0) return false;
+    #else
+        struct stat st;
+        if (stat(filepath, &st) != 0) return false;
+    #endif
+
+        mtime = (int64_t)st.st_mtime;
+        size = (uint64_t)st.st_size;
+        return true;
+    }
+
+
+    /*
+     * 64-bit FNV-1a over the source file contents, eight bytes at a time.
+     */
+    uint64_t hashBytes(const char *data, size_t size) {
+        const uint64_t prime = 1099511628211ULL;
+        uint64_t hash = 14695981039346656037ULL;
+
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < size; i++) {
+            hash = (hash ^ (unsigned char)data[i]) * prime;
+        }
+        return hash;
+    }
+
+
+    /*
+     * Returns the current load-time settings, as recorded in a cache.
+     */
+    static Settings currentSettings() {
+        Settings settings;
+        memset(&settings, 0, sizeof(settings));
+
+        if (Constants::OPTIMIZE_MESH) {
+            settings.flags |= SETTING_OPTIMIZED;
+            settings.vertex_cache_size = Constants::vertex_cache_size;
+        }
+        if (Constants::FRUSTUM_CULLING) {
+            settings.flags |= SETTING_CLUSTERED;
+            settings.cluster_faces = Constants::cluster_faces;
+        }
+        if (Constants::BUILD_LOD) {
+            settings.flags |= SETTING_LOD;
+            settings.lod_levels = (uint32_t)Constants::lod_levels;
+            for (int i = 0; i < Constants::lod_levels && i < MAX_LOD_RATIOS; i++) {
+                settings.lod_ratios[i] = Constants::lod_ratios[i];
+            }
+        }
+        if (Constants::PACKED_VERTICES) settings.flags |= SETTING_PACKED;
+        return settings;
+    }
+
+
+    /*
+     * Returns true if the file at filepath still hashes to source_hash.
+     */
+    static bool sameContents(const char *filepath, uint64_t source_hash) {
+        Profiler::Scope scope("cache check", "load");
+
+        MappedFile::File file;
+        if (!MappedFile::open(filepath, file)) return false;
+
+        bool same = hashBytes(file.data, file.size) == source_hash;
+        MappedFile::close(file);
+        return same;
+    }
+
+
+    /*
+     * Records a new source modification time in the cache at path.
+     *
+     * Returns true if it was written; false otherwise.
+     */
+    static bool refreshTime(const std::string &path, int64_t mtime) {
+        FILE *fp = fopen(path.c_str(), "r+b");
+        if (fp == NULL) return false;
+
+        bool ok = fseek(fp, (long)offsetof(Header, source_mtime), SEEK_SET) == 0
+            && fwrite(&mtime, sizeof(mtime), 1, fp) == 1;
+        ok = (fclose(fp) == 0) && ok;
+        return ok;
+    }
+
+
+    /*
+     * Maps the cache for the model at filepath, if it exists, was built
+     * from the same file with the current settings, and points the model's mesh arrays, culling clusters
+     * and levels of detail into the mapping, which the model then owns.
+     * The model's bounds are restored from the header.
+     *
+     * Returns true if the cache was used; false if the model must be parsed.
+     */
+    bool load(const char *filepath, ObjectLoader::Model &model) {
+        Profiler::Scope scope("cache read", "load");
+
+        int64_t mtime;
+        uint64_t size;
+        if (!sourceStat(filepath, mtime, size)) return false;
+
+        std::string path = cachePath(filepath);
+        MappedFile::File file;
+        if (!MappedFile::open(path.c_str(), file)) return false;
+
+        const Header *header = (const Header *)file.data;
+        bool current_format = file.size >= sizeof(Header)
+            && memcmp(header->magic, "MVB1", 4) == 0
+            && header->version == VERSION;
+
+        /* A source with a new modification time but the same contents (copied,
+         * checked out again) keeps its cache, which then records the new time */
+        if (current_format && header->source_mtime != mtime && header->source_size == size) {
+            uint64_t source_hash = header->source_hash;
+            MappedFile::close(file);
+
+            if (!sameContents(filepath, source_hash) || !refreshTime(path, mtime)) return false;
+            if (DEBUG) printf("Mesh cache \"%s\" still matches its source\n", path.c_str());
+
+            if (!MappedFile::open(path.c_str(), file)) return false;
+            header = (const Header *)file.data;
+        }
+
+        Settings settings = currentSettings();
+        uint64_t packed_bytes = (current_format && (settings.flags & SETTING_PACKED))
+            ? header->num_vertices * (uint64_t)sizeof(VertexPacking::PackedVertex) : 0;
+
+        bool valid = current_format
+            && header->source_mtime == mtime
+            && header->source_size == size
+            && header->positions_offset + header->num_vertices * 3ULL * sizeof(GLfloat) <= file.size
+            && header->normals_offset + header->num_vertices * 3ULL * sizeof(GLfloat) <= file.size
+            && header->indices_offset + header->num_indices * (uint64_t)sizeof(GLuint) <= file.size
+            && header->clusters_offset + header->num_clusters * (uint64_t)sizeof(MeshClusters::Cluster) <= file.size
+            && header->nodes_offset + header->num_nodes * (uint64_t)sizeof(MeshClusters::Node) <= file.size
+            && header->lod_indices_offset + header->num_lod_indices * (uint64_t)sizeof(GLuint) <= file.size
+            && header->lod_levels_offset + header->num_lod_levels * (uint64_t)sizeof(MeshLod::Level) <= file.size
+            && header->lod_clusters_offset + header->num_lod_clusters * (uint64_t)sizeof(MeshClusters::Cluster) <= file.size
+            && header->packed_offset + packed_bytes <= file.size
+            && memcmp(&header->settings, &settings, sizeof(settings)) == 0;
+
+        if (!valid) {
+            if (DEBUG) printf("Stale or invalid mesh cache \"%s\"\n", path.c_str());
+            MappedFile::close(file);
+            return false;
+        }
+
+        model.cache = file;
+        model.cached = true;
+
+        model.bounds.minx = header->minx; model.bounds.miny = header->miny; model.bounds.minz = header->minz;
+        model.bounds.maxx = header->maxx; model.bounds.maxy = header->maxy; model.bounds.maxz = header->maxz;
+        model.max_xy = header->max_xy;
+
+        model.vertexData = (const GLfloat *)(file.data + header->positions_offset);
+        model.normalData = (const GLfloat *)(file.data + header->normals_offset);
+        model.indexData = (const GLuint *)(file.data + header->indices_offset);
+        model.numVertices = header->num_vertices;
+        model.numIndices = header->num_indices;
+
+        model.clusterData = (const MeshClusters::Cluster *)(file.data + header->clusters_offset);
+        model.numClusters = header->num_clusters;
+        model.nodeData = (const MeshClusters::Node *)(file.data + header->nodes_offset);
+        model.numNodes = header->num_nodes;
+
+        model.lodIndexData = (const GLuint *)(file.data + header->lod_indices_offset);
+        model.numLodIndices = header->num_lod_indices;
+        model.lodLevelData = (const MeshLod::Level *)(file.data + header->lod_levels_offset);
+        model.numLodLevels = header->num_lod_levels;
+        model.lodClusterData = (const MeshClusters::Cluster *)(file.data + header->lod_clusters_offset);
+        model.numLodClusters = header->num_lod_clusters;
+
+        if (packed_bytes > 0) {
+            model.packedData = (const VertexPacking::PackedVertex *)(file.data + header->packed_offset);
+            memcpy(model.packMin, header->pack_min, sizeof(model.packMin));
+            memcpy(model.packExtent, header->pack_extent, sizeof(model.packExtent));
+        }
+
+        return true;
+    }
+
+
+    /*
+     * Writes a model's mesh arrays, culling clusters, levels of detail,
+     * packed vertices (which must have been prepared with
+     * Constants::PACKED_VERTICES) and bounds to the cache for the model at
+     * filepath, with the hash of its source and the current load-time
+     * settings. The file is written under a temporary name and renamed, so
+     * a partially written cache is never picked up.
+     *
+     * Returns true if the cache was written; false otherwise.
+     */
+    bool write(const char *filepath, const ObjectLoader::Model &model, uint64_t source_hash) {
+        Profiler::Scope scope("cache write", "load");
+
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "MVB1", 4);
+        header.version = VERSION;
+        header.settings = currentSettings();
+
+        bool packed = (header.settings.flags & SETTING_PACKED) != 0;
+        if (packed && model.packedData == NULL) return false;
+
+        if (!sourceStat(filepath, header.source_mtime, header.source_size)) return false;
+        header.source_hash = source_hash;
+
+        header.num_vertices = model.numVertices;
+        header.num_indices = model.numIndices;
+        header.num_clusters = model.numClusters;
+        header.num_nodes = model.numNodes;
+        header.num_lod_indices = model.numLodIndices;
+        header.num_lod_levels = model.numLodLevels;
+        header.num_lod_clusters = model.numLodClusters;
+
+        header.minx = model.bounds.minx; header.miny = model.bounds.miny; header.minz = model.bounds.minz;
+        header.maxx = model.bounds.maxx; header.maxy = model.bounds.maxy; header.maxz = model.bounds.maxz;
+        header.max_xy = model.max_xy;
+
+        uint64_t vertex_bytes = header.num_vertices * 3ULL * sizeof(GLfloat);
+        uint64_t index_bytes = header.num_indices * (uint64_t)sizeof(GLuint);
+        uint64_t cluster_bytes = header.num_clusters * (uint64_t)sizeof(MeshClusters::Cluster);
+        uint64_t node_bytes = header.num_nodes * (uint64_t)sizeof(MeshClusters::Node);
+        uint64_t lod_index_bytes = header.num_lod_indices * (uint64_t)sizeof(GLuint);
+        uint64_t lod_level_bytes = header.num_lod_levels * (uint64_t)sizeof(MeshLod::Level);
+        uint64_t lod_cluster_bytes = header.num_lod_clusters * (uint64_t)sizeof(MeshClusters::Cluster);
+        uint64_t packed_bytes = packed ? header.num_vertices * (uint64_t)sizeof(VertexPacking::PackedVertex) : 0;
+
+        header.positions_offset = alignOffset(sizeof(Header));
+        header.normals_offset = alignOffset(header.positions_offset + vertex_bytes);
+        header.indices_offset = alignOffset(header.normals_offset + vertex_bytes);
+        header.clusters_offset = alignOffset(header.indices_offset + index_bytes);
+        header.nodes_offset = alignOffset(header.clusters_offset + cluster_bytes);
+        header.lod_indices_offset = alignOffset(header.nodes_offset + node_bytes);
+        header.lod_levels_offset = alignOffset(header.lod_indices_offset + lod_index_bytes);
+        header.lod_clusters_offset = alignOffset(header.lod_levels_offset + lod_level_bytes);
+        header.packed_offset = alignOffset(header.lod_clusters_offset + lod_cluster_bytes);
+
+        if (packed) {
+            memcpy(header.pack_min, model.packMin, sizeof(header.pack_min));
+            memcpy(header.pack_extent, model.packExtent, sizeof(header.pack_extent));
+        }
+
+        std::string path = cachePath(filepath);
+        std::string temp_path = path + ".tmp";
+
+        FILE *fp = fopen(temp_path.c_str(), "wb");
+        if (fp == NULL) {
+            printf("Can't write mesh cache \"%s\"\n", path.c_str());
+            return false;
+        }
+
+        /* Each array is preceded by zero padding up to its aligned offset */
+        static const char padding[ALIGNMENT] = { 0 };
+        uint64_t written = 0;
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        written += sizeof(header);
+
+        ok = ok && fwrite(padding, 1, header.positions_offset - written, fp) == header.positions_offset - written;
+        ok = ok && fwrite(model.vertexData, 1, vertex_bytes, fp) == vertex_bytes;
+        written = header.positions_offset + vertex_bytes;
+
+        ok = ok && fwrite(padding, 1, header.normals_offset - written, fp) == header.normals_offset - written;
+        ok = ok && fwrite(model.normalData, 1, vertex_bytes, fp) == vertex_bytes;
+        written = header.normals_offset + vertex_bytes;
+
+        ok = ok && fwrite(padding, 1, header.indices_offset - written, fp) == header.indices_offset - written;
+        ok = ok && fwrite(model.indexData, 1, index_bytes, fp) == index_bytes;
+        written = header.indices_offset + index_bytes;
+
+        ok = ok && fwrite(padding, 1, header.clusters_offset - written, fp) == header.clusters_offset - written;
+        ok = ok && fwrite(model.clusterData, 1, cluster_bytes, fp) == cluster_bytes;
+        written = header.clusters_offset + cluster_bytes;
+
+        ok = ok && fwrite(padding, 1, header.nodes_offset - written, fp) == header.nodes_offset - written;
+        ok = ok && fwrite(model.nodeData, 1, node_bytes, fp) == node_bytes;
+        written = header.nodes_offset + node_bytes;
+
+        ok = ok && fwrite(padding, 1, header.lod_indices_offset - written, fp) == header.lod_indices_offset - written;
+        ok = ok && fwrite(model.lodIndexData, 1, lod_index_bytes, fp) == lod_index_bytes;
+        written = header.lod_indices_offset + lod_index_bytes;
+
+        ok = ok && fwrite(padding, 1, header.lod_levels_offset - written, fp) == header.lod_levels_offset - written;
+        ok = ok && fwrite(model.lodLevelData, 1, lod_level_bytes, fp) == lod_level_bytes;
+        written = header.lod_levels_offset + lod_level_bytes;
+
+        ok = ok && fwrite(padding, 1, header.lod_clusters_offset - written, fp) == header.lod_clusters_offset - written;
+        ok = ok && fwrite(model.lodClusterData, 1, lod_cluster_bytes, fp) == lod_cluster_bytes;
+        written = header.lod_clusters_offset + lod_cluster_bytes;
+
+        ok = ok && fwrite(padding, 1, header.packed_offset - written, fp) == header.packed_offset - written;
+        ok = ok && fwrite(model.packedData, 1, packed_bytes, fp) == packed_bytes;
+
+        ok = (fclose(fp) == 0) && ok;
+
+        if (ok) {
+            remove(path.c_str());
+            ok = rename(temp_path.c_str(), path.c_str()) == 0;
+        }
+
+        if (!ok) {
+            printf("Can't write mesh cache \"%s\"\n", path.c_str());
+            remove(temp_path.c_str());
+        }
+        return ok;
+    }
+
+}
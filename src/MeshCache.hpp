@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "GL/freeglut.h"
+
+#include "ObjectLoader.hpp"
+
+namespace MeshCache {
+
+    /* Most levels of detail whose ratios are recorded in a cache */
+    const int MAX_LOD_RATIOS = 8;
+
+    /* Stages that ran on the cached arrays (Settings::flags) */
+    enum SettingFlags {
+        SETTING_OPTIMIZED = 1,
+        SETTING_CLUSTERED = 2,
+        SETTING_LOD = 4,
+        SETTING_PACKED = 8
+    };
+
+    /* Load-time settings that shaped the cached arrays, so a cache built
+     * with different ones is stale; those of stages that didn't run are 0 */
+    struct Settings {
+        uint32_t flags;
+        uint32_t vertex_cache_size;
+        uint32_t cluster_faces;
+        uint32_t lod_levels;
+        GLfloat lod_ratios[MAX_LOD_RATIOS];
+    };
+
+    /* On-disk layout of a .mvb file; arrays start at 64-byte aligned offsets */
+    struct Header {
+        char magic[4];
+        uint32_t version;
+
+        uint32_t num_vertices;
+        uint32_t num_indices;
+
+        GLfloat minx, miny, minz;
+        GLfloat maxx, maxy, maxz;
+        GLfloat max_xy;
+        uint32_t reserved;
+
+        uint64_t source_hash;
+        int64_t source_mtime;
+        uint64_t source_size;
+
+        uint64_t positions_offset;
+        uint64_t normals_offset;
+        uint64_t indices_offset;
+
+        uint32_t num_clusters;
+        uint32_t num_nodes;
+        uint64_t clusters_offset;
+        uint64_t nodes_offset;
+
+        uint32_t num_lod_indices;
+        uint32_t num_lod_levels;
+        uint32_t num_lod_clusters;
+        uint32_t reserved2;
+        uint64_t lod_indices_offset;
+        uint64_t lod_levels_offset;
+        uint64_t lod_clusters_offset;
+
+        /* Vertices in VertexPacking's format, if SETTING_PACKED, and the
+         * box their positions are quantized to */
+        uint64_t packed_offset;
+        GLfloat pack_min[3];
+        GLfloat pack_extent[3];
+
+        Settings settings;
+    };
+
+    extern const uint32_t VERSION;
+
+    std::string cachePath(const char *filepath);
+    bool sourceStat(const char *filepath, int64_t &mtime, uint64_t &size);
+    uint64_t hashBytes(const char *data, size_t size);
+    bool load(const char *filepath, ObjectLoader::Model &model);
+    bool write(const char *filepath, const ObjectLoader::Model &model, uint64_t source_hash);
+
+}
+
+#endif
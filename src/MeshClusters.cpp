@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "MeshClusters.hpp"
+#include "WorkerPool.hpp"
+
+
+/*
+ * Spatial clusters of faces and a bounding volume hierarchy over them,
+ * built at load time, so that each frame only the clusters inside the view
+ * frustum are drawn.
+ *
+ * Faces are split recursively at the median centroid along the longest
+ * axis, and reordered so that every node of the split covers a contiguous
+ * range of the index buffer. The tree shape depends only on the face count
+ * (each node is split at its middle face), so it can be rebuilt from the
+ * reordered faces without storing the split decisions.
+ */
+namespace MeshClusters {
+
+    const bool DEBUG(false);
+
+    /* Arrays used for culling; point into the current ObjectLoader::Model,
+     * or into a mapped mesh cache */
+    const Cluster *clusterData = NULL;
+    const Node *nodeData = NULL;
+    GLuint numClusters = 0, numNodes = 0;
+
+    /* Range of faces still to be split */
+    struct Range {
+        GLuint begin, end;
+    };
+
+
+    /*
+     * Sets the arrays used for culling. Called by ObjectLoader when a model
+     * is installed.
+     */
+    void setClusterArrays(const Cluster *cluster_data, GLuint num_clusters,
+        const Node *node_data, GLuint num_nodes) {
+
+        clusterData = cluster_data;
+        numClusters = num_clusters;
+        nodeData = node_data;
+        numNodes = num_nodes;
+    }
+
+
+    /*
+     * Partially sorts order[begin, end) so that the faces left of the middle
+     * have smaller centroids along the longest axis of the range, then
+     * recurses until ranges are at most cluster_faces long. If tasks is
+     * given, ranges reaching max_depth are appended to it instead.
+     */
+    static void split(const std::vector<GLfloat> &centroids, GLuint *order,
+        GLuint begin, GLuint end, GLuint cluster_faces, int depth, int max_depth,
+        std::vector<Range> *tasks) {
+
+        if (end - begin <= cluster_faces) return;
+
+        if (tasks != NULL && depth == max_depth) {
+            Range range = { begin, end };
+            tasks->push_back(range);
+            return;
+        }
+
+        GLfloat min[3] = { centroids[order[begin] * 3], centroids[order[begin] * 3 + 1], centroids[order[begin] * 3 + 2] };
+        GLfloat max[3] = { min[0], min[1], min[2] };
+
+        for (GLuint i = begin + 1; i < end; i++) {
+            const GLfloat *c = &centroids[order[i] * 3];
+            for (int k = 0; k < 3; k++) {
+                if (c[k] < min[k]) min[k] = c[k];
+                if (c[k] > max[k]) max[k] = c[k];
+            }
+        }
+
+        int axis = 0;
+        if (max[1] - min[1] > max[axis] - min[axis]) axis = 1;
+        if (max[2] - min[2] > max[axis] - min[axis]) axis = 2;
+
+        GLuint mid = begin + (end - begin) / 2;
+        std::nth_element(order + begin, order + mid, order + end, [&](GLuint a, GLuint b) {
+            return centroids[a * 3 + axis] < centroids[b * 3 + axis];
+        });
+
+        split(centroids, order, begin, mid, cluster_faces, depth + 1, max_depth, tasks);
+        split(centroids, order, mid, end, cluster_faces, depth + 1, max_depth, tasks);
+    }
+
+
+    /*
+     * Orders faces so that each cluster (and each BVH node above it) is a
+     * contiguous, spatially compact run. The top levels are split serially
+     * and the resulting subtrees on the worker pool.
+     *
+     * face_order receives the original index of each face, in cluster order.
+     */
+    void partition(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        GLuint cluster_faces, std::vector<GLuint> &face_order) {
+
+        face_order.resize(num_faces);
+        for (GLuint f = 0; f < num_faces; f++) face_order[f] = f;
+
+        if (cluster_faces == 0) cluster_faces = 1;
+        if (num_faces <= cluster_faces) return;
+
+        /* Centroids scaled by 3, which doesn't affect their order */
+        std::vector<GLfloat> centroids(num_faces * 3);
+        WorkerPool::parallelFor(num_faces, 65536, [&](size_t begin, size_t end) {
+            for (size_t f = begin; f < end; f++) {
+                const GLuint *face = indices + f * 3;
+                for (int k = 0; k < 3; k++) {
+                    centroids[f * 3 + k] = coords[face[0] * 3 + k] + coords[face[1] * 3 + k] + coords[face[2] * 3 + k];
+                }
+            }
+        });
+
+        /* Enough subtrees to keep every worker busy */
+        int max_depth = 0;
+        while ((1u << max_depth) < WorkerPool::threadCount() * 4) max_depth++;
+
+        std::vector<Range> tasks;
+        split(centroids, face_order.data(), 0, num_faces, cluster_faces, 0, max_depth, &tasks);
+
+        WorkerPool::parallelFor(tasks.size(), 1, [&](size_t first, size_t last) {
+            for (size_t t = first; t < last; t++) {
+                split(centroids, face_order.data(), tasks[t].begin, tasks[t].end,
+                    cluster_faces, 0, 0, NULL);
+            }
+        });
+    }
+
+
+    /*
+     * Appends the node for faces [begin, end) and its subtree, depth first,
+     * with the same split points as partition.
+     */
+    static void emitNode(GLuint begin, GLuint end, GLuint cluster_faces,
+        std::vector<Cluster> &clusters, std::vector<Node> &nodes) {
+
+        GLuint index = nodes.size();
+        nodes.push_back(Node());
+        nodes[index].first_cluster = clusters.size();
+
+        if (end - begin <= cluster_faces) {
+            Cluster cluster;
+            cluster.first_index = begin * 3;
+            cluster.num_indices = (end - begin) * 3;
+            clusters.push_back(cluster);
+        } else {
+            GLuint mid = begin + (end - begin) / 2;
+            emitNode(begin, mid, cluster_faces, clusters, nodes);
+            emitNode(mid, end, cluster_faces, clusters, nodes);
+        }
+
+        nodes[index].num_clusters = clusters.size() - nodes[index].first_cluster;
+    }
+
+
+    /*
+     * Builds the clusters and BVH for faces already ordered by partition
+     * (and possibly reordered within each cluster since), with bounds taken
+     * from the given vertex positions.
+     */
+    void build(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        GLuint cluster_faces, std::vector<Cluster> &clusters, std::vector<Node> &nodes) {
+
+        clusters.clear();
+        nodes.clear();
+
+        if (cluster_faces == 0) cluster_faces = 1;
+        if (num_faces > 0) emitNode(0, num_faces, cluster_faces, clusters, nodes);
+
+        /* Cluster bounds */
+        WorkerPool::parallelFor(clusters.size(), 16, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++) {
+                Cluster &cluster = clusters[c];
+                const GLuint *cluster_indices = indices + cluster.first_index;
+
+                const GLfloat *p = coords + cluster_indices[0] * 3;
+                for (int k = 0; k < 3; k++) cluster.min[k] = cluster.max[k] = p[k];
+
+                for (GLuint i = 1; i < cluster.num_indices; i++) {
+                    p = coords + cluster_indices[i] * 3;
+                    for (int k = 0; k < 3; k++) {
+                        if (p[k] < cluster.min[k]) cluster.min[k] = p[k];
+                        if (p[k] > cluster.max[k]) cluster.max[k] = p[k];
+                    }
+                }
+            }
+        });
+
+        /* Node bounds, children first (they always follow their parent) */
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node &node = nodes[i];
+
+            if (node.num_clusters == 1) {
+                const Cluster &cluster = clusters[node.first_cluster];
+                memcpy(node.min, cluster.min, sizeof(node.min));
+                memcpy(node.max, cluster.max, sizeof(node.max));
+            } else {
+                const Node &left = nodes[i + 1];
+                const Node &right = nodes[i + 2 * left.num_clusters];
+                for (int k = 0; k < 3; k++) {
+                    node.min[k] = std::min(left.min[k], right.min[k]);
+                    node.max[k] = std::max(left.max[k], right.max[k]);
+                }
+            }
+        }
+    }
+
+
+    /*
+     * Extracts the six frustum planes (left, right, bottom, top, near, far)
+     * in model space from column-major projection and modelview matrices,
+     * as laid out by Camera::calcProjectionMat/calcModelViewMat. A point p is
+     * inside plane i if dot(planes[i].xyz, p) + planes[i].w >= 0.
+     */
+    void extractPlanes(const GLfloat *projection, const GLfloat *modelview, GLfloat planes[6][4]) {
+        GLfloat m[16];
+        for (int col = 0; col < 4; col++) {
+            for (int row = 0; row < 4; row++) {
+                GLfloat sum = 0.0f;
+                for (int k = 0; k < 4; k++) sum += projection[k * 4 + row] * modelview[col * 4 + k];
+                m[col * 4 + row] = sum;
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            for (int k = 0; k < 4; k++) {
+                planes[i * 2][k] = m[k * 4 + 3] + m[k * 4 + i];
+                planes[i * 2 + 1][k] = m[k * 4 + 3] - m[k * 4 + i];
+            }
+        }
+    }
+
+
+    /*
+     * Walks the BVH against the frustum and collects the index ranges of
+     * visible clusters for glMultiDrawElements, as byte offsets from indices
+     * (NULL for an element buffer). cluster_data gives the clusters' index
+     * ranges: clusterData, or those of a simplified level (see MeshLod).
+     * Subtrees entirely inside the frustum are accepted without testing
+     * their children, and adjacent ranges are merged into one draw.
+     */
+    void cull(const GLfloat planes[6][4], const Cluster *cluster_data, const GLvoid *indices,
+        std::vector<GLsizei> &counts, std::vector<const GLvoid *> &offsets, Stats &stats) {
+
+        counts.clear();
+        offsets.clear();
+        memset(&stats, 0, sizeof(stats));
+        if (numNodes == 0) return;
+
+        stats.clusters_total = numClusters;
+        const Cluster &last_cluster = cluster_data[numClusters - 1];
+        stats.triangles_total = (last_cluster.first_index + last_cluster.num_indices - cluster_data[0].first_index) / 3;
+
+        /* Pending nodes, with the planes they may still cross */
+        struct Entry {
+            GLuint node;
+            unsigned planes;
+        } stack[64];
+
+        int top = 0;
+        stack[top].node = 0;
+        stack[top].planes = 0x3F;
+        top++;
+
+        GLuint range_end = (GLuint)-1;
+
+        while (top > 0) {
+            top--;
+            GLuint index = stack[top].node;
+            unsigned mask = stack[top].planes;
+            const Node &node = nodeData[index];
+
+            bool outside = false;
+            for (int i = 0; i < 6 && !outside; i++) {
+                if (!(mask & (1u << i))) continue;
+
+                const GLfloat *plane = planes[i];
+                GLfloat nearest = plane[3], farthest = plane[3];
+                for (int k = 0; k < 3; k++) {
+                    GLfloat lo = plane[k] * node.min[k], hi = plane[k] * node.max[k];
+                    nearest += std::min(lo, hi);
+                    farthest += std::max(lo, hi);
+                }
+
+                if (farthest < 0.0f) outside = true;
+                else if (nearest >= 0.0f) mask &= ~(1u << i);
+            }
+
+            const Cluster &first = cluster_data[node.first_cluster];
+            const Cluster &last = cluster_data[node.first_cluster + node.num_clusters - 1];
+
+            if (outside) {
+                stats.clusters_culled += node.num_clusters;
+                stats.triangles_culled += (last.first_index + last.num_indices - first.first_index) / 3;
+                continue;
+            }
+
+            if (mask != 0 && node.num_clusters > 1 && top + 2 <= 64) {
+                const Node &left = nodeData[index + 1];
+
+                /* Right first, so ranges come out in index order */
+                stack[top].node = index + 2 * left.num_clusters;
+                stack[top].planes = mask;
+                stack[top + 1].node = index + 1;
+                stack[top + 1].planes = mask;
+                top += 2;
+                continue;
+            }
+
+            GLuint begin = first.first_index;
+            GLuint end = last.first_index + last.num_indices;
+
+            if (begin == range_end) {
+                counts.back() += end - begin;
+            } else {
+                counts.push_back(end - begin);
+                offsets.push_back((const char *)indices + begin * sizeof(GLuint));
+            }
+            range_end = end;
+        }
+
+        stats.draw_ranges = counts.size();
+
+        if (DEBUG) printf("Culled %u/%u clusters, %u/%u triangles, %u draws\n",
+            stats.clusters_culled, stats.clusters_total,
+            stats.triangles_culled, stats.triangles_total, stats.draw_ranges);
+    }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef MESHCLUSTERS_H
+#define MESHCLUSTERS_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+namespace MeshClusters {
+
+    /* Contiguous run of faces in the index buffer, and its bounding box */
+    struct Cluster {
+        GLuint first_index, num_indices;
+        GLfloat min[3], max[3];
+    };
+
+    /* BVH node over a contiguous range of clusters. Nodes are stored depth
+     * first: the left child of node i is i + 1, and the right child follows
+     * the left child's subtree. Leaves hold exactly one cluster. */
+    struct Node {
+        GLfloat min[3], max[3];
+        GLuint first_cluster, num_clusters;
+    };
+
+    /* Result of culling one frame */
+    struct Stats {
+        GLuint clusters_culled, triangles_culled;
+        GLuint clusters_total, triangles_total;
+        GLuint draw_ranges;
+    };
+
+    extern const Cluster *clusterData;
+    extern const Node *nodeData;
+    extern GLuint numClusters, numNodes;
+
+    void setClusterArrays(const Cluster *cluster_data, GLuint num_clusters,
+        const Node *node_data, GLuint num_nodes);
+    void partition(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        GLuint cluster_faces, std::vector<GLuint> &face_order);
+    void build(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        GLuint cluster_faces, std::vector<Cluster> &clusters, std::vector<Node> &nodes);
+    void extractPlanes(const GLfloat *projection, const GLfloat *modelview, GLfloat planes[6][4]);
+    void cull(const GLfloat planes[6][4], const Cluster *cluster_data, const GLvoid *indices,
+        std::vector<GLsizei> &counts, std::vector<const GLvoid *> &offsets, Stats &stats);
+
+}
+
+#endif
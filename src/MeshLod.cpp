@@ -0,0 +1,224 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "GL/freeglut.h"
+#include "glm/glm.hpp"
+
+#include "Arena.hpp"
+#include "Camera.hpp"
+#include "Constants.hpp"
+#include "Display.hpp"
+#include "MeshClusters.hpp"
+#include "MeshLod.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "Profiler.hpp"
+#include "WorkerPool.hpp"
+
+
+/*
+ * Chain of simplified index buffers over the model's vertex buffer, built
+ * at load time (Constants::lod_ratios), and selection of a level from the
+ * model's projected size.
+ *
+ * Each culling cluster is simplified on its own, in parallel, with the
+ * vertices it shares with other clusters locked, so every level keeps the
+ * same clusters (and BVH) as the full mesh and is culled the same way.
+ */
+namespace MeshLod {
+
+    const bool DEBUG(false);
+
+    /* Arrays used for drawing; point into the current ObjectLoader::Model,
+     * or into a mapped mesh cache. Levels are stored one after another in
+     * indexData, each as the concatenation of its clusters */
+    const GLuint *indexData = NULL;
+    const Level *levelData = NULL;
+    const MeshClusters::Cluster *clusterData = NULL;
+    GLuint numIndices = 0, numLevels = 0, numClusters = 0;
+
+
+    /*
+     * Sets the arrays used for drawing simplified levels. Called by
+     * ObjectLoader when a model is installed.
+     */
+    void setLodArrays(const GLuint *index_data, GLuint num_indices,
+        const Level *level_data, GLuint num_levels,
+        const MeshClusters::Cluster *cluster_data, GLuint num_clusters) {
+
+        indexData = index_data;
+        numIndices = num_indices;
+        levelData = level_data;
+        numLevels = num_levels;
+        clusterData = cluster_data;
+        numClusters = num_clusters;
+    }
+
+
+    /*
+     * Builds Constants::lod_levels simplified levels of the mesh, each with
+     * about lod_ratios[i] of its faces, into indices, levels and clusters.
+     * Each of the mesh's culling clusters is simplified separately (the
+     * whole mesh is one piece if there are none).
+     */
+    void build(const GLfloat *coords, GLuint num_vertices, const GLuint *mesh_indices, GLuint num_faces,
+        const MeshClusters::Cluster *mesh_clusters, GLuint num_mesh_clusters,
+        std::vector<GLuint> &indices, std::vector<Level> &levels,
+        std::vector<MeshClusters::Cluster> &clusters) {
+
+        Profiler::Scope scope("lod", "load");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        indices.clear();
+        levels.clear();
+        clusters.clear();
+
+        int num_levels = Constants::lod_levels;
+        GLuint num_pieces = num_mesh_clusters;
+
+        std::vector<MeshClusters::Cluster> pieces(mesh_clusters, mesh_clusters + num_pieces);
+        if (num_pieces == 0) {
+            MeshClusters::Cluster whole;
+            memset(&whole, 0, sizeof(whole));
+            whole.num_indices = num_faces * 3;
+            pieces.push_back(whole);
+        }
+
+        /* Lock every vertex used by more than one piece, so pieces meet without cracks */
+        std::vector<unsigned char> locked;
+
+        if (pieces.size() > 1) {
+            const GLuint NONE = (GLuint)-1;
+            std::vector<GLuint> owner(num_vertices, NONE);
+            locked.assign(num_vertices, 0);
+
+            for (GLuint p = 0; p < pieces.size(); p++) {
+                for (GLuint i = 0; i < pieces[p].num_indices; i++) {
+                    GLuint v = mesh_indices[pieces[p].first_index + i];
+                    if (owner[v] == NONE) owner[v] = p;
+                    else if (owner[v] != p) locked[v] = 1;
+                }
+            }
+        }
+
+        /* Simplify each piece to every level; results[piece * levels + level] */
+        std::vector< std::vector<GLuint> > results(pieces.size() * num_levels);
+
+        WorkerPool::parallelFor(pieces.size(), 1, [&](size_t first, size_t last) {
+            std::vector<GLuint> targets(num_levels);
+            std::vector<GLuint> order, reordered;
+            Arena::Monotonic arena;
+
+            for (size_t p = first; p < last; p++) {
+                GLuint piece_faces = pieces[p].num_indices / 3;
+                for (int l = 0; l < num_levels; l++) {
+                    targets[l] = (GLuint)ceil(piece_faces * Constants::lod_ratios[l]);
+                }
+
+                std::vector<GLuint> *piece_levels = &results[p * num_levels];
+                MeshSimplifier::simplify(coords, mesh_indices + pieces[p].first_index, piece_faces,
+                    locked.empty() ? NULL : locked.data(), targets.data(), num_levels, piece_levels, arena);
+
+                if (!Constants::OPTIMIZE_MESH) continue;
+
+                /* Keep each simplified piece vertex cache friendly too */
+                for (int l = 0; l < num_levels; l++) {
+                    std::vector<GLuint> &level = piece_levels[l];
+                    MeshOptimizer::tipsifyLocal(level.data(), level.size() / 3,
+                        Constants::vertex_cache_size, order);
+
+                    reordered.resize(level.size());
+                    for (size_t i = 0; i < order.size(); i++) {
+                        for (int k = 0; k < 3; k++) reordered[i * 3 + k] = level[order[i] * 3 + k];
+                    }
+                    level.swap(reordered);
+                }
+            }
+        });
+
+        /* Concatenate level by level, cluster by cluster */
+        for (int l = 0; l < num_levels; l++) {
+            Level level;
+            level.first_index = indices.size();
+
+            for (GLuint p = 0; p < pieces.size(); p++) {
+                std::vector<GLuint> &piece = results[p * num_levels + l];
+
+                if (num_pieces > 0) {
+                    MeshClusters::Cluster cluster = pieces[p]; // bounds still contain the piece
+                    cluster.first_index = indices.size();
+                    cluster.num_indices = piece.size();
+                    clusters.push_back(cluster);
+                }
+
+                indices.insert(indices.end(), piece.begin(), piece.end());
+                std::vector<GLuint>().swap(piece);
+            }
+
+            level.num_indices = indices.size() - level.first_index;
+            levels.push_back(level);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("Built %u LOD levels in %.3f s (faces:", (GLuint)levels.size(), seconds);
+        for (size_t l = 0; l < levels.size(); l++) printf(" %u", levels[l].num_indices / 3);
+        printf(")\n");
+    }
+
+
+    /*
+     * Picks the level to draw from the model's projected size: the frustum
+     * is max_xy / 2 wide at the near plane, so at the model's distance from
+     * Camera::camera the model covers about size x size pixels. The coarsest
+     * level with at least Constants::lod_faces_per_pixel faces per covered
+     * pixel is chosen.
+     *
+     * Returns 0 for the full mesh, or i for levelData[i - 1].
+     */
+    GLuint selectLevel() {
+        glm::vec3 center((Display::minx + Display::maxx) / 2,
+            (Display::miny + Display::maxy) / 2,
+            (Display::minz + Display::maxz) / 2);
+        GLfloat distance = glm::length(Camera::camera - center);
+
+        return levelFor(Display::max_xy, distance, levelData, numLevels);
+    }
+
+
+    /*
+     * Picks the level of a model model_size wide (in x or y) at the given
+     * distance from the camera, from the given levels, as selectLevel does
+     * for the current model. Used for scene instances of any model.
+     */
+    GLuint levelFor(GLfloat model_size, GLfloat distance, const Level *level_data, GLuint num_levels) {
+        if (num_levels == 0 || Display::max_xy <= 0.0f) return 0;
+        if (distance <= Camera::near_clip) return 0;
+
+        GLfloat visible_width = Display::max_xy / 2 * distance / Camera::near_clip;
+        GLfloat size = Constants::window_w * model_size / visible_width;
+        GLfloat wanted_faces = size * size * Constants::lod_faces_per_pixel;
+
+        GLuint selected = 0;
+        for (GLuint l = 0; l < num_levels; l++) {
+            if (level_data[l].num_indices / 3 >= wanted_faces) selected = l + 1;
+        }
+
+        if (DEBUG) printf("Projected size %.0f px, LOD %u\n", size, selected);
+        return selected;
+    }
+
+
+    /*
+     * Returns the culling clusters of the given level (1 to numLevels), or
+     * NULL if the model has no clusters.
+     */
+    const MeshClusters::Cluster *levelClusters(GLuint level) {
+        if (numClusters == 0 || level == 0) return NULL;
+        return clusterData + (level - 1) * (numClusters / numLevels);
+    }
+
+}
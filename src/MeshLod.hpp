@@ -0,0 +1,37 @@
+#pragma once
+
+#ifndef MESHLOD_H
+#define MESHLOD_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "MeshClusters.hpp"
+
+namespace MeshLod {
+
+    /* One simplified level, as a range of the LOD index buffer */
+    struct Level {
+        GLuint first_index, num_indices;
+    };
+
+    extern const GLuint *indexData;
+    extern const Level *levelData;
+    extern const MeshClusters::Cluster *clusterData;
+    extern GLuint numIndices, numLevels, numClusters;
+
+    void setLodArrays(const GLuint *index_data, GLuint num_indices,
+        const Level *level_data, GLuint num_levels,
+        const MeshClusters::Cluster *cluster_data, GLuint num_clusters);
+    void build(const GLfloat *coords, GLuint num_vertices, const GLuint *mesh_indices, GLuint num_faces,
+        const MeshClusters::Cluster *mesh_clusters, GLuint num_mesh_clusters,
+        std::vector<GLuint> &indices, std::vector<Level> &levels,
+        std::vector<MeshClusters::Cluster> &clusters);
+    GLuint selectLevel();
+    GLuint levelFor(GLfloat model_size, GLfloat distance, const Level *level_data, GLuint num_levels);
+    const MeshClusters::Cluster *levelClusters(GLuint level);
+
+}
+
+#endif
@@ -0,0 +1,236 @@
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "MeshOptimizer.hpp"
+
+
+/*
+ * Load-time reordering of the index and vertex buffers for the GPU's
+ * post-transform vertex cache and for vertex fetch locality.
+ */
+namespace MeshOptimizer {
+
+    static const GLuint NONE = (GLuint)-1;
+
+
+    /*
+     * Returns a vertex that still has unemitted faces: the most recently
+     * touched one on the dead-end stack, or else the next one in input order.
+     * Returns NONE once every face has been emitted.
+     */
+    static GLuint skipDeadEnd(const std::vector<GLuint> &live, std::vector<GLuint> &dead_end,
+        GLuint &cursor, GLuint num_vertices) {
+
+        while (!dead_end.empty()) {
+            GLuint v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0) return v;
+        }
+
+        for (; cursor < num_vertices; cursor++) {
+            if (live[cursor] > 0) return cursor;
+        }
+        return NONE;
+    }
+
+
+    /*
+     * Orders faces for vertex cache reuse with the Tipsify algorithm (Sander,
+     * Nehab & Barczak, 2007): all remaining faces around a fanning vertex are
+     * emitted, then the next fanning vertex is picked among the vertices just
+     * emitted, preferring ones that will still be in a cache of cache_size
+     * entries once their remaining faces are drawn. face_offsets/member_faces
+     * is the vertex-to-face adjacency from ObjectLoader::buildAdjacency.
+     *
+     * face_order receives the original index of each face, in drawing order.
+     */
+    void tipsify(const GLuint *indices, GLuint num_faces, GLuint num_vertices,
+        const GLuint *face_offsets, const GLuint *member_faces, GLuint cache_size,
+        std::vector<GLuint> &face_order) {
+
+        face_order.clear();
+        face_order.reserve(num_faces);
+
+        /* Faces not yet emitted around each vertex */
+        std::vector<GLuint> live(num_vertices);
+        for (GLuint v = 0; v < num_vertices; v++) {
+            live[v] = face_offsets[v + 1] - face_offsets[v];
+        }
+
+        /* Time each vertex last entered the simulated cache */
+        std::vector<GLuint> cache_time(num_vertices, 0);
+        std::vector<bool> emitted(num_faces, false);
+        std::vector<GLuint> dead_end, candidates;
+
+        GLuint time = cache_size + 1;
+        GLuint cursor = 0;
+        GLuint fan = skipDeadEnd(live, dead_end, cursor, num_vertices);
+
+        while (fan != NONE) {
+            candidates.clear();
+
+            /* Emit every remaining face around the fanning vertex */
+            for (GLuint i = face_offsets[fan]; i < face_offsets[fan + 1]; i++) {
+                GLuint face = member_faces[i];
+                if (emitted[face]) continue;
+
+                for (int corner = 0; corner < 3; corner++) {
+                    GLuint v = indices[face * 3 + corner];
+                    dead_end.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+
+                    if (time - cache_time[v] > cache_size) {
+                        cache_time[v] = time;
+                        time++;
+                    }
+                }
+
+                emitted[face] = true;
+                face_order.push_back(face);
+            }
+
+            /* Pick the candidate that stays cached longest after its remaining faces */
+            GLuint next = NONE;
+            int best = -1;
+
+            for (size_t c = 0; c < candidates.size(); c++) {
+                GLuint v = candidates[c];
+                if (live[v] == 0) continue;
+
+                int priority = 0;
+                if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+                    priority = time - cache_time[v];
+                }
+
+                if (priority > best) {
+                    best = priority;
+                    next = v;
+                }
+            }
+
+            if (next == NONE) next = skipDeadEnd(live, dead_end, cursor, num_vertices);
+            fan = next;
+        }
+    }
+
+
+    /*
+     * Runs tipsify over a subset of a mesh's faces (such as one spatial
+     * cluster) without touching whole-mesh arrays: the faces' vertices are
+     * compacted to local ids and given their own adjacency, so clusters can
+     * be optimized independently and in parallel.
+     *
+     * face_order receives the position of each face within indices, in
+     * drawing order.
+     */
+    void tipsifyLocal(const GLuint *indices, GLuint num_faces, GLuint cache_size,
+        std::vector<GLuint> &face_order) {
+
+        GLuint num_indices = num_faces * 3;
+
+        /* Local vertex ids are ranks among the distinct global ids */
+        std::vector<GLuint> unique(indices, indices + num_indices);
+        std::sort(unique.begin(), unique.end());
+        unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+        GLuint num_vertices = unique.size();
+
+        std::vector<GLuint> local(num_indices);
+        for (GLuint i = 0; i < num_indices; i++) {
+            local[i] = std::lower_bound(unique.begin(), unique.end(), indices[i]) - unique.begin();
+        }
+
+        /* Same counting and fill passes as ObjectLoader::buildAdjacency */
+        std::vector<GLuint> face_offsets(num_vertices + 1, 0);
+        std::vector<GLuint> member_faces(num_indices);
+
+        for (GLuint i = 0; i < num_indices; i++) face_offsets[local[i] + 1]++;
+        for (GLuint v = 0; v < num_vertices; v++) face_offsets[v + 1] += face_offsets[v];
+
+        std::vector<GLuint> cursor(face_offsets.begin(), face_offsets.end() - 1);
+        for (GLuint i = 0; i < num_indices; i++) member_faces[cursor[local[i]]++] = i / 3;
+
+        tipsify(local.data(), num_faces, num_vertices, face_offsets.data(), member_faces.data(),
+            cache_size, face_order);
+    }
+
+
+    /*
+     * Renumbers vertices in order of first use in the index buffer, so that
+     * vertex fetches walk memory mostly sequentially. Unreferenced vertices
+     * are moved to the end. indices is rewritten in place.
+     *
+     * remap receives the new index of each original vertex.
+     */
+    void remapVertices(std::vector<GLuint> &indices, GLuint num_vertices,
+        std::vector<GLuint> &remap) {
+
+        remap.assign(num_vertices, NONE);
+        GLuint next = 0;
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint &v = remap[indices[i]];
+            if (v == NONE) v = next++;
+            indices[i] = v;
+        }
+
+        for (GLuint v = 0; v < num_vertices; v++) {
+            if (remap[v] == NONE) remap[v] = next++;
+        }
+    }
+
+
+    /*
+     * Moves each vertex's attribute (components floats wide) to its
+     * remapped position.
+     */
+    void permuteAttribute(std::vector<GLfloat> &data, int components,
+        const std::vector<GLuint> &remap) {
+
+        std::vector<GLfloat> permuted(data.size());
+
+        for (size_t v = 0; v < remap.size(); v++) {
+            for (int c = 0; c < components; c++) {
+                permuted[remap[v] * components + c] = data[v * components + c];
+            }
+        }
+
+        data.swap(permuted);
+    }
+
+
+    /*
+     * Simulates a FIFO post-transform cache of cache_size entries over the
+     * index buffer. acmr is the average number of cache misses per triangle;
+     * atvr is misses per referenced vertex (1.0 is optimal).
+     */
+    void simulateFifo(const GLuint *indices, GLuint num_indices, GLuint num_vertices,
+        GLuint cache_size, GLfloat &acmr, GLfloat &atvr) {
+
+        /* A vertex is cached if fewer than cache_size misses happened since it was loaded */
+        std::vector<size_t> loaded_at(num_vertices, 0);
+        std::vector<bool> referenced(num_vertices, false);
+        size_t misses = 0, unique = 0;
+
+        for (GLuint i = 0; i < num_indices; i++) {
+            GLuint v = indices[i];
+
+            if (!referenced[v]) {
+                referenced[v] = true;
+                unique++;
+            } else if (misses - loaded_at[v] <= cache_size) {
+                continue;
+            }
+
+            loaded_at[v] = misses;
+            misses++;
+        }
+
+        acmr = num_indices ? (GLfloat)misses / (num_indices / 3) : 0.0f;
+        atvr = unique ? (GLfloat)misses / unique : 0.0f;
+    }
+
+}
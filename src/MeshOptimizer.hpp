@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+namespace MeshOptimizer {
+
+    void tipsify(const GLuint *indices, GLuint num_faces, GLuint num_vertices,
+        const GLuint *face_offsets, const GLuint *member_faces, GLuint cache_size,
+        std::vector<GLuint> &face_order);
+    void tipsifyLocal(const GLuint *indices, GLuint num_faces, GLuint cache_size,
+        std::vector<GLuint> &face_order);
+    void remapVertices(std::vector<GLuint> &indices, GLuint num_vertices,
+        std::vector<GLuint> &remap);
+    void permuteAttribute(std::vector<GLfloat> &data, int components,
+        const std::vector<GLuint> &remap);
+    void simulateFifo(const GLuint *indices, GLuint num_indices, GLuint num_vertices,
+        GLuint cache_size, GLfloat &acmr, GLfloat &atvr);
+
+}
+
+#endif
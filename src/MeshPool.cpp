@@ -0,0 +1,286 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "MeshPool.hpp"
+#include "ObjectLoader.hpp"
+#include "Scene.hpp"
+#include "ShaderLoader.hpp"
+
+
+/*
+ * GPU buffers of recently viewed models, kept resident within
+ * Constants::gpu_mesh_budget so that switching back to one of them is
+ * instant. Each entry keeps the model's CPU data too (culling, LOD
+ * selection and the debug lines read it), within
+ * Constants::host_mesh_budget. When either budget is exceeded, the least
+ * recently shown models are evicted; the current model and models
+ * instanced in the Scene always stay.
+ */
+namespace MeshPool {
+
+    const bool DEBUG(false);
+
+    /* Resident models; never destroyed at exit, since their buffers can only
+     * be deleted while the GL context is alive */
+    static std::vector<Entry *> entries;
+    static Entry *current_entry = NULL;
+    static unsigned long long use_clock = 0;
+
+
+    GpuMesh::GpuMesh() : VAO(0), pVBO(0), nVBO(0), EBO(0), bytes(0), packed(false) {
+        for (int i = 0; i < 3; i++) {
+            positionOffset[i] = 0.0f;
+            positionScale[i] = 1.0f;
+        }
+    }
+
+
+    GpuMesh::GpuMesh(GpuMesh &&other) : GpuMesh() {
+        *this = std::move(other);
+    }
+
+
+    /*
+     * Takes over other's names, deleting this mesh's own first.
+     */
+    GpuMesh &GpuMesh::operator=(GpuMesh &&other) {
+        if (this == &other) return *this;
+
+        reset();
+
+        VAO = other.VAO; pVBO = other.pVBO; nVBO = other.nVBO; EBO = other.EBO;
+        memcpy(positionOffset, other.positionOffset, sizeof(positionOffset));
+        memcpy(positionScale, other.positionScale, sizeof(positionScale));
+        bytes = other.bytes;
+        packed = other.packed;
+
+        other.VAO = other.pVBO = other.nVBO = other.EBO = 0;
+        other.bytes = 0;
+        return *this;
+    }
+
+
+    GpuMesh::~GpuMesh() {
+        reset();
+    }
+
+
+    /*
+     * Generates the VAO and buffer names (deleting any held before). The
+     * buffers get their storage, and bytes is set, when they are filled.
+     */
+    void GpuMesh::create() {
+        reset();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &pVBO);
+        glGenBuffers(1, &nVBO);
+        glGenBuffers(1, &EBO);
+    }
+
+
+    /*
+     * Deletes the VAO and buffers, if any.
+     */
+    void GpuMesh::reset() {
+        if (VAO == 0 && pVBO == 0 && nVBO == 0 && EBO == 0) return;
+
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &pVBO);
+        glDeleteBuffers(1, &nVBO);
+        glDeleteBuffers(1, &EBO);
+
+        VAO = pVBO = nVBO = EBO = 0;
+        bytes = 0;
+    }
+
+
+    /*
+     * Returns the resident entry for the model at path, or NULL.
+     */
+    Entry *find(const char *path) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (!strcmp(entries[i]->path, path)) return entries[i];
+        }
+        return NULL;
+    }
+
+
+    /*
+     * Makes a resident entry the current model. Its data is swapped into
+     * ObjectLoader::current, and the previous current model's data is
+     * parked in that model's own entry.
+     */
+    static void activate(Entry &entry) {
+        entry.last_used = ++use_clock;
+        if (&entry == current_entry) return;
+
+        /* entry.model is left holding the previous current model */
+        ObjectLoader::installModel(entry.model);
+
+        if (current_entry != NULL) {
+            std::swap(current_entry->model, entry.model);
+        } else {
+            ObjectLoader::releaseModel(entry.model);
+        }
+
+        current_entry = &entry;
+        ShaderLoader::useMesh(entry.mesh);
+    }
+
+
+    /*
+     * Switches to the model at path if it is resident.
+     *
+     * Returns true if it was; false if it must be loaded.
+     */
+    bool show(const char *path) {
+        Entry *entry = find(path);
+        if (entry == NULL) return false;
+
+        activate(*entry);
+        if (DEBUG) printStats();
+        return true;
+    }
+
+
+    /*
+     * Makes a newly loaded model and its uploaded buffers the current model,
+     * taking both over, then evicts what no longer fits the budget.
+     */
+    void add(ObjectLoader::Model &model, GpuMesh &mesh) {
+        Entry *entry = find(model.path);
+
+        if (entry == NULL) {
+            entry = new Entry;
+            strcpy(entry->path, model.path);
+            entries.push_back(entry);
+        } else if (entry == current_entry) {
+            /* Reloaded in place: drop the old data instead of parking it */
+            ObjectLoader::installModel(model);
+            ObjectLoader::releaseModel(model);
+            ObjectLoader::releasePacked(ObjectLoader::current);
+
+            entry->mesh = std::move(mesh);
+            ShaderLoader::useMesh(entry->mesh);
+            evict();
+            return;
+        }
+
+        ObjectLoader::releaseModel(entry->model);
+        std::swap(entry->model, model);
+        entry->mesh = std::move(mesh);
+
+        activate(*entry);
+
+        /* The packed copy was only needed for the upload */
+        ObjectLoader::releasePacked(ObjectLoader::current);
+
+        evict();
+    }
+
+
+    /*
+     * Registers buffers uploaded for ObjectLoader::current, which was
+     * installed without the pool (at startup).
+     */
+    void addCurrent(GpuMesh &mesh) {
+        Entry *entry = find(ObjectLoader::current.path);
+
+        if (entry == NULL) {
+            entry = new Entry;
+            strcpy(entry->path, ObjectLoader::current.path);
+            entries.push_back(entry);
+        }
+
+        /* Any data parked in the entry is stale: the current model replaces it */
+        ObjectLoader::releaseModel(entry->model);
+        entry->mesh = std::move(mesh);
+        entry->last_used = ++use_clock;
+        current_entry = entry;
+
+        ShaderLoader::useMesh(entry->mesh);
+        evict();
+    }
+
+
+    /*
+     * Deletes the least recently shown models (never the current one, nor
+     * those instanced in the Scene) until the resident buffers fit
+     * Constants::gpu_mesh_budget, and their CPU data
+     * Constants::host_mesh_budget.
+     */
+    void evict() {
+        while (residentBytes() > Constants::gpu_mesh_budget
+            || residentHostBytes() > Constants::host_mesh_budget) {
+            size_t oldest = entries.size();
+
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (entries[i] == current_entry || Scene::uses(entries[i]->path)) continue;
+                if (oldest == entries.size() || entries[i]->last_used < entries[oldest]->last_used) {
+                    oldest = i;
+                }
+            }
+
+            if (oldest == entries.size()) break; // only the current model is left
+
+            Entry *entry = entries[oldest];
+            if (DEBUG) printf("Evicting \"%s\" (%.1f MB on the GPU, %.1f MB on the CPU)\n", entry->path,
+                entry->mesh.bytes / 1048576.0, ObjectLoader::hostBytes(entry->model) / 1048576.0);
+
+            ObjectLoader::releaseModel(entry->model);
+            delete entry;
+            entries.erase(entries.begin() + oldest);
+        }
+
+        if (DEBUG) printStats();
+    }
+
+
+    /*
+     * Returns the GPU memory held by all resident models, in bytes.
+     */
+    size_t residentBytes() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < entries.size(); i++) bytes += entries[i]->mesh.bytes;
+        return bytes;
+    }
+
+
+    /*
+     * Returns the CPU memory held by all resident models, including the
+     * current one, in bytes (see ObjectLoader::hostBytes).
+     */
+    size_t residentHostBytes() {
+        size_t bytes = ObjectLoader::hostBytes(ObjectLoader::current);
+        for (size_t i = 0; i < entries.size(); i++) bytes += ObjectLoader::hostBytes(entries[i]->model);
+        return bytes;
+    }
+
+
+    /*
+     * Returns the number of resident models, including the current one.
+     */
+    unsigned residentCount() {
+        return entries.size();
+    }
+
+
+    /*
+     * Prints the resident model count and memory against the budgets.
+     */
+    void printStats() {
+        printf("GPU meshes: %u resident, %.1f MB of %.1f MB on the GPU, %.1f MB of %.1f MB on the CPU\n",
+            residentCount(), residentBytes() / 1048576.0, Constants::gpu_mesh_budget / 1048576.0,
+            residentHostBytes() / 1048576.0, Constants::host_mesh_budget / 1048576.0);
+    }
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef MESHPOOL_H
+#define MESHPOOL_H
+
+#include <stddef.h>
+
+#include "GL/freeglut.h"
+
+#include "ObjectLoader.hpp"
+
+namespace MeshPool {
+
+    /* VAO and buffers of one model on the GPU, deleted with the object.
+     * Must be created and destroyed with the windows' shared context current. */
+    class GpuMesh {
+    public:
+        GLuint VAO, pVBO, nVBO, EBO;
+        GLfloat positionOffset[3], positionScale[3];
+        size_t bytes;
+        bool packed;            // vertices in VertexPacking's format, else floats
+
+        GpuMesh();
+        GpuMesh(GpuMesh &&other);
+        GpuMesh &operator=(GpuMesh &&other);
+        ~GpuMesh();
+
+        void create();
+        void reset();
+
+        GpuMesh(const GpuMesh &) = delete;
+        GpuMesh &operator=(const GpuMesh &) = delete;
+    };
+
+    /* A resident model. The current model's data lives in
+     * ObjectLoader::current, so its own model is left empty. */
+    struct Entry {
+        char path[100];
+        ObjectLoader::Model model;
+        GpuMesh mesh;
+        unsigned long long last_used;
+    };
+
+    Entry *find(const char *path);
+    bool show(const char *path);
+    void add(ObjectLoader::Model &model, GpuMesh &mesh);
+    void addCurrent(GpuMesh &mesh);
+    void evict();
+    size_t residentBytes();
+    size_t residentHostBytes();
+    unsigned residentCount();
+    void printStats();
+
+}
+
+#endif
@@ -0,0 +1,431 @@
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "Arena.hpp"
+#include "MeshSimplifier.hpp"
+
+
+/*
+ * Quadric error metric simplification (Garland & Heckbert, 1997) by half
+ * edge collapses: a vertex is always collapsed onto one of its neighbours,
+ * so simplified meshes index the original vertex buffer and need no new
+ * vertices or normals.
+ *
+ * All working state of a simplification is allocated from one arena,
+ * sized up front, so simplifying many small pieces of a mesh makes almost
+ * no heap allocations.
+ */
+namespace MeshSimplifier {
+
+    /* Symmetric 4x4 matrix, upper triangle in row order */
+    struct Quadric {
+        double a[10];
+    };
+
+    /* Candidate collapse of vertex from onto vertex to; stamps tell whether
+     * either vertex has changed since the cost was computed */
+    struct Collapse {
+        double cost;
+        GLuint from, to;
+        GLuint from_stamp, to_stamp;
+
+        bool operator<(const Collapse &other) const {
+            return cost > other.cost; // cheapest first in std::priority_queue
+        }
+    };
+
+    /* Faces of one vertex (may list dead faces); moved to a larger range of
+     * the arena when full */
+    struct FaceList {
+        GLuint *faces;
+        GLuint size, capacity;
+    };
+
+    typedef std::pair<GLuint, GLuint> Edge;
+
+    /* Working state for one simplification, on compacted vertex ids */
+    struct Mesh {
+        Arena::Monotonic *arena;
+
+        Arena::Array<GLuint> global;        // original id of each local vertex
+        Arena::Array<double> position;      // 3 per vertex
+        Arena::Array<Quadric> quadric;
+        Arena::Array<unsigned char> locked;
+        Arena::Array<GLuint> stamp;
+        Arena::Array<FaceList> faces_of;
+
+        Arena::Array<GLuint> face;          // 3 per face, local ids
+        Arena::Array<unsigned char> alive;
+        GLuint alive_faces;
+
+        std::priority_queue<Collapse> queue;
+    };
+
+
+    static void addPlane(Quadric &q, double a, double b, double c, double d, double weight) {
+        double p[4] = { a, b, c, d };
+        int k = 0;
+        for (int i = 0; i < 4; i++) {
+            for (int j = i; j < 4; j++) q.a[k++] += weight * p[i] * p[j];
+        }
+    }
+
+
+    /*
+     * Returns v^T Q v for v = (x, y, z, 1).
+     */
+    static double evaluate(const Quadric &q, const double *p) {
+        double x = p[0], y = p[1], z = p[2];
+        const double *a = q.a;
+        return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+            + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+            + a[7] * z * z + 2 * a[8] * z
+            + a[9];
+    }
+
+
+    static void faceNormal(const Mesh &mesh, GLuint a, GLuint b, GLuint c, double *n) {
+        const double *pa = &mesh.position[a * 3];
+        const double *pb = &mesh.position[b * 3];
+        const double *pc = &mesh.position[c * 3];
+
+        double u[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+        double v[3] = { pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2] };
+
+        n[0] = u[1] * v[2] - u[2] * v[1];
+        n[1] = u[2] * v[0] - u[0] * v[2];
+        n[2] = u[0] * v[1] - u[1] * v[0];
+    }
+
+
+    /*
+     * Compacts the faces' vertices to local ids, and sums the area-weighted
+     * plane quadric of each face into its vertices. Vertices on open edges
+     * are locked along with those locked by the caller.
+     */
+    static void setup(Mesh &mesh, const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        const unsigned char *locked) {
+
+        Arena::Monotonic &arena = *mesh.arena;
+        GLuint num_indices = num_faces * 3;
+
+        mesh.global.resize(arena, num_indices);
+        std::copy(indices, indices + num_indices, mesh.global.begin());
+        std::sort(mesh.global.begin(), mesh.global.end());
+        GLuint num_vertices = std::unique(mesh.global.begin(), mesh.global.end()) - mesh.global.begin();
+        mesh.global.resize(arena, num_vertices);
+
+        /* Everything below, with as much again for face lists to grow into */
+        arena.reserve(num_indices * (2 * sizeof(GLuint) + sizeof(Edge)) + num_faces
+            + num_vertices * (3 * sizeof(double) + sizeof(Quadric) + 1 + sizeof(GLuint) + sizeof(FaceList))
+            + num_indices * sizeof(GLuint));
+
+        mesh.face.resize(arena, num_indices);
+        for (GLuint i = 0; i < num_indices; i++) {
+            mesh.face[i] = std::lower_bound(mesh.global.begin(), mesh.global.end(), indices[i]) - mesh.global.begin();
+        }
+
+        mesh.position.resize(arena, num_vertices * 3);
+        mesh.locked.resize(arena, num_vertices);
+        for (GLuint v = 0; v < num_vertices; v++) {
+            for (int k = 0; k < 3; k++) mesh.position[v * 3 + k] = coords[mesh.global[v] * 3 + k];
+            mesh.locked[v] = locked ? locked[mesh.global[v]] : 0;
+        }
+
+        Quadric zero;
+        for (int k = 0; k < 10; k++) zero.a[k] = 0.0;
+        mesh.quadric.assign(arena, num_vertices, zero);
+
+        mesh.stamp.assign(arena, num_vertices, 0);
+        mesh.alive.assign(arena, num_faces, 1);
+        mesh.alive_faces = num_faces;
+
+        /* Each vertex's face list starts out with exactly its own faces */
+        FaceList empty = { NULL, 0, 0 };
+        mesh.faces_of.assign(arena, num_vertices, empty);
+        for (GLuint i = 0; i < num_indices; i++) mesh.faces_of[mesh.face[i]].capacity++;
+
+        GLuint *lists = arena.allocate<GLuint>(num_indices);
+        for (GLuint v = 0; v < num_vertices; v++) {
+            mesh.faces_of[v].faces = lists;
+            lists += mesh.faces_of[v].capacity;
+        }
+
+        /* Edges as (min, max) pairs; open edges appear exactly once */
+        Edge *edges = arena.allocate<Edge>(num_indices);
+        GLuint num_edges = 0;
+
+        std::vector<Collapse> queued;
+        queued.reserve(num_indices);
+        mesh.queue = std::priority_queue<Collapse>(std::less<Collapse>(), std::move(queued));
+
+        for (GLuint f = 0; f < num_faces; f++) {
+            const GLuint *t = &mesh.face[f * 3];
+
+            double n[3];
+            faceNormal(mesh, t[0], t[1], t[2], n);
+            double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            if (length > 0.0) {
+                double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+                const double *p = &mesh.position[t[0] * 3];
+                double d = -(a * p[0] + b * p[1] + c * p[2]);
+
+                for (int k = 0; k < 3; k++) addPlane(mesh.quadric[t[k]], a, b, c, d, length * 0.5);
+            }
+
+            for (int k = 0; k < 3; k++) {
+                FaceList &list = mesh.faces_of[t[k]];
+                list.faces[list.size++] = f;
+
+                GLuint u = t[k], v = t[(k + 1) % 3];
+                edges[num_edges++] = Edge(std::min(u, v), std::max(u, v));
+            }
+        }
+
+        std::sort(edges, edges + num_edges);
+        for (GLuint i = 0; i < num_edges;) {
+            GLuint j = i + 1;
+            while (j < num_edges && edges[j] == edges[i]) j++;
+
+            if (j - i == 1) {
+                mesh.locked[edges[i].first] = 1;
+                mesh.locked[edges[i].second] = 1;
+            }
+            i = j;
+        }
+    }
+
+
+    /*
+     * Appends face f to list, moving the list to twice the room in the
+     * arena if it is full.
+     */
+    static void pushFace(Mesh &mesh, FaceList &list, GLuint f) {
+        if (list.size == list.capacity) {
+            GLuint capacity = std::max(4u, list.capacity * 2);
+            GLuint *faces = mesh.arena->allocate<GLuint>(capacity);
+            std::copy(list.faces, list.faces + list.size, faces);
+            list.faces = faces;
+            list.capacity = capacity;
+        }
+        list.faces[list.size++] = f;
+    }
+
+
+    /*
+     * Gathers the distinct vertices sharing a live face with v.
+     */
+    static void neighbours(const Mesh &mesh, GLuint v, std::vector<GLuint> &result) {
+        result.clear();
+
+        const FaceList &faces = mesh.faces_of[v];
+        for (GLuint i = 0; i < faces.size; i++) {
+            if (!mesh.alive[faces.faces[i]]) continue;
+
+            const GLuint *t = &mesh.face[faces.faces[i] * 3];
+            for (int k = 0; k < 3; k++) {
+                if (t[k] != v) result.push_back(t[k]);
+            }
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+
+
+    /*
+     * Queues the cheaper allowed direction of collapsing edge (u, v).
+     */
+    static void pushEdge(Mesh &mesh, GLuint u, GLuint v) {
+        Quadric q;
+        for (int k = 0; k < 10; k++) q.a[k] = mesh.quadric[u].a[k] + mesh.quadric[v].a[k];
+
+        Collapse collapse;
+        bool allowed = false;
+
+        if (!mesh.locked[u]) {
+            collapse.cost = evaluate(q, &mesh.position[v * 3]);
+            collapse.from = u;
+            collapse.to = v;
+            allowed = true;
+        }
+
+        if (!mesh.locked[v]) {
+            double cost = evaluate(q, &mesh.position[u * 3]);
+            if (!allowed || cost < collapse.cost) {
+                collapse.cost = cost;
+                collapse.from = v;
+                collapse.to = u;
+                allowed = true;
+            }
+        }
+
+        if (!allowed) return;
+
+        collapse.from_stamp = mesh.stamp[collapse.from];
+        collapse.to_stamp = mesh.stamp[collapse.to];
+        mesh.queue.push(collapse);
+    }
+
+
+    /*
+     * Returns true if collapsing from onto to keeps the surface manifold
+     * (the link condition) and flips none of the faces that remain.
+     */
+    static bool canCollapse(const Mesh &mesh, GLuint from, GLuint to,
+        std::vector<GLuint> &from_ring, std::vector<GLuint> &to_ring) {
+
+        neighbours(mesh, from, from_ring);
+        neighbours(mesh, to, to_ring);
+
+        GLuint shared_faces = 0;
+        const FaceList &faces = mesh.faces_of[from];
+
+        for (GLuint i = 0; i < faces.size; i++) {
+            if (!mesh.alive[faces.faces[i]]) continue;
+
+            const GLuint *t = &mesh.face[faces.faces[i] * 3];
+            if (t[0] == to || t[1] == to || t[2] == to) {
+                shared_faces++;
+                continue;
+            }
+
+            /* Normal before and after moving from onto to */
+            GLuint moved[3] = { t[0], t[1], t[2] };
+            for (int k = 0; k < 3; k++) {
+                if (moved[k] == from) moved[k] = to;
+            }
+
+            double before[3], after[3];
+            faceNormal(mesh, t[0], t[1], t[2], before);
+            faceNormal(mesh, moved[0], moved[1], moved[2], after);
+
+            if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0) return false;
+        }
+
+        if (shared_faces == 0) return false;
+
+        /* Vertices adjacent to both must be exactly those of the shared faces */
+        GLuint common = 0;
+        for (size_t i = 0, j = 0; i < from_ring.size() && j < to_ring.size();) {
+            if (from_ring[i] < to_ring[j]) i++;
+            else if (from_ring[i] > to_ring[j]) j++;
+            else { common++; i++; j++; }
+        }
+
+        return common == shared_faces;
+    }
+
+
+    /*
+     * Collapses from onto to: faces containing both die, the rest of from's
+     * faces move to to, and the edges around to are requeued.
+     */
+    static void collapse(Mesh &mesh, GLuint from, GLuint to, std::vector<GLuint> &ring) {
+        FaceList &faces = mesh.faces_of[from];
+
+        for (GLuint i = 0; i < faces.size; i++) {
+            GLuint f = faces.faces[i];
+            if (!mesh.alive[f]) continue;
+
+            GLuint *t = &mesh.face[f * 3];
+            if (t[0] == to || t[1] == to || t[2] == to) {
+                mesh.alive[f] = 0;
+                mesh.alive_faces--;
+                continue;
+            }
+
+            for (int k = 0; k < 3; k++) {
+                if (t[k] == from) t[k] = to;
+            }
+            pushFace(mesh, mesh.faces_of[to], f);
+        }
+        faces.size = 0;
+
+        for (int k = 0; k < 10; k++) mesh.quadric[to].a[k] += mesh.quadric[from].a[k];
+        mesh.stamp[from]++;
+        mesh.stamp[to]++;
+
+        neighbours(mesh, to, ring);
+        for (size_t i = 0; i < ring.size(); i++) pushEdge(mesh, to, ring[i]);
+    }
+
+
+    /*
+     * Appends the live faces, with original vertex ids, to out.
+     */
+    static void snapshot(const Mesh &mesh, std::vector<GLuint> &out) {
+        out.clear();
+        out.reserve(mesh.alive_faces * 3);
+
+        for (size_t f = 0; f < mesh.alive.size(); f++) {
+            if (!mesh.alive[f]) continue;
+            for (int k = 0; k < 3; k++) out.push_back(mesh.global[mesh.face[f * 3 + k]]);
+        }
+    }
+
+
+    /*
+     * Simplifies the given faces by repeatedly collapsing the edge of least
+     * quadric error. Vertices flagged in locked (indexed by original id; may
+     * be NULL) and vertices on open edges never move, so independently
+     * simplified pieces of a mesh still meet without cracks.
+     *
+     * targets lists face counts in decreasing order; levels[i] receives the
+     * index buffer at the point the mesh first had at most targets[i] faces
+     * (or the simplest mesh reachable, if that has more).
+     *
+     * The working state is allocated from arena, which is reset first, so
+     * one arena can be reused across calls.
+     */
+    void simplify(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        const unsigned char *locked, const GLuint *targets, int num_targets,
+        std::vector<GLuint> *levels, Arena::Monotonic &arena) {
+
+        arena.reset();
+
+        Mesh mesh;
+        mesh.arena = &arena;
+        setup(mesh, coords, indices, num_faces, locked);
+
+        std::vector<GLuint> from_ring, to_ring;
+
+        for (GLuint f = 0; f < num_faces; f++) {
+            const GLuint *t = &mesh.face[f * 3];
+            for (int k = 0; k < 3; k++) {
+                GLuint u = t[k], v = t[(k + 1) % 3];
+                if (u < v) pushEdge(mesh, u, v); // interior edges are seen from both faces
+            }
+        }
+
+        int level = 0;
+        while (level < num_targets) {
+            if (mesh.alive_faces <= targets[level]) {
+                snapshot(mesh, levels[level]);
+                level++;
+                continue;
+            }
+
+            if (mesh.queue.empty()) break;
+
+            Collapse next = mesh.queue.top();
+            mesh.queue.pop();
+
+            if (mesh.stamp[next.from] != next.from_stamp || mesh.stamp[next.to] != next.to_stamp) continue;
+            if (!canCollapse(mesh, next.from, next.to, from_ring, to_ring)) continue;
+
+            collapse(mesh, next.from, next.to, to_ring);
+        }
+
+        /* Nothing left to collapse; remaining levels get the simplest mesh */
+        for (; level < num_targets; level++) snapshot(mesh, levels[level]);
+    }
+
+}
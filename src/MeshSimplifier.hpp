@@ -0,0 +1,20 @@
+#pragma once
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "Arena.hpp"
+
+namespace MeshSimplifier {
+
+    void simplify(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        const unsigned char *locked, const GLuint *targets, int num_targets,
+        std::vector<GLuint> *levels, Arena::Monotonic &arena);
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "Camera.hpp"
 #include "Constants.hpp"
+#include "Display.hpp"
 #include "Mouse.hpp"
 
 namespace Mouse {
@@ -32,15 +33,20 @@ namespace Mouse {
             else right_press = true;
         }
 
+        /* Held buttons tilt the camera from the timer */
+        if (left_press || right_press) Display::startTimer();
+
         if (state == GLUT_UP) return; // disregard GLUT_UP events for scrolls
 
         /* Scrolls translate camera along n axis */
         if (button == 3) {
             // Zoom in
             Camera::translateCamera('n', false);
+            Display::invalidate();
         } else if (button == 4) {
             // Zoom out
             Camera::translateCamera('n', true);
+            Display::invalidate();
         }
     }
 
@@ -71,6 +77,8 @@ namespace Mouse {
             Camera::rotateCamera('u', -Constants::rotate_speed); // mouse moved down
         }
 
+        if (deltax > 1 || deltax < -1 || deltay > 1 || deltay < -1) Display::invalidate();
+
         glutWarpPointer(Constants::window_w / 2, Constants::window_h / 2);
     }
 
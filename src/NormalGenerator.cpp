@@ -0,0 +1,159 @@
+#include <math.h>
+#include <stddef.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMALS_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include "GL/freeglut.h"
+
+#include "NormalGenerator.hpp"
+#include "WorkerPool.hpp"
+
+
+/*
+ * Face and vertex normal generation for Gouraud shading. Face normals are
+ * computed four triangles at a time from structure-of-arrays batches, and
+ * vertex normals gather from the vertex-to-face adjacency, so no two threads
+ * ever write to the same output element.
+ */
+namespace NormalGenerator {
+
+    /* Faces/vertices handed to a worker at a time */
+    static const size_t GRAIN = 16384;
+
+
+    /*
+     * Scalar face normal and area, for batch remainders and non-SSE builds.
+     * Degenerate faces get a zero normal.
+     */
+    static void faceNormal(const GLfloat *coords, const GLuint *face, GLfloat *normal, GLfloat *area) {
+        const GLfloat *v0 = coords + face[0] * 3;
+        const GLfloat *v1 = coords + face[1] * 3;
+        const GLfloat *v2 = coords + face[2] * 3;
+
+        GLfloat e1x = v1[0] - v0[0], e1y = v1[1] - v0[1], e1z = v1[2] - v0[2];
+        GLfloat e2x = v2[0] - v0[0], e2y = v2[1] - v0[1], e2z = v2[2] - v0[2];
+
+        GLfloat cx = e1y * e2z - e1z * e2y;
+        GLfloat cy = e1z * e2x - e1x * e2z;
+        GLfloat cz = e1x * e2y - e1y * e2x;
+
+        GLfloat length = sqrtf(cx * cx + cy * cy + cz * cz);
+        GLfloat inverse = length > 0.0f ? 1.0f / length : 0.0f;
+
+        normal[0] = cx * inverse;
+        normal[1] = cy * inverse;
+        normal[2] = cz * inverse;
+        *area = 0.5f * length;
+    }
+
+
+    /*
+     * Computes faces [begin, end), four at a time where possible.
+     */
+    static void faceNormalRange(const GLfloat *coords, const GLuint *indices, size_t begin, size_t end,
+        GLfloat *normals, GLfloat *areas) {
+
+        size_t f = begin;
+
+    #ifdef NORMALS_SSE
+        /* Gather four triangles into SoA form: one register per coordinate of each corner */
+        for (; f + 4 <= end; f += 4) {
+            float p[3][3][4];
+            for (int t = 0; t < 4; t++) {
+                for (int corner = 0; corner < 3; corner++) {
+                    const GLfloat *v = coords + indices[(f + t) * 3 + corner] * 3;
+                    p[corner][0][t] = v[0];
+                    p[corner][1][t] = v[1];
+                    p[corner][2][t] = v[2];
+                }
+            }
+
+            __m128 x0 = _mm_loadu_ps(p[0][0]), y0 = _mm_loadu_ps(p[0][1]), z0 = _mm_loadu_ps(p[0][2]);
+
+            __m128 e1x = _mm_sub_ps(_mm_loadu_ps(p[1][0]), x0);
+            __m128 e1y = _mm_sub_ps(_mm_loadu_ps(p[1][1]), y0);
+            __m128 e1z = _mm_sub_ps(_mm_loadu_ps(p[1][2]), z0);
+            __m128 e2x = _mm_sub_ps(_mm_loadu_ps(p[2][0]), x0);
+            __m128 e2y = _mm_sub_ps(_mm_loadu_ps(p[2][1]), y0);
+            __m128 e2z = _mm_sub_ps(_mm_loadu_ps(p[2][2]), z0);
+
+            __m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+            __m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+            __m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)),
+                _mm_mul_ps(cz, cz)));
+
+            /* Zero normal for degenerate faces instead of a division by zero */
+            __m128 nonzero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+            __m128 inverse = _mm_and_ps(nonzero, _mm_div_ps(_mm_set1_ps(1.0f), length));
+
+            float nx[4], ny[4], nz[4];
+            _mm_storeu_ps(nx, _mm_mul_ps(cx, inverse));
+            _mm_storeu_ps(ny, _mm_mul_ps(cy, inverse));
+            _mm_storeu_ps(nz, _mm_mul_ps(cz, inverse));
+            _mm_storeu_ps(areas + f, _mm_mul_ps(_mm_set1_ps(0.5f), length));
+
+            for (int t = 0; t < 4; t++) {
+                normals[(f + t) * 3] = nx[t];
+                normals[(f + t) * 3 + 1] = ny[t];
+                normals[(f + t) * 3 + 2] = nz[t];
+            }
+        }
+    #endif
+
+        for (; f < end; f++) {
+            faceNormal(coords, indices + f * 3, normals + f * 3, areas + f);
+        }
+    }
+
+
+    /*
+     * Calculates the unit normal and area of every face, in parallel.
+     * normals must hold 3 * num_faces values and areas num_faces values.
+     */
+    void faceNormals(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        GLfloat *normals, GLfloat *areas) {
+
+        WorkerPool::parallelFor(num_faces, GRAIN, [=](size_t begin, size_t end) {
+            faceNormalRange(coords, indices, begin, end, normals, areas);
+        });
+    }
+
+
+    /*
+     * Calculates each vertex normal as the area-weighted average of the
+     * normals of its faces, in parallel. face_offsets/member_faces is the
+     * adjacency built by ObjectLoader::buildAdjacency; faces are summed in
+     * the order listed there.
+     */
+    void vertexNormals(const GLfloat *face_normals, const GLfloat *face_areas,
+        const GLuint *face_offsets, const GLuint *member_faces, GLuint num_vertices,
+        GLfloat *normals) {
+
+        WorkerPool::parallelFor(num_vertices, GRAIN, [=](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                GLfloat x = 0.0f, y = 0.0f, z = 0.0f;
+
+                for (GLuint i = face_offsets[v]; i < face_offsets[v + 1]; i++) {
+                    GLuint face = member_faces[i];
+                    GLfloat area = face_areas[face];
+                    x += area * face_normals[face * 3];
+                    y += area * face_normals[face * 3 + 1];
+                    z += area * face_normals[face * 3 + 2];
+                }
+
+                GLfloat length = sqrtf(x * x + y * y + z * z);
+                GLfloat inverse = length > 0.0f ? 1.0f / length : 0.0f;
+
+                normals[v * 3] = x * inverse;
+                normals[v * 3 + 1] = y * inverse;
+                normals[v * 3 + 2] = z * inverse;
+            }
+        });
+    }
+
+}
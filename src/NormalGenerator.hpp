@@ -0,0 +1,18 @@
+#pragma once
+
+#ifndef NORMALGENERATOR_H
+#define NORMALGENERATOR_H
+
+#include "GL/freeglut.h"
+
+namespace NormalGenerator {
+
+    void faceNormals(const GLfloat *coords, const GLuint *indices, GLuint num_faces,
+        GLfloat *normals, GLfloat *areas);
+    void vertexNormals(const GLfloat *face_normals, const GLfloat *face_areas,
+        const GLuint *face_offsets, const GLuint *member_faces, GLuint num_vertices,
+        GLfloat *normals);
+
+}
+
+#endif
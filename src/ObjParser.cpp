@@ -0,0 +1,957 @@
+#include <float.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "ObjParser.hpp"
+#include "Profiler.hpp"
+#include "WorkerPool.hpp"
+
+
+/*
+ * Locale-independent tokenizer for .obj files. Works directly on an
+ * in-memory buffer (usually a mapped file), so no stdio calls or
+ * per-character function calls are made while parsing.
+ *
+ * Most models are plain "v x y z" and "f a b c" records, which the fast
+ * path reads straight into the output on several threads. Files with
+ * texture coordinates or normals, "a/b/c" indices, negative indices or
+ * polygons are read by the general parser, also on several threads,
+ * which triangulates polygons and gives every distinct
+ * position/texcoord/normal combination its own vertex. "o", "g" and
+ * "usemtl" records are kept as groups by both.
+ */
+namespace ObjParser {
+
+    /* Exact powers of ten representable as doubles, used to scale mantissas */
+    static const double POW10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    static inline bool isDigit(char c) {
+        return (unsigned)(c - '0') < 10;
+    }
+
+    static inline bool isBlank(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline const char *skipBlanks(const char *p, const char *end) {
+        while (p < end && isBlank(*p)) p++;
+        return p;
+    }
+
+    static inline const char *skipLine(const char *p, const char *end) {
+        while (p < end && *p != '\n') p++;
+        return p < end ? p + 1 : end;
+    }
+
+    /* Whether nothing but blanks or a comment is left of the line at p */
+    static inline bool atLineEnd(const char *p, const char *end) {
+        p = skipBlanks(p, end);
+        return p == end || *p == '\n' || *p == '\r' || *p == '#';
+    }
+
+    /*
+     * Initializes bounds so that any vertex will replace them.
+     */
+    void resetBounds(Bounds &bounds) {
+        bounds.minx = bounds.miny = bounds.minz = FLT_MAX;
+        bounds.maxx = bounds.maxy = bounds.maxz = -FLT_MAX;
+    }
+
+
+    /*
+     * Parses a decimal float (optional sign, fraction and exponent) starting
+     * at p, skipping leading blanks.
+     *
+     * Returns a pointer past the number, or NULL if no digits were found.
+     */
+    const char *parseFloat(const char *p, const char *end, GLfloat &value) {
+        p = skipBlanks(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = (*p == '-');
+            p++;
+        }
+
+        /* Accumulate up to 19 significant digits; further digits only scale */
+        unsigned long long mantissa = 0;
+        int digits = 0, exponent = 0;
+        const char *start = p;
+
+        for (; p < end && isDigit(*p); p++) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) digits++;
+            } else {
+                exponent++;
+            }
+        }
+
+        if (p < end && *p == '.') {
+            for (p++; p < end && isDigit(*p); p++) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if (mantissa) digits++;
+                    exponent--;
+                }
+            }
+        }
+
+        if (p == start || (p == start + 1 && *start == '.')) return NULL;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            bool exp_negative = false;
+            if (q < end && (*q == '-' || *q == '+')) {
+                exp_negative = (*q == '-');
+                q++;
+            }
+
+            if (q < end && isDigit(*q)) {
+                int e = 0;
+                for (; q < end && isDigit(*q); q++) {
+                    if (e < 10000) e = e * 10 + (*q - '0');
+                }
+                exponent += exp_negative ? -e : e;
+                p = q;
+            }
+        }
+
+        /* Dividing by an exact power of ten keeps the common case correctly rounded */
+        double result = (double)mantissa;
+        while (exponent > 22) { result *= 1e22; exponent -= 22; }
+        while (exponent < -22) { result /= 1e22; exponent += 22; }
+        result = exponent < 0 ? result / POW10[-exponent] : result * POW10[exponent];
+
+        value = (GLfloat)(negative ? -result : result);
+        return p;
+    }
+
+
+    /*
+     * Parses an unsigned vertex index starting at p, skipping leading blanks.
+     *
+     * Returns a pointer past the number, or NULL if no digits were found.
+     */
+    const char *parseIndex(const char *p, const char *end, GLuint &value) {
+        p = skipBlanks(p, end);
+
+        const char *start = p;
+        GLuint result = 0;
+        for (; p < end && isDigit(*p); p++) {
+            result = result * 10 + (*p - '0');
+        }
+
+        if (p == start) return NULL;
+
+        value = result;
+        return p;
+    }
+
+
+    /*
+     * Counts the "v", "vt", "vn" and "f" records in [begin, end), the same
+     * way the parsers recognize them, so the output can be allocated once.
+     */
+    void countRecords(const char *begin, const char *end, Counts &counts) {
+        counts.vertices = counts.texcoords = counts.normals = counts.faces = 0;
+
+        for (const char *p = begin; p < end;) {
+            if (p + 1 < end && isBlank(p[1])) {
+                if (*p == 'v') counts.vertices++;
+                else if (*p == 'f') counts.faces++;
+            } else if (*p == 'v' && p + 2 < end && isBlank(p[2])) {
+                if (p[1] == 't') counts.texcoords++;
+                else if (p[1] == 'n') counts.normals++;
+            }
+
+            const char *newline = (const char *)memchr(p, '\n', end - p);
+            p = newline ? newline + 1 : end;
+        }
+    }
+
+
+    /*
+     * If the line at p is an "o", "g" or "usemtl" record, adds it to records
+     * as starting at triangle face.
+     *
+     * Returns true if it was one; false otherwise.
+     */
+    static bool readGroupRecord(const char *p, const char *end, GLuint face,
+        std::vector<GroupRecord> &records) {
+
+        GroupRecord record;
+        const char *name;
+
+        if ((*p == 'o' || *p == 'g') && p + 1 < end && isBlank(p[1])) {
+            record.kind = *p;
+            name = p + 1;
+        } else if (end - p > 6 && !memcmp(p, "usemtl", 6) && isBlank(p[6])) {
+            record.kind = 'u';
+            name = p + 6;
+        } else {
+            return false;
+        }
+
+        /* The rest of the line, trimmed and truncated */
+        name = skipBlanks(name, end);
+        const char *name_end = name;
+        while (name_end < end && *name_end != '\n' && *name_end != '\r') name_end++;
+        while (name_end > name && isBlank(name_end[-1])) name_end--;
+
+        size_t length = name_end - name;
+        if (length > sizeof(record.name) - 1) length = sizeof(record.name) - 1;
+        memcpy(record.name, name, length);
+        record.name[length] = '\0';
+
+        record.face = face;
+        records.push_back(record);
+        return true;
+    }
+
+
+    /*
+     * Fast path: parses every line in [begin, end), storing vertex
+     * coordinates and (zero-based) face indices from coords and indices on,
+     * which must have room for the records counted by countRecords, and
+     * widening bounds. Group records are added to records, numbered from
+     * first_face. line_count is advanced by the number of lines consumed.
+     *
+     * Returns true for a successful parse; false on any face that isn't
+     * three positive indices below num_vertices (or any malformed record),
+     * which the general parser then has to read.
+     */
+    static bool parseRecords(const char *begin, const char *end, GLfloat *coords, GLuint *indices,
+        GLuint num_vertices, GLuint first_face, std::vector<GroupRecord> &records,
+        Bounds &bounds, int &line_count) {
+
+        const char *p = begin;
+        const GLuint *first_index = indices;
+
+        while (p < end) {
+            line_count++;
+
+            char ch = *p;
+            bool record = (p + 1 < end && isBlank(p[1]));
+
+            if (ch == 'v' && record) {
+                GLfloat x, y, z;
+                const char *q = parseFloat(p + 1, end, x);
+                if (q) q = parseFloat(q, end, y);
+                if (q) q = parseFloat(q, end, z);
+
+                if (q == NULL) return false;
+
+                *coords++ = x;
+                *coords++ = y;
+                *coords++ = z;
+
+                if (x > bounds.maxx) bounds.maxx = x;
+                if (y > bounds.maxy) bounds.maxy = y;
+                if (z > bounds.maxz) bounds.maxz = z;
+
+                if (x < bounds.minx) bounds.minx = x;
+                if (y < bounds.miny) bounds.miny = y;
+                if (z < bounds.minz) bounds.minz = z;
+
+                p = q;
+
+            } else if (ch == 'f' && record) {
+                GLuint v1, v2, v3;
+                const char *q = parseIndex(p + 1, end, v1);
+                if (q) q = parseIndex(q, end, v2);
+                if (q) q = parseIndex(q, end, v3);
+
+                /* Slashes, signs, polygons and bad indices all go to the general
+                 * parser (index 0 wraps around, so it is out of range too) */
+                if (q == NULL || !atLineEnd(q, end)) return false;
+                if (v1 - 1 >= num_vertices || v2 - 1 >= num_vertices || v3 - 1 >= num_vertices) return false;
+
+                *indices++ = v1 - 1;
+                *indices++ = v2 - 1;
+                *indices++ = v3 - 1;
+
+                p = q;
+
+            } else if (ch == 'o' || ch == 'g' || ch == 'u') {
+                readGroupRecord(p, end, first_face + (GLuint)(indices - first_index) / 3, records);
+            }
+
+            p = skipLine(p, end); // rest of record, or a line not read here
+        }
+
+        return true;
+    }
+
+
+    /*
+     * Fast path over [begin, end): appends vertex coordinates and
+     * (zero-based) face indices to the given vectors, and group records to
+     * records, and widens bounds. The records are counted first, so each
+     * vector grows only once. line_count is advanced by the number of lines
+     * consumed.
+     *
+     * Returns true for a successful parse; false if the buffer has texture
+     * coordinates, normals or any face parseRecords can't read.
+     */
+    bool parseBuffer(const char *begin, const char *end,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count) {
+
+        Counts counts;
+        countRecords(begin, end, counts);
+        if (counts.texcoords > 0 || counts.normals > 0) return false;
+
+        size_t coord_base = vertexCoords.size();
+        size_t index_base = faceVertices.size();
+        vertexCoords.resize(coord_base + counts.vertices * 3);
+        faceVertices.resize(index_base + counts.faces * 3);
+
+        return parseRecords(begin, end, vertexCoords.data() + coord_base,
+            faceVertices.data() + index_base, (GLuint)(vertexCoords.size() / 3), (GLuint)(index_base / 3),
+            records, bounds, line_count);
+    }
+
+
+    /*
+     * Widens bounds to also contain other.
+     */
+    static void mergeBounds(Bounds &bounds, const Bounds &other) {
+        if (other.maxx > bounds.maxx) bounds.maxx = other.maxx;
+        if (other.maxy > bounds.maxy) bounds.maxy = other.maxy;
+        if (other.maxz > bounds.maxz) bounds.maxz = other.maxz;
+
+        if (other.minx < bounds.minx) bounds.minx = other.minx;
+        if (other.miny < bounds.miny) bounds.miny = other.miny;
+        if (other.minz < bounds.minz) bounds.minz = other.minz;
+    }
+
+
+    /*
+     * Splits [begin, end) into num_threads chunks at newline boundaries, so
+     * no record straddles two chunks, and counts the records of each on the
+     * worker pool.
+     */
+    static void countChunks(const char *begin, const char *end, unsigned num_threads,
+        std::vector<Chunk> &chunks) {
+
+        chunks.assign(num_threads, Chunk());
+        size_t size = end - begin;
+        const char *chunk_begin = begin;
+
+        for (unsigned i = 0; i < num_threads; i++) {
+            const char *chunk_end = (i + 1 == num_threads) ? end : begin + size * (i + 1) / num_threads;
+            if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+
+            const char *newline = (const char *)memchr(chunk_end, '\n', end - chunk_end);
+            if (i + 1 < num_threads) chunk_end = newline ? newline + 1 : end;
+
+            chunks[i].begin = chunk_begin;
+            chunks[i].end = chunk_end;
+            chunk_begin = chunk_end;
+        }
+
+        WorkerPool::parallelFor(num_threads, 1, [&chunks](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                countRecords(chunks[i].begin, chunks[i].end, chunks[i].counts);
+            }
+        });
+    }
+
+
+    /*
+     * Returns true if any chunk has texture coordinates or normals, which
+     * only the general parser reads; false otherwise.
+     */
+    static bool hasAttributes(const std::vector<Chunk> &chunks) {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            if (chunks[i].counts.texcoords > 0 || chunks[i].counts.normals > 0) return true;
+        }
+        return false;
+    }
+
+
+    /*
+     * Fast path over counted chunks, on the worker pool. Prefix sums of the
+     * counts give each chunk its range of the output, which is allocated
+     * once, and the chunks are parsed straight into their ranges. Face
+     * indices in the file are absolute, so the output is identical to that
+     * of parseBuffer over the whole range.
+     *
+     * Returns true for a successful parse; false if parseBuffer would fail.
+     */
+    static bool parseChunks(std::vector<Chunk> &chunks,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count) {
+
+        size_t num_chunks = chunks.size();
+
+        /* Prefix sums give each chunk's output offsets */
+        std::vector<size_t> coord_offset(num_chunks + 1, vertexCoords.size());
+        std::vector<size_t> index_offset(num_chunks + 1, faceVertices.size());
+
+        for (size_t i = 0; i < num_chunks; i++) {
+            coord_offset[i + 1] = coord_offset[i] + chunks[i].counts.vertices * 3;
+            index_offset[i + 1] = index_offset[i] + chunks[i].counts.faces * 3;
+        }
+
+        vertexCoords.resize(coord_offset[num_chunks]);
+        faceVertices.resize(index_offset[num_chunks]);
+
+        /* Each chunk parses into its own disjoint range */
+        WorkerPool::parallelFor(num_chunks, 1, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                Chunk &chunk = chunks[i];
+
+                resetBounds(chunk.bounds);
+                chunk.line_count = 0;
+                chunk.parsed = parseRecords(chunk.begin, chunk.end,
+                    vertexCoords.data() + coord_offset[i], faceVertices.data() + index_offset[i],
+                    (GLuint)(vertexCoords.size() / 3), (GLuint)(index_offset[i] / 3),
+                    chunk.records, chunk.bounds, chunk.line_count);
+            }
+        });
+
+        for (size_t i = 0; i < num_chunks; i++) {
+            if (!chunks[i].parsed) return false;
+        }
+
+        for (size_t i = 0; i < num_chunks; i++) {
+            line_count += chunks[i].line_count;
+            mergeBounds(bounds, chunks[i].bounds);
+            records.insert(records.end(), chunks[i].records.begin(), chunks[i].records.end());
+        }
+
+        return true;
+    }
+
+
+    /*
+     * Fast path over [begin, end) on the worker pool: the buffer is split
+     * into num_threads chunks, which are counted and then parsed in
+     * parallel (see parseChunks).
+     *
+     * Returns true for a successful parse; false if parseBuffer would fail.
+     */
+    bool parseParallel(const char *begin, const char *end, unsigned num_threads,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count) {
+
+        if (num_threads < 2) {
+            return parseBuffer(begin, end, vertexCoords, faceVertices, records, bounds, line_count);
+        }
+
+        std::vector<Chunk> chunks;
+        countChunks(begin, end, num_threads, chunks);
+        if (hasAttributes(chunks)) return false;
+
+        return parseChunks(chunks, vertexCoords, faceVertices, records, bounds, line_count);
+    }
+
+
+    /*
+     * Maps corners to the vertices of one chunk of the general parser. The
+     * vertices are the chunk's distinct corners, in order of first use.
+     * They are found through an open addressing hash table (linear probing
+     * over one flat array, doubled once half full) keyed by position index
+     * alone: nearby faces use nearby positions, so lookups stay in cache,
+     * and the few corners sharing a position sit next to each other.
+     */
+    class VertexTable {
+    public:
+        VertexTable(std::vector<Corner> &vertices, size_t expected) : vertices(vertices) {
+            size_t capacity = 16;
+            while (capacity < expected * 2) capacity *= 2;
+            slots.assign(capacity, Slot{ NONE, NONE });
+        }
+
+        /* Returns the vertex of corner, adding it if it is new */
+        GLuint find(const Corner &corner) {
+            if ((vertices.size() + 1) * 2 > slots.size()) grow();
+
+            size_t mask = slots.size() - 1;
+            for (size_t i = corner.v & mask;; i = (i + 1) & mask) {
+                Slot &slot = slots[i];
+
+                if (slot.vertex == NONE) {
+                    slot.v = corner.v;
+                    slot.vertex = (GLuint)vertices.size();
+                    vertices.push_back(corner);
+                    return slot.vertex;
+                }
+
+                if (slot.v == corner.v) {
+                    const Corner &key = vertices[slot.vertex];
+                    if (key.vt == corner.vt && key.vn == corner.vn) return slot.vertex;
+                }
+            }
+        }
+
+    private:
+        struct Slot {
+            GLuint v, vertex;
+        };
+
+        void grow() {
+            slots.assign(slots.size() * 2, Slot{ NONE, NONE });
+
+            size_t mask = slots.size() - 1;
+            for (size_t vertex = 0; vertex < vertices.size(); vertex++) {
+                size_t i = vertices[vertex].v & mask;
+                while (slots[i].vertex != NONE) i = (i + 1) & mask;
+                slots[i].v = vertices[vertex].v;
+                slots[i].vertex = (GLuint)vertex;
+            }
+        }
+
+        std::vector<Corner> &vertices;
+        std::vector<Slot> slots;
+    };
+
+
+    /*
+     * Parses a one-based .obj index at p (no leading blanks), which may be
+     * negative to count back from the last of the count elements read so
+     * far, into a zero-based index.
+     *
+     * Returns a pointer past it, or NULL if it is missing, zero or out of range.
+     */
+    static const char *parseReference(const char *p, const char *end, size_t count, GLuint &index) {
+        bool negative = (p < end && *p == '-');
+        if (negative) p++;
+        if (p == end || !isDigit(*p)) return NULL;
+
+        GLuint value;
+        p = parseIndex(p, end, value);
+        if (value == 0 || value > count) return NULL;
+
+        index = negative ? (GLuint)(count - value) : value - 1;
+        return p;
+    }
+
+
+    /*
+     * Parses the corners of a face record starting at p (just past the 'f')
+     * into corners, resolving each index against the number of positions,
+     * texture coordinates and normals read before the record.
+     *
+     * Returns a pointer past the last corner, or NULL if the record is
+     * malformed, with error saying why.
+     */
+    const char *parseFace(const char *p, const char *end,
+        size_t num_positions, size_t num_texcoords, size_t num_normals,
+        std::vector<Corner> &corners, const char *&error) {
+
+        corners.clear();
+        p = skipBlanks(p, end);
+
+        while (!atLineEnd(p, end)) {
+            Corner corner = { 0, NONE, NONE };
+
+            p = parseReference(skipBlanks(p, end), end, num_positions, corner.v);
+
+            if (p && p < end && *p == '/') {
+                p++;
+                if (p < end && *p != '/') p = parseReference(p, end, num_texcoords, corner.vt);
+                if (p && p < end && *p == '/') p = parseReference(p + 1, end, num_normals, corner.vn);
+            }
+
+            if (p == NULL || (p < end && !isBlank(*p) && *p != '\n' && *p != '\r')) {
+                error = "Bad face index";
+                return NULL;
+            }
+
+            corners.push_back(corner);
+        }
+
+        if (corners.size() < 3) {
+            error = "Less than 3 values";
+            return NULL;
+        }
+
+        return p;
+    }
+
+
+    /* What the general parser made of one chunk: its distinct corners, in
+     * order of first use, and its triangles as indices into them */
+    struct GeneralChunk {
+        std::vector<Corner> vertices;
+        std::vector<GLuint> faces;
+        bool all_normals, all_texcoords;
+        const char *error;
+    };
+
+
+    /*
+     * General parser for one chunk. Its "v", "vt" and "vn" records are
+     * stored from the given counts of each before the chunk on, in the
+     * file's own arrays, and face corners are resolved against the same
+     * running counts, so negative indices count back across chunks. Faces
+     * may list any number of corners and are split into fans of triangles
+     * around their first corner; the corners are only numbered here, and
+     * copied out of the file's arrays once every chunk has been read.
+     * Group records are numbered by the chunk's own triangles.
+     *
+     * Returns true for a successful parse; false otherwise, with the
+     * chunk's line_count at the offending line and output.error saying why.
+     */
+    static bool parseGeneralRecords(Chunk &chunk, const Counts &before,
+        GLfloat *positions, GLfloat *texcoords, GLfloat *normals, GeneralChunk &output) {
+
+        size_t num_positions = before.vertices;
+        size_t num_texcoords = before.texcoords;
+        size_t num_normals = before.normals;
+
+        /* Triangles average about half a vertex each */
+        output.faces.reserve(chunk.counts.faces * 3);
+        output.vertices.reserve(chunk.counts.faces / 2 + 16);
+        output.all_normals = output.all_texcoords = true;
+
+        VertexTable table(output.vertices, chunk.counts.faces / 2 + 16);
+        std::vector<Corner> corners;
+
+        Bounds &bounds = chunk.bounds;
+        const char *p = chunk.begin, *end = chunk.end;
+
+        while (p < end) {
+            chunk.line_count++;
+
+            char ch = *p;
+            bool record = (p + 1 < end && isBlank(p[1]));
+
+            if (ch == 'v' && record) {
+                GLfloat x, y, z;
+                const char *q = parseFloat(p + 1, end, x);
+                if (q) q = parseFloat(q, end, y);
+                if (q) q = parseFloat(q, end, z);
+
+                if (q == NULL) {
+                    output.error = "Less than 3 values";
+                    return false;
+                }
+
+                GLfloat *position = positions + num_positions++ * 3;
+                position[0] = x;
+                position[1] = y;
+                position[2] = z;
+
+                if (x > bounds.maxx) bounds.maxx = x;
+                if (y > bounds.maxy) bounds.maxy = y;
+                if (z > bounds.maxz) bounds.maxz = z;
+
+                if (x < bounds.minx) bounds.minx = x;
+                if (y < bounds.miny) bounds.miny = y;
+                if (z < bounds.minz) bounds.minz = z;
+
+                p = q;
+
+            } else if (ch == 'v' && p + 2 < end && p[1] == 'n' && isBlank(p[2])) {
+                GLfloat *normal = normals + num_normals * 3;
+                const char *q = parseFloat(p + 2, end, normal[0]);
+                if (q) q = parseFloat(q, end, normal[1]);
+                if (q) q = parseFloat(q, end, normal[2]);
+
+                if (q == NULL) {
+                    output.error = "Less than 3 values";
+                    return false;
+                }
+
+                num_normals++;
+                p = q;
+
+            } else if (ch == 'v' && p + 2 < end && p[1] == 't' && isBlank(p[2])) {
+                /* The optional third (w) coordinate is ignored */
+                GLfloat *texcoord = texcoords + num_texcoords * 2;
+                texcoord[1] = 0.0f;
+                const char *q = parseFloat(p + 2, end, texcoord[0]);
+                if (q && !atLineEnd(q, end)) q = parseFloat(q, end, texcoord[1]);
+
+                if (q == NULL) {
+                    output.error = "Bad texture coordinate";
+                    return false;
+                }
+
+                num_texcoords++;
+                p = q;
+
+            } else if (ch == 'f' && record) {
+                const char *q = parseFace(p + 1, end,
+                    num_positions, num_texcoords, num_normals, corners, output.error);
+                if (q == NULL) return false;
+
+                for (size_t c = 0; c < corners.size(); c++) {
+                    if (corners[c].vn == NONE) output.all_normals = false;
+                    if (corners[c].vt == NONE) output.all_texcoords = false;
+                }
+
+                /* Fan triangulation, which keeps the polygon's winding */
+                GLuint first = table.find(corners[0]), previous = table.find(corners[1]);
+
+                for (size_t c = 2; c < corners.size(); c++) {
+                    GLuint vertex = table.find(corners[c]);
+                    output.faces.push_back(first);
+                    output.faces.push_back(previous);
+                    output.faces.push_back(vertex);
+                    previous = vertex;
+                }
+
+                p = q;
+
+            } else if (ch == 'o' || ch == 'g' || ch == 'u') {
+                readGroupRecord(p, end, (GLuint)(output.faces.size() / 3), chunk.records);
+            }
+
+            p = skipLine(p, end); // rest of record, or a line not read here
+        }
+
+        return true;
+    }
+
+
+    /*
+     * General parser over counted chunks, on the worker pool. Prefix sums
+     * of the counts place each chunk's "v", "vt" and "vn" records in the
+     * file's own arrays, and every chunk is read in parallel, numbering
+     * its distinct corners (see parseGeneralRecords). The chunks' corners
+     * are then merged in order, so the vertices are those of a single pass
+     * over the file, and copied out and renumbered in parallel again.
+     *
+     * Each vertex has its position in vertexCoords, and its normal and
+     * texture coordinates in vertexNormals and vertexTexCoords, which are
+     * left empty unless every corner in the file has one. line_count is
+     * advanced by the number of lines consumed; on failure it is the
+     * offending line, and error says why.
+     *
+     * Returns true for a successful parse; false otherwise.
+     */
+    static bool parseGeneralChunks(std::vector<Chunk> &chunks,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLfloat> &vertexNormals,
+        std::vector<GLfloat> &vertexTexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count, const char *&error) {
+
+        size_t num_chunks = chunks.size();
+
+        /* Records of each kind before each chunk */
+        std::vector<Counts> before(num_chunks + 1, Counts());
+
+        for (size_t i = 0; i < num_chunks; i++) {
+            before[i + 1].vertices = before[i].vertices + chunks[i].counts.vertices;
+            before[i + 1].texcoords = before[i].texcoords + chunks[i].counts.texcoords;
+            before[i + 1].normals = before[i].normals + chunks[i].counts.normals;
+        }
+
+        /* The file's own arrays, which corners index into */
+        const Counts &total = before[num_chunks];
+        std::vector<GLfloat> positions(total.vertices * 3), texcoords(total.texcoords * 2), normals(total.normals * 3);
+        std::vector<GeneralChunk> output(num_chunks);
+
+        WorkerPool::parallelFor(num_chunks, 1, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                Chunk &chunk = chunks[i];
+
+                resetBounds(chunk.bounds);
+                chunk.records.clear();
+                chunk.line_count = 0;
+                chunk.parsed = parseGeneralRecords(chunk, before[i],
+                    positions.data(), texcoords.data(), normals.data(), output[i]);
+            }
+        });
+
+        for (size_t i = 0; i < num_chunks; i++) {
+            line_count += chunks[i].line_count;
+
+            if (!chunks[i].parsed) {
+                error = output[i].error;
+                return false;
+            }
+        }
+
+        /* Corners used by several chunks are merged into one vertex, numbered
+         * in chunk order, so vertices keep the file's order of first use. A
+         * lone chunk's vertices and triangles are already numbered. */
+        std::vector<Corner> vertices;
+        std::vector<std::vector<GLuint> > numbers(num_chunks);
+        bool all_normals = true, all_texcoords = true;
+
+        if (num_chunks == 1) {
+            vertices.swap(output[0].vertices);
+        } else {
+            size_t expected = 0;
+            for (size_t i = 0; i < num_chunks; i++) expected += output[i].vertices.size();
+
+            vertices.reserve(expected);
+            VertexTable table(vertices, expected);
+
+            for (size_t i = 0; i < num_chunks; i++) {
+                numbers[i].resize(output[i].vertices.size());
+                for (size_t k = 0; k < numbers[i].size(); k++) numbers[i][k] = table.find(output[i].vertices[k]);
+                std::vector<Corner>().swap(output[i].vertices);
+            }
+        }
+
+        /* Prefix sums give each chunk's triangle offsets */
+        std::vector<size_t> index_offset(num_chunks + 1, faceVertices.size());
+
+        for (size_t i = 0; i < num_chunks; i++) {
+            index_offset[i + 1] = index_offset[i] + output[i].faces.size();
+            all_normals = all_normals && output[i].all_normals;
+            all_texcoords = all_texcoords && output[i].all_texcoords;
+        }
+
+        size_t vertex_base = vertexCoords.size() / 3;
+        size_t num_vertices = vertex_base + vertices.size();
+        vertexCoords.resize(num_vertices * 3);
+
+        if (all_normals) vertexNormals.resize(num_vertices * 3);
+        else std::vector<GLfloat>().swap(vertexNormals);
+
+        if (all_texcoords) vertexTexCoords.resize(num_vertices * 2);
+        else std::vector<GLfloat>().swap(vertexTexCoords);
+
+        bool moved = (num_chunks == 1 && faceVertices.empty());
+        if (moved) faceVertices.swap(output[0].faces);
+        else faceVertices.resize(index_offset[num_chunks]);
+
+        /* Vertices are copied out of the file's arrays */
+        WorkerPool::parallelFor(vertices.size(), 65536, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                const Corner &vertex = vertices[k];
+                size_t out = vertex_base + k;
+
+                memcpy(&vertexCoords[out * 3], &positions[vertex.v * 3], 3 * sizeof(GLfloat));
+                if (all_normals) memcpy(&vertexNormals[out * 3], &normals[vertex.vn * 3], 3 * sizeof(GLfloat));
+                if (all_texcoords) memcpy(&vertexTexCoords[out * 2], &texcoords[vertex.vt * 2], 2 * sizeof(GLfloat));
+            }
+        });
+
+        /* Each chunk's triangles are renumbered into its own range */
+        if (!moved) WorkerPool::parallelFor(num_chunks, 1, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                const std::vector<GLuint> &faces = output[i].faces;
+                GLuint *indices = faceVertices.data() + index_offset[i];
+                GLuint base = (GLuint)vertex_base;
+
+                if (num_chunks == 1) {
+                    for (size_t k = 0; k < faces.size(); k++) indices[k] = faces[k] + base;
+                } else {
+                    for (size_t k = 0; k < faces.size(); k++) indices[k] = numbers[i][faces[k]] + base;
+                }
+            }
+        });
+
+        for (size_t i = 0; i < num_chunks; i++) {
+            mergeBounds(bounds, chunks[i].bounds);
+
+            for (size_t r = 0; r < chunks[i].records.size(); r++) {
+                records.push_back(chunks[i].records[r]);
+                records.back().face += (GLuint)(index_offset[i] / 3);
+            }
+        }
+
+        return true;
+    }
+
+
+    /*
+     * General parser over [begin, end) on the worker pool: the buffer is
+     * split into num_threads chunks, which are counted and then parsed in
+     * parallel (see parseGeneralChunks).
+     *
+     * Returns true for a successful parse; false otherwise.
+     */
+    bool parseGeneral(const char *begin, const char *end, unsigned num_threads,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLfloat> &vertexNormals,
+        std::vector<GLfloat> &vertexTexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count, const char *&error) {
+
+        std::vector<Chunk> chunks;
+        countChunks(begin, end, std::max(1u, num_threads), chunks);
+
+        return parseGeneralChunks(chunks, vertexCoords, vertexNormals, vertexTexCoords,
+            faceVertices, records, bounds, line_count, error);
+    }
+
+
+    /*
+     * Turns group records into runs of triangles: "o" and "g" records name
+     * the triangles after them, and "usemtl" records give them a material.
+     * Empty runs are dropped.
+     */
+    void buildGroups(const std::vector<GroupRecord> &records, GLuint num_faces, std::vector<Group> &groups) {
+        groups.clear();
+
+        Group group = Group();
+        for (size_t i = 0; i <= records.size(); i++) {
+            GLuint face = (i < records.size()) ? records[i].face : num_faces;
+
+            group.num_faces = face - group.first_face;
+            if (group.num_faces > 0) groups.push_back(group);
+            if (i == records.size()) break;
+
+            const GroupRecord &record = records[i];
+            strcpy(record.kind == 'u' ? group.material : group.name, record.name);
+            group.first_face = face;
+        }
+    }
+
+
+    /*
+     * Parses [begin, end) into the given arrays (see parseGeneralChunks),
+     * and reports the line of any malformed record, on several threads when
+     * the buffer is large enough for it to pay off (see
+     * Constants::loader_threads). The file is counted once: files with
+     * texture coordinates or normals go straight to the general parser,
+     * and others take the fast path, falling back to the general parser
+     * (with the same counts) on a face it can't read.
+     *
+     * Returns true for a successful parse; false otherwise.
+     */
+    bool parse(const char *begin, const char *end,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLfloat> &vertexNormals,
+        std::vector<GLfloat> &vertexTexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<Group> &groups, Bounds &bounds, int &line_count) {
+
+        Profiler::Scope scope("parse", "load");
+
+        unsigned num_threads = WorkerPool::threadCount();
+        if ((size_t)(end - begin) < Constants::parallel_parse_bytes) num_threads = 1;
+
+        Bounds start_bounds = bounds;
+        int start_line = line_count;
+        std::vector<GroupRecord> records;
+
+        std::vector<Chunk> chunks;
+        countChunks(begin, end, num_threads, chunks);
+
+        bool parsed = !hasAttributes(chunks)
+            && parseChunks(chunks, vertexCoords, faceVertices, records, bounds, line_count);
+
+        if (!parsed) {
+            vertexCoords.clear();
+            faceVertices.clear();
+            records.clear();
+            bounds = start_bounds;
+            line_count = start_line;
+
+            const char *error = "";
+            parsed = parseGeneralChunks(chunks, vertexCoords, vertexNormals, vertexTexCoords,
+                faceVertices, records, bounds, line_count, error);
+
+            if (!parsed) printf("%s on line %d\n", error, line_count);
+        }
+
+        if (parsed) buildGroups(records, (GLuint)(faceVertices.size() / 3), groups);
+        return parsed;
+    }
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+namespace ObjParser {
+
+    /* Marks a missing texture coordinate or normal index */
+    const GLuint NONE = (GLuint)-1;
+
+    /* Min/max vertex coordinates seen while parsing */
+    struct Bounds {
+        GLfloat minx, miny, minz;
+        GLfloat maxx, maxy, maxz;
+    };
+
+    /* Records counted in a span of the file ("v", "vt", "vn" and "f" lines) */
+    struct Counts {
+        size_t vertices, texcoords, normals, faces;
+    };
+
+    /* One corner of a face: zero-based position, texture coordinate and
+     * normal indices, the latter two NONE if absent */
+    struct Corner {
+        GLuint v, vt, vn;
+    };
+
+    /* An "o", "g" or "usemtl" record, and the first triangle after it */
+    struct GroupRecord {
+        char kind;
+        char name[64];
+        GLuint face;
+    };
+
+    /* A run of triangles sharing an object/group name and a material, in
+     * the order they were read from the file */
+    struct Group {
+        char name[64];
+        char material[64];
+        GLuint first_face, num_faces;
+    };
+
+    /* One newline-aligned span of the file, and the records counted in it */
+    struct Chunk {
+        const char *begin, *end;
+        Counts counts;
+        std::vector<GroupRecord> records;
+        Bounds bounds;
+        int line_count;
+        bool parsed;
+    };
+
+    void resetBounds(Bounds &bounds);
+    const char *parseFloat(const char *p, const char *end, GLfloat &value);
+    const char *parseIndex(const char *p, const char *end, GLuint &value);
+    const char *parseFace(const char *p, const char *end,
+        size_t num_positions, size_t num_texcoords, size_t num_normals,
+        std::vector<Corner> &corners, const char *&error);
+    void countRecords(const char *begin, const char *end, Counts &counts);
+    void buildGroups(const std::vector<GroupRecord> &records, GLuint num_faces, std::vector<Group> &groups);
+    bool parseBuffer(const char *begin, const char *end,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count);
+    bool parseParallel(const char *begin, const char *end, unsigned num_threads,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count);
+    bool parseGeneral(const char *begin, const char *end, unsigned num_threads,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLfloat> &vertexNormals,
+        std::vector<GLfloat> &vertexTexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<GroupRecord> &records, Bounds &bounds, int &line_count, const char *&error);
+    bool parse(const char *begin, const char *end,
+        std::vector<GLfloat> &vertexCoords, std::vector<GLfloat> &vertexNormals,
+        std::vector<GLfloat> &vertexTexCoords, std::vector<GLuint> &faceVertices,
+        std::vector<Group> &groups, Bounds &bounds, int &line_count);
+
+}
+
+#endif
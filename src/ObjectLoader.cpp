@@ -2,218 +2,553 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <utility>
 #include <vector>
-#include <list>
 #include <iostream>
+#include <chrono>
 
 #include "GL/freeglut.h"
 
+#include "AsyncLoader.hpp"
 #include "Display.hpp"
 #include "Camera.hpp"
+#include "ChunkStream.hpp"
+#include "Constants.hpp"
+#include "MappedFile.hpp"
+#include "MeshClusters.hpp"
+#include "MeshLod.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshPool.hpp"
+#include "NormalGenerator.hpp"
 #include "ObjectLoader.hpp"
+#include "ObjParser.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
+#include "ShaderLoader.hpp"
+#include "WorkerPool.hpp"
 
 
 namespace ObjectLoader {
 
     const bool DEBUG(false);
 
-    /* used to calculate vertex normals for Gouraud shading */
-    std::vector<GLfloat> faceNormals;
-    std::vector<GLfloat> faceAreas;
+    /* The model being drawn; the Display, MeshClusters and MeshLod arrays
+     * point into it (see installModel) */
+    Model current;
 
-    /* Maps vertices to all faces they belong to */
-    std::vector< std::list< GLuint > > memberFaces;
 
+    static void setProgress(std::atomic<unsigned> *progress, unsigned percent) {
+        if (progress != NULL) *progress = percent;
+    }
 
-    /* 
-     * Reads the vertex/face data from the argument file, and stores it in
-     * the global vectors vertexCoords and faceVertices. Also stores min/max 
-     * vertex coordinates.
+
+    /*
+     * Points the draw arrays of a freshly built model at its own vectors.
+     */
+    static void setModelArrays(Model &model) {
+        model.vertexData = model.vertexCoords.data();
+        model.normalData = model.vertexNormals.data();
+        model.indexData = model.faceVertices.data();
+        model.numVertices = model.vertexCoords.size() / 3;
+        model.numIndices = model.faceVertices.size();
+
+        model.clusterData = model.clusters.data();
+        model.numClusters = model.clusters.size();
+        model.nodeData = model.nodes.data();
+        model.numNodes = model.nodes.size();
+
+        model.lodIndexData = model.lodIndices.data();
+        model.numLodIndices = model.lodIndices.size();
+        model.lodLevelData = model.lodLevels.data();
+        model.numLodLevels = model.lodLevels.size();
+        model.lodClusterData = model.lodClusters.data();
+        model.numLodClusters = model.lodClusters.size();
+    }
+
+
+    /*
+     * Loads the model at filepath and makes it the current model, replacing
+     * (and freeing) the previous one. Used at startup and by the headless
+     * renderer; see AsyncLoader for loads while the viewer is running.
      *
      * Returns true for successful load; false otherwise.
      */
     bool loadObject(char *filepath) {
-        FILE *fp;
-        fp = fopen(filepath, "r");
+        Model model;
+        if (!loadModel(filepath, model, NULL)) return false;
 
-        if (fp == NULL) {
+        installModel(model);
+        releaseModel(model);
+        return true;
+    }
+
+
+    /* 
+     * Reads the vertex/face data from the argument file into model, and
+     * stores its min/max vertex coordinates. Then calculates normals and
+     * builds the clusters and levels of detail, and packs the vertices for
+     * the GPU with Constants::PACKED_VERTICES. Only touches model, so it
+     * can run on any thread while another model is drawn.
+     *
+     * The file is memory-mapped and tokenized by ObjParser (split across
+     * worker threads for large files of plain triangles), and a throughput
+     * summary is printed once it has been read.
+     *
+     * If an up-to-date mesh cache exists next to the model, it is mapped and
+     * used instead, and the vectors are left empty; otherwise the cache is
+     * (re)written once the model has been processed.
+     *
+     * If progress is not NULL, it is set to a rough percentage done after
+     * each stage.
+     *
+     * Returns true for successful load; false otherwise.
+     */
+    bool loadModel(const char *filepath, Model &model, std::atomic<unsigned> *progress) {
+        Profiler::Scope scope("load", "load");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        strncpy(model.path, filepath, sizeof(model.path) - 1);
+        setProgress(progress, 0);
+
+        if (Constants::USE_MESH_CACHE && MeshCache::load(filepath, model)) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("Loaded \"%s\" from mesh cache in %.3f s\n", filepath, seconds);
+            setProgress(progress, 100);
+            return true;
+        }
+
+        MappedFile::File file;
+        if (!MappedFile::open(filepath, file)) {
             printf("Can't open \"%s\"\n", filepath);
             return false;
         }
 
         /* For error checking/printing during file reading */
-        int numRead;
-        int line_count = 1;
+        int line_count = 0;
 
-        char ch; // limited to 'v' and 'f' for this loader
+        ObjParser::Bounds &bounds = model.bounds;
+        ObjParser::resetBounds(bounds);
 
-        GLfloat x, y, z; // vertex coords
-        GLuint v1, v2, v3; // vertex indices (for faces)
+        bool parsed = ObjParser::parse(file.data, file.data + file.size,
+            model.vertexCoords, model.vertexNormals, model.vertexTexCoords, model.faceVertices,
+            model.groups, bounds, line_count);
 
-        while (!(feof(fp))) {
-            fscanf(fp, "%c", &ch);
+        size_t file_size = file.size;
+        uint64_t source_hash = 0;
+        if (parsed && Constants::USE_MESH_CACHE) source_hash = MeshCache::hashBytes(file.data, file.size);
 
-            if (ch == 'v') {
-                numRead = fscanf(fp, "%f %f %f\n", &x, &y, &z);
+        MappedFile::close(file);
 
-                if (numRead != 3) {
-                    printf("Less than 3 values on line %d\n", line_count);
-                    return false;
-                }
+        if (!parsed) return false;
+
+        /* No vertices leaves the bounds at their sentinels */
+        if (model.vertexCoords.empty()) bounds = ObjParser::Bounds();
+
+        if (abs(bounds.maxx - bounds.minx) > abs(bounds.maxy - bounds.miny)) {
+            model.max_xy = abs(bounds.maxx - bounds.minx);
+        } else {
+            model.max_xy = abs(bounds.maxy - bounds.miny);
+        }
 
-                Display::vertexCoords.push_back(x);
-                Display::vertexCoords.push_back(y);
-                Display::vertexCoords.push_back(z);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds <= 0.0) seconds = 1e-9;
 
-                if (x > Display::maxx) Display::maxx = x;
-                if (y > Display::maxy) Display::maxy = y;
-                if (z > Display::maxz) Display::maxz = z;
+        printf("Loaded \"%s\": %d lines, %.2f MB in %.3f s (%.0f lines/sec, %.1f MB/sec)\n",
+            filepath, line_count, file_size / 1e6, seconds,
+            line_count / seconds, file_size / 1e6 / seconds);
 
-                if (x < Display::minx) Display::minx = x;
-                if (y < Display::miny) Display::miny = y;
-                if (z < Display::minz) Display::minz = z;
+        if (model.groups.size() > 1 || !model.vertexNormals.empty() || !model.vertexTexCoords.empty()) {
+            printf("%u groups%s%s\n", (unsigned)model.groups.size(),
+                model.vertexNormals.empty() ? "" : ", normals", model.vertexTexCoords.empty() ? "" : ", texture coordinates");
+        }
 
-            } else if (ch == 'f') {
-                numRead = fscanf(fp, "%d %d %d\n", &v1, &v2, &v3);
+        if (DEBUG) printf("max: \t%.5f, %.5f, %.5f\n", bounds.maxx, bounds.maxy, bounds.maxz);
+        if (DEBUG) printf("min: \t%.5f, %.5f, %.5f\n\n", bounds.minx, bounds.miny, bounds.minz);
 
-                if (numRead != 3) {
-                    printf("Less than 3 values on line %d\n", line_count);
-                    return false;
-                }
+        setProgress(progress, 40);
 
-                Display::faceVertices.push_back(v1 - 1);
-                Display::faceVertices.push_back(v2 - 1);
-                Display::faceVertices.push_back(v3 - 1);
+        /* Once all faces have been read, calculate normals for Gouraud shading based on them */
+        processFaces(model);
+        setProgress(progress, 55);
 
-            } else {
-                fscanf(fp, "\n"); // character other than 'v' or 'f'; skip line
-            }
+        if (Constants::FRUSTUM_CULLING) clusterMesh(model);
+        setProgress(progress, 60);
 
-            line_count++;
-        }
+        if (Constants::OPTIMIZE_MESH) optimizeMesh(model);
+        setProgress(progress, 70);
 
-        if (abs(Display::maxx - Display::minx) > abs(Display::maxy - Display::miny)) {
-            Display::max_xy = abs(Display::maxx - Display::minx);
-        } else {
-            Display::max_xy = abs(Display::maxy - Display::miny);
+        if (Constants::BUILD_LOD) {
+            MeshLod::build(model.vertexCoords.data(), model.vertexCoords.size() / 3,
+                model.faceVertices.data(), model.faceVertices.size() / 3,
+                model.clusters.data(), model.clusters.size(),
+                model.lodIndices, model.lodLevels, model.lodClusters);
         }
+        setProgress(progress, 90);
 
-        if (DEBUG) printf("max: \t%.5f, %.5f, %.5f\n", Display::maxx, Display::maxy, Display::maxz);
-        if (DEBUG) printf("min: \t%.5f, %.5f, %.5f\n\n", Display::minx, Display::miny, Display::minz);
+        setModelArrays(model);
 
-        /* Once all faces have been read, calculate normals for Gouraud shading based on them */
-        processFaces();
+        /* Packed here rather than at upload, so the cache holds them too */
+        if (Constants::PACKED_VERTICES) ShaderLoader::prepareVertices(model);
+
+        if (Constants::USE_MESH_CACHE) MeshCache::write(filepath, model, source_hash);
+        setProgress(progress, 100);
 
         return true;
     }
 
 
+    /*
+     * Makes model the current model: swaps it with ObjectLoader::current and
+     * points the Display, MeshClusters and MeshLod arrays and bounds at it,
+     * then lays the Scene out again around it. model is left holding the
+     * previous model, for releaseModel once nothing draws from it anymore.
+     */
+    void installModel(Model &model) {
+        std::swap(current, model);
+
+        strcpy(Display::current_model, current.path);
+
+        Display::setMeshArrays(current.vertexData, current.normalData, current.indexData,
+            current.numVertices, current.numIndices);
+        MeshClusters::setClusterArrays(current.clusterData, current.numClusters,
+            current.nodeData, current.numNodes);
+        MeshLod::setLodArrays(current.lodIndexData, current.numLodIndices,
+            current.lodLevelData, current.numLodLevels,
+            current.lodClusterData, current.numLodClusters);
+
+        Display::maxx = current.bounds.maxx; Display::maxy = current.bounds.maxy; Display::maxz = current.bounds.maxz;
+        Display::minx = current.bounds.minx; Display::miny = current.bounds.miny; Display::minz = current.bounds.minz;
+        Display::max_xy = current.max_xy;
+
+        Scene::modelChanged();
+    }
+
+
+    /*
+     * Frees everything a model owns, and unmaps its mesh cache.
+     */
+    void releaseModel(Model &model) {
+        if (model.cached) MappedFile::close(model.cache);
+        model = Model();
+    }
+
+
+    template <typename T>
+    static size_t vectorBytes(const std::vector<T> &v) {
+        return v.capacity() * sizeof(T);
+    }
+
+
+    /*
+     * Returns the memory a model owns: its vectors and arena. A mapped mesh
+     * cache is backed by its file, so it isn't counted.
+     */
+    size_t hostBytes(const Model &model) {
+        return vectorBytes(model.vertexCoords) + vectorBytes(model.faceVertices)
+            + vectorBytes(model.vertexNormals) + vectorBytes(model.vertexTexCoords)
+            + vectorBytes(model.groups) + vectorBytes(model.clusters) + vectorBytes(model.nodes)
+            + vectorBytes(model.lodIndices) + vectorBytes(model.lodLevels) + vectorBytes(model.lodClusters)
+            + vectorBytes(model.packedVertices) + model.arena.capacity();
+    }
+
+
+    /*
+     * Frees a model's packed vertices once they are uploaded. Those in a
+     * mapped mesh cache stay mapped.
+     */
+    void releasePacked(Model &model) {
+        std::vector<VertexPacking::PackedVertex>().swap(model.packedVertices);
+        if (!model.cached) model.packedData = NULL;
+    }
+
+
     /* 
      * Changes the current object model to that in the given filepath.
+     * Models still resident in MeshPool are switched to at once. Others are
+     * loaded in the background and swapped in once they are on the GPU
+     * with Constants::ASYNC_LOADING; otherwise this blocks until done.
+     * Streaming (see ChunkStream) stops first.
      */
     void changeModel(char *filepath) {
-        if (!strcmp(filepath, Display::current_model)) return; // ignore redundant loads
+        ChunkStream::close();
 
-        strcpy(Display::current_model, filepath);
+        if (Constants::ASYNC_LOADING) {
+            AsyncLoader::request(filepath);
+            return;
+        }
 
-        Display::vertexCoords.clear();
-        Display::faceVertices.clear();
-        Display::vertexNormals.clear();
+        if (!strcmp(filepath, Display::current_model)) return; // ignore redundant loads
 
-        faceNormals.clear();
-        faceAreas.clear();
+        if (!MeshPool::show(filepath)) {
+            Model model;
+            if (!loadModel(filepath, model, NULL)) return;
+
+            MeshPool::GpuMesh mesh;
+            ShaderLoader::uploadModel(model, mesh);
+            MeshPool::add(model, mesh);
+        }
 
-        loadObject(filepath);
         Camera::resetCamera();
+        Display::invalidate();
+    }
+
 
-        Display::reinitializeShaders();
+    /*
+     * Builds the map of vertices to the faces containing them from the
+     * model's index buffer, with a counting pass followed by a fill pass.
+     * Faces are listed in increasing order for each vertex. Rebuilding it
+     * for the same mesh reuses the same memory in the model's arena. A
+     * model from the mesh cache has no vectors, so its mapped index buffer
+     * is used.
+     */
+    void buildAdjacency(Model &model) {
+        bool parsed = !model.faceVertices.empty();
+        const GLuint *indices = parsed ? model.faceVertices.data() : model.indexData;
+        GLuint num_indices = parsed ? model.faceVertices.size() : model.numIndices;
+        GLuint num_vertices = parsed ? model.vertexCoords.size() / 3 : model.numVertices;
+
+        Arena::Array<GLuint> &faceOffsets = model.faceOffsets;
+        Arena::Array<GLuint> &memberFaces = model.memberFaces;
+
+        faceOffsets.assign(model.arena, num_vertices + 1, 0);
+        memberFaces.resize(model.arena, num_indices);
+
+        /* Count the faces of each vertex, shifted by one for the prefix sum */
+        for (GLuint i = 0; i < num_indices; i++) {
+            faceOffsets[indices[i] + 1]++;
+        }
+
+        for (GLuint v = 0; v < num_vertices; v++) {
+            faceOffsets[v + 1] += faceOffsets[v];
+        }
+
+        /* Fill each vertex's range, using its start offset as the cursor;
+         * afterwards faceOffsets[v] holds the start of v + 1, so shift back */
+        for (GLuint i = 0; i < num_indices; i++) {
+            memberFaces[faceOffsets[indices[i]]++] = i / 3;
+        }
+
+        for (GLuint v = num_vertices; v > 0; v--) {
+            faceOffsets[v] = faceOffsets[v - 1];
+        }
+        faceOffsets[0] = 0;
     }
 
 
     /*
-     * Calculates the normal and area of each face, and builds a map of
-     * vertices to the faces containing them.
+     * Builds the current model's adjacency if it has none: a model loaded
+     * from the mesh cache only gets one once it is first queried.
      */
-    void processFaces() {
-        int numIndices = Display::faceVertices.size();
-        int numVertices = Display::vertexCoords.size() / 3;
+    static void requireAdjacency() {
+        if (current.faceOffsets.empty()) buildAdjacency(current);
+    }
 
-        /* Reserve space for every vertex in the map of vertices to faces */
-        memberFaces.resize(numVertices);
 
-        /* Loop through all faces */
-        for (int i = 0; i < numIndices; i += 3) {
-            int ind0 = Display::faceVertices[i];
-            int ind1 = Display::faceVertices[i + 1];
-            int ind2 = Display::faceVertices[i + 2];
+    /*
+     * Returns the number of faces of the current model containing the
+     * given vertex.
+     */
+    GLuint valence(GLuint vertex) {
+        requireAdjacency();
+        return current.faceOffsets[vertex + 1] - current.faceOffsets[vertex];
+    }
+
+
+    /*
+     * Returns the faces of the current model containing the given vertex,
+     * as the half-open range [facesBegin(vertex), facesEnd(vertex)).
+     */
+    const GLuint *facesBegin(GLuint vertex) {
+        requireAdjacency();
+        return current.memberFaces.data() + current.faceOffsets[vertex];
+    }
+
+    const GLuint *facesEnd(GLuint vertex) {
+        requireAdjacency();
+        return current.memberFaces.data() + current.faceOffsets[vertex + 1];
+    }
 
-            /* Add this face to the lists of faces for each member vertex */
-            memberFaces[ind0].push_back(i / 3);
-            memberFaces[ind1].push_back(i / 3);
-            memberFaces[ind2].push_back(i / 3);
 
-            /* Calculate the normal for this face */
-            glm::vec3 v0(Display::vertexCoords[ind0 * 3],
-                Display::vertexCoords[ind0 * 3 + 1],
-                Display::vertexCoords[ind0 * 3 + 2]);
+    /*
+     * Calculates the normal and area of each face, and builds a map of
+     * vertices to the faces containing them. Face normals are computed in
+     * SIMD batches on the worker pool by NormalGenerator. Vertex normals
+     * read from the file are kept.
+     */
+    void processFaces(Model &model) {
+        Profiler::Scope scope("normals", "load");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-            glm::vec3 v1(Display::vertexCoords[ind1 * 3],
-                Display::vertexCoords[ind1 * 3 + 1],
-                Display::vertexCoords[ind1 * 3 + 2]);
+        int numIndices = model.faceVertices.size();
+        int numVertices = model.vertexCoords.size() / 3;
 
-            glm::vec3 v2(Display::vertexCoords[ind2 * 3],
-                Display::vertexCoords[ind2 * 3 + 1],
-                Display::vertexCoords[ind2 * 3 + 2]);
+        /* Everything the arena will hold, in one block */
+        model.arena.reserve((numVertices + 1) * sizeof(GLuint)
+            + numIndices * (sizeof(GLuint) + sizeof(GLfloat)) + numIndices / 3 * sizeof(GLfloat));
 
-            glm::vec3 edge1(v1 - v0);
-            glm::vec3 edge2(v2 - v0);
+        /* Map every vertex to its faces; kept for later queries */
+        buildAdjacency(model);
 
-            glm::vec3 crossProd(glm::cross(edge1, edge2));
-            glm::vec3 normal(glm::normalize(crossProd));
+        /* Calculate the normal and area of every face */
+        model.faceNormals.resize(model.arena, numIndices);
+        model.faceAreas.resize(model.arena, numIndices / 3);
+        NormalGenerator::faceNormals(model.vertexCoords.data(), model.faceVertices.data(),
+            numIndices / 3, model.faceNormals.data(), model.faceAreas.data());
 
-            faceNormals.push_back(normal.x);
-            faceNormals.push_back(normal.y);
-            faceNormals.push_back(normal.z);
+        /* Once all face data has been processed, calculate vertex normals,
+         * unless the file gave every vertex one */
+        if (model.vertexNormals.size() != model.vertexCoords.size()) calculateVertexNormals(model);
 
-            /* Store the area of this face */
-            faceAreas.push_back(0.5f * glm::length(crossProd));
-        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds <= 0.0) seconds = 1e-9;
 
-        /* Once all face data has been processed, calculate vertex normals */
-        calculateVertexNormals();
+        printf("Calculated normals for %d faces in %.3f s (%.0f faces/sec)\n",
+            numIndices / 3, seconds, numIndices / 3 / seconds);
     }
 
 
     /* 
      * For each vertex, loops through member faces to calculate normal;
      * uses the average of adjacent face normals, weighted by face area,
-     * to implement smooth Gouraud shading.
+     * to implement smooth Gouraud shading. Each vertex gathers from its
+     * own faces, so vertices are processed in parallel.
      */
-    void calculateVertexNormals() {
-        int numVertices = Display::vertexCoords.size() / 3;
-
-        /* Loop through all vertices */
-        for (int i = 0; i < numVertices; i++) {
-            glm::vec3 vertNormal(0.0f, 0.0f, 0.0f);
+    void calculateVertexNormals(Model &model) {
+        int numVertices = model.vertexCoords.size() / 3;
 
-            /* Loop through member faces */
-            while (!memberFaces[i].empty()) {
-                GLuint faceIndex = memberFaces[i].front();
-                memberFaces[i].pop_front();
+        model.vertexNormals.resize(numVertices * 3);
+        NormalGenerator::vertexNormals(model.faceNormals.data(), model.faceAreas.data(),
+            model.faceOffsets.data(), model.memberFaces.data(), numVertices, model.vertexNormals.data());
+    }
 
-                glm::vec3 faceNormal(faceNormals[faceIndex * 3],
-                    faceNormals[faceIndex * 3 + 1],
-                    faceNormals[faceIndex * 3 + 2]);
 
-                vertNormal += faceAreas[faceIndex] * faceNormal;
+    /*
+     * Puts faces (and their normals and areas) in the given order, where
+     * face_order lists the original index of each face.
+     */
+    static void permuteFaces(Model &model, const std::vector<GLuint> &face_order) {
+        GLuint numFaces = face_order.size();
+
+        std::vector<GLuint> orderedVertices(numFaces * 3);
+        std::vector<GLfloat> orderedNormals(numFaces * 3);
+        std::vector<GLfloat> orderedAreas(numFaces);
+
+        for (GLuint i = 0; i < numFaces; i++) {
+            GLuint face = face_order[i];
+            for (int j = 0; j < 3; j++) {
+                orderedVertices[i * 3 + j] = model.faceVertices[face * 3 + j];
+                orderedNormals[i * 3 + j] = model.faceNormals[face * 3 + j];
             }
+            orderedAreas[i] = model.faceAreas[face];
+        }
+
+        /* Normals and areas are copied back, since the arena can't free */
+        model.faceVertices.swap(orderedVertices);
+        std::copy(orderedNormals.begin(), orderedNormals.end(), model.faceNormals.begin());
+        std::copy(orderedAreas.begin(), orderedAreas.end(), model.faceAreas.begin());
+    }
+
+
+    /*
+     * Splits the mesh into spatially compact clusters of faces for frustum
+     * culling (see MeshClusters), reordering faces so that each cluster is
+     * a contiguous range of the index buffer, and builds the BVH over them.
+     */
+    void clusterMesh(Model &model) {
+        Profiler::Scope scope("clusters", "load");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        GLuint numIndices = model.faceVertices.size();
+
+        std::vector<GLuint> faceOrder;
+        MeshClusters::partition(model.vertexCoords.data(), model.faceVertices.data(),
+            numIndices / 3, Constants::cluster_faces, faceOrder);
+
+        permuteFaces(model, faceOrder);
+        buildAdjacency(model);
+
+        MeshClusters::build(model.vertexCoords.data(), model.faceVertices.data(),
+            numIndices / 3, Constants::cluster_faces, model.clusters, model.nodes);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("Built %u clusters (%u BVH nodes) in %.3f s\n",
+            (GLuint)model.clusters.size(), (GLuint)model.nodes.size(), seconds);
+    }
+
+
+    /*
+     * Reorders faces for the post-transform vertex cache (Tipsify), then
+     * renumbers vertices in order of first use. Face data and the adjacency
+     * are permuted/rebuilt to match. Prints the ACMR and ATVR of a simulated
+     * FIFO cache before and after.
+     *
+     * If the mesh has been clustered, faces are only reordered within each
+     * cluster (in parallel), so the cluster ranges stay valid.
+     */
+    void optimizeMesh(Model &model) {
+        Profiler::Scope scope("optimize", "load");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::vector<GLuint> &faceVertices = model.faceVertices;
+        GLuint numIndices = faceVertices.size();
+        GLuint numFaces = numIndices / 3;
+        GLuint numVertices = model.vertexCoords.size() / 3;
+        GLuint cacheSize = Constants::vertex_cache_size;
+
+        GLfloat acmrBefore, atvrBefore, acmrAfter, atvrAfter;
+        MeshOptimizer::simulateFifo(faceVertices.data(), numIndices, numVertices,
+            cacheSize, acmrBefore, atvrBefore);
+
+        /* Draw faces in cache-friendly order */
+        std::vector<GLuint> faceOrder;
+
+        if (model.clusters.empty()) {
+            MeshOptimizer::tipsify(faceVertices.data(), numFaces, numVertices,
+                model.faceOffsets.data(), model.memberFaces.data(), cacheSize, faceOrder);
+        } else {
+            faceOrder.resize(numFaces);
+
+            WorkerPool::parallelFor(model.clusters.size(), 1, [&](size_t first, size_t last) {
+                std::vector<GLuint> localOrder;
 
-            vertNormal = glm::normalize(vertNormal);
+                for (size_t c = first; c < last; c++) {
+                    const MeshClusters::Cluster &cluster = model.clusters[c];
+                    GLuint firstFace = cluster.first_index / 3;
 
-            Display::vertexNormals.push_back(vertNormal.x);
-            Display::vertexNormals.push_back(vertNormal.y);
-            Display::vertexNormals.push_back(vertNormal.z);
+                    MeshOptimizer::tipsifyLocal(faceVertices.data() + cluster.first_index,
+                        cluster.num_indices / 3, cacheSize, localOrder);
+
+                    for (size_t i = 0; i < localOrder.size(); i++) {
+                        faceOrder[firstFace + i] = firstFace + localOrder[i];
+                    }
+                }
+            });
         }
+
+        permuteFaces(model, faceOrder);
+
+        /* Store vertices in the order they are first drawn */
+        std::vector<GLuint> remap;
+        MeshOptimizer::remapVertices(faceVertices, numVertices, remap);
+        MeshOptimizer::permuteAttribute(model.vertexCoords, 3, remap);
+        MeshOptimizer::permuteAttribute(model.vertexNormals, 3, remap);
+        if (!model.vertexTexCoords.empty()) MeshOptimizer::permuteAttribute(model.vertexTexCoords, 2, remap);
+
+        buildAdjacency(model);
+
+        MeshOptimizer::simulateFifo(faceVertices.data(), numIndices, numVertices,
+            cacheSize, acmrAfter, atvrAfter);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("Optimized mesh in %.3f s (FIFO %u): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+            seconds, cacheSize, acmrBefore, acmrAfter, atvrBefore, atvrAfter);
     }
 
 
@@ -221,14 +556,14 @@ namespace ObjectLoader {
      * Debugging utility.
      */
     void printMemberFaces() {
-        int numVertices = Display::vertexCoords.size() / 3;
+        requireAdjacency();
+        int numVertices = current.faceOffsets.empty() ? 0 : current.faceOffsets.size() - 1;
 
         for (int i = 0; i < numVertices; i++) {
             printf("Faces containing vertex %d: ", i);
-            printf("[%d] ", memberFaces[i].size());
-            while (!memberFaces[i].empty()) {
-                std::cout << ' ' << memberFaces[i].front();
-                memberFaces[i].pop_front();
+            printf("[%d] ", valence(i));
+            for (const GLuint *face = facesBegin(i); face != facesEnd(i); face++) {
+                std::cout << ' ' << *face;
             }
             printf("\n");
         }
@@ -3,21 +3,112 @@
 #ifndef OBJECTLOADER_H
 #define OBJECTLOADER_H
 
-#include <list>
+#include <atomic>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "Arena.hpp"
+#include "MappedFile.hpp"
+#include "MeshClusters.hpp"
+#include "MeshLod.hpp"
+#include "ObjParser.hpp"
+#include "VertexPacking.hpp"
 
 namespace ObjectLoader {
 
-    extern std::vector<GLfloat> faceNormals;
-    extern std::vector<GLfloat> faceAreas;
-    extern std::vector< std::list< GLuint > > memberFaces;
+    /* Everything loaded for one model. A model is built without touching
+     * the one being drawn, and only becomes current through installModel,
+     * which points the Display, MeshClusters and MeshLod arrays into it. */
+    struct Model {
+        char path[100] = "";
+
+        /* Owned arrays of a parsed model (empty if it came from a mesh cache) */
+        std::vector<GLfloat> vertexCoords;
+        std::vector<GLuint> faceVertices;
+        std::vector<GLfloat> vertexNormals;
+
+        /* Texture coordinates from the file, if every vertex has one; not
+         * drawn yet, nor kept in the mesh cache */
+        std::vector<GLfloat> vertexTexCoords;
+
+        /* "o"/"g"/"usemtl" runs of triangles, in file order (faces are
+         * reordered afterwards by clustering and optimization) */
+        std::vector<ObjParser::Group> groups;
+
+        /* Load-time data below lives in one arena, sized once the model is
+         * parsed and freed all at once with the model */
+        Arena::Monotonic arena;
+
+        /* used to calculate vertex normals for Gouraud shading */
+        Arena::Array<GLfloat> faceNormals;
+        Arena::Array<GLfloat> faceAreas;
+
+        /* Maps vertices to all faces they belong to, in compressed sparse row form:
+         * the faces of vertex v are memberFaces[faceOffsets[v] .. faceOffsets[v + 1]);
+         * empty for a cached model until queried through valence/facesBegin */
+        Arena::Array<GLuint> faceOffsets;
+        Arena::Array<GLuint> memberFaces;
+
+        std::vector<MeshClusters::Cluster> clusters;
+        std::vector<MeshClusters::Node> nodes;
+
+        std::vector<GLuint> lodIndices;
+        std::vector<MeshLod::Level> lodLevels;
+        std::vector<MeshClusters::Cluster> lodClusters;
+
+        /* GPU vertex format, filled by ShaderLoader::prepareVertices; only
+         * kept until the model is uploaded */
+        std::vector<VertexPacking::PackedVertex> packedVertices;
+        GLfloat packMin[3] = { 0.0f, 0.0f, 0.0f };
+        GLfloat packExtent[3] = { 1.0f, 1.0f, 1.0f };
+
+        /* Mesh cache the arrays below point into, if cached is set */
+        MappedFile::File cache = MappedFile::File();
+        bool cached = false;
+
+        ObjParser::Bounds bounds = ObjParser::Bounds();
+        GLfloat max_xy = 0.0f;
+
+        /* Arrays to draw; point into the vectors above, or into the cache */
+        const GLfloat *vertexData = NULL;
+        const GLfloat *normalData = NULL;
+        const GLuint *indexData = NULL;
+        GLuint numVertices = 0, numIndices = 0;
+
+        /* numVertices packed vertices to upload, or NULL if not prepared */
+        const VertexPacking::PackedVertex *packedData = NULL;
+
+        const MeshClusters::Cluster *clusterData = NULL;
+        const MeshClusters::Node *nodeData = NULL;
+        GLuint numClusters = 0, numNodes = 0;
+
+        const GLuint *lodIndexData = NULL;
+        const MeshLod::Level *lodLevelData = NULL;
+        const MeshClusters::Cluster *lodClusterData = NULL;
+        GLuint numLodIndices = 0, numLodLevels = 0, numLodClusters = 0;
+    };
+
+    extern Model current;
     extern const bool debug;
 
     bool loadObject(char *filepath);
+    bool loadModel(const char *filepath, Model &model, std::atomic<unsigned> *progress);
+    void installModel(Model &model);
+    void releaseModel(Model &model);
+    void releasePacked(Model &model);
+    size_t hostBytes(const Model &model);
     void changeModel(char *filepath);
-    void processFaces();
-    void calculateVertexNormals();
+    void buildAdjacency(Model &model);
+    GLuint valence(GLuint vertex);
+    const GLuint *facesBegin(GLuint vertex);
+    const GLuint *facesEnd(GLuint vertex);
+    void processFaces(Model &model);
+    void calculateVertexNormals(Model &model);
+    void clusterMesh(Model &model);
+    void optimizeMesh(Model &model);
     void printMemberFaces();
 
 }
 
-#endif
\ No newline at end of file
+#endif
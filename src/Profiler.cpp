@@ -0,0 +1,372 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "Profiler.hpp"
+
+
+/*
+ * Stage timings. Scope times a block on the CPU, from any thread, and
+ * beginGpu/endGpu wrap a window's draw calls in GL_TIME_ELAPSED queries
+ * where timer queries are supported. Every timing is kept as a trace
+ * event, for writeTrace (Chrome's trace event format, viewable in
+ * chrome://tracing or Perfetto), and folded into a per-stage running
+ * average, for drawOverlay.
+ */
+namespace Profiler {
+
+    const bool DEBUG(false);
+
+    /* One timed stage, in microseconds since startup */
+    struct Event {
+        const char *name, *category;
+        double start, duration;
+        unsigned thread;
+    };
+
+    /* Latest and averaged time of one stage, for the overlay */
+    struct Stage {
+        const char *name, *category;
+        double last, average;
+    };
+
+    /* Named trace thread */
+    struct Thread {
+        unsigned id;
+        const char *name;
+    };
+
+    /* GL_TIME_ELAPSED queries of one window, read back a few redraws later
+     * so the CPU never waits on the GPU */
+    static const unsigned GPU_QUERIES = 4;
+
+    struct GpuTimer {
+        GLuint queries[GPU_QUERIES];
+        double issued[GPU_QUERIES];
+        unsigned first, pending;
+        bool created, running;
+    };
+
+    /* GPU timings go on their own trace rows, after the CPU threads */
+    static const unsigned GPU_THREAD = 1000;
+    static const char *view_categories[NUM_VIEWS] = { "fixed", "shaders" };
+    static const char *gpu_threads[NUM_VIEWS] = { "GPU (fixed)", "GPU (shaders)" };
+
+    /* Weight of the newest timing in a stage's average */
+    static const double AVERAGE_WEIGHT = 0.1;
+
+    bool show_overlay = false;
+
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    /* Never destroyed at exit, since other threads may still record and
+     * the trace is written from an atexit handler */
+    static std::mutex &profile_mutex = *new std::mutex();
+    static std::vector<Event> &events = *new std::vector<Event>();
+    static std::vector<Stage> &stages = *new std::vector<Stage>();
+    static std::vector<Thread> &threads = *new std::vector<Thread>();
+    static size_t dropped_events = 0;
+
+    static std::atomic<unsigned> next_thread(1);
+    static thread_local unsigned thread_id = 0;
+
+    static GpuTimer gpu_timers[NUM_VIEWS];
+
+    static char trace_path[260] = "";
+
+
+    /*
+     * Returns the calling thread's trace id, assigning one on first use.
+     */
+    static unsigned currentThread() {
+        if (thread_id == 0) thread_id = next_thread++;
+        return thread_id;
+    }
+
+
+    /*
+     * Returns the time since startup, in microseconds.
+     */
+    double now() {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+
+    /*
+     * Folds one timing into its stage's average. profile_mutex must be held.
+     */
+    static void updateStage(const char *name, const char *category, double duration) {
+        for (size_t i = 0; i < stages.size(); i++) {
+            Stage &stage = stages[i];
+            if (strcmp(stage.name, name) || strcmp(stage.category, category)) continue;
+
+            stage.last = duration;
+            stage.average += (duration - stage.average) * AVERAGE_WEIGHT;
+            return;
+        }
+
+        Stage stage = { name, category, duration, duration };
+        stages.push_back(stage);
+    }
+
+
+    /*
+     * Adds an event for name on the trace row of thread, and updates the
+     * stage's average. Events past Constants::trace_max_events are dropped.
+     */
+    static void addEvent(const char *name, const char *category, double start, double duration,
+        unsigned thread) {
+
+        std::lock_guard<std::mutex> lock(profile_mutex);
+
+        if (events.size() < Constants::trace_max_events) {
+            Event event = { name, category, start, duration, thread };
+            events.push_back(event);
+        } else {
+            dropped_events++;
+        }
+
+        updateStage(name, category, duration);
+
+        if (DEBUG) printf("%s/%s: %.3f ms\n", category, name, duration / 1000.0);
+    }
+
+
+    /*
+     * Records a stage timed by the caller, on the calling thread's row.
+     */
+    void record(const char *name, const char *category, double start, double duration) {
+        if (!Constants::PROFILING) return;
+        addEvent(name, category, start, duration, currentThread());
+    }
+
+
+    /*
+     * Returns the running average of a stage, in microseconds, or 0 if it
+     * hasn't been timed.
+     */
+    double average(const char *name, const char *category) {
+        std::lock_guard<std::mutex> lock(profile_mutex);
+
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (!strcmp(stages[i].name, name) && !strcmp(stages[i].category, category)) return stages[i].average;
+        }
+        return 0.0;
+    }
+
+
+    Scope::Scope(const char *name, const char *category) :
+        name(name), category(category), start(Constants::PROFILING ? now() : 0.0) {
+    }
+
+
+    Scope::~Scope() {
+        if (Constants::PROFILING) record(name, category, start, now() - start);
+    }
+
+
+    static void nameThreadId(unsigned id, const char *name) {
+        Thread thread = { id, name };
+
+        std::lock_guard<std::mutex> lock(profile_mutex);
+        threads.push_back(thread);
+    }
+
+
+    /*
+     * Labels the calling thread's row in the trace.
+     */
+    void nameThread(const char *name) {
+        if (Constants::PROFILING) nameThreadId(currentThread(), name);
+    }
+
+
+    /*
+     * Returns whether GL_TIME_ELAPSED queries can be used.
+     */
+    static bool timerQueries() {
+        return Constants::PROFILING && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+    }
+
+
+    /*
+     * Records the GPU time of every finished query of view, oldest first.
+     * Must be called with the view's window current.
+     */
+    static void collectGpu(View view) {
+        GpuTimer &timer = gpu_timers[view];
+
+        while (timer.pending > 0) {
+            GLuint query = timer.queries[timer.first];
+
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) break;
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+
+            /* Placed at the CPU time the draw calls were issued; the GPU
+             * clock isn't synchronized with it */
+            addEvent("gpu", view_categories[view], timer.issued[timer.first], nanoseconds / 1000.0,
+                GPU_THREAD + view);
+
+            timer.first = (timer.first + 1) % GPU_QUERIES;
+            timer.pending--;
+        }
+    }
+
+
+    /*
+     * Starts timing view's draw calls on the GPU, if timer queries are
+     * supported and a query is free. Must be called with the view's window
+     * current.
+     */
+    void beginGpu(View view) {
+        GpuTimer &timer = gpu_timers[view];
+        timer.running = false;
+
+        if (!timerQueries()) return;
+
+        if (!timer.created) {
+            glGenQueries(GPU_QUERIES, timer.queries);
+            timer.created = true;
+
+            nameThreadId(GPU_THREAD + view, gpu_threads[view]);
+        }
+
+        collectGpu(view);
+        if (timer.pending == GPU_QUERIES) return;
+
+        unsigned slot = (timer.first + timer.pending) % GPU_QUERIES;
+        timer.issued[slot] = now();
+        glBeginQuery(GL_TIME_ELAPSED, timer.queries[slot]);
+        timer.running = true;
+    }
+
+
+    /*
+     * Ends the query started by beginGpu. Its result is read by a later
+     * beginGpu, once the GPU has finished.
+     */
+    void endGpu(View view) {
+        GpuTimer &timer = gpu_timers[view];
+        if (!timer.running) return;
+
+        glEndQuery(GL_TIME_ELAPSED);
+        timer.pending++;
+        timer.running = false;
+    }
+
+
+    /*
+     * Draws the latest and average time of the stages shown in view (its
+     * own, loading and uploading) as text over the top left corner of the
+     * current window, height pixels high. Leaves GL state as it was, apart
+     * from the bound program.
+     */
+    void drawOverlay(View view, int height) {
+        if (!Constants::PROFILING || !show_overlay) return;
+
+        std::vector<Stage> shown;
+        {
+            std::lock_guard<std::mutex> lock(profile_mutex);
+            for (size_t i = 0; i < stages.size(); i++) {
+                const char *category = stages[i].category;
+                if (!strcmp(category, view_categories[view]) || !strcmp(category, "load") ||
+                    !strcmp(category, "upload")) {
+                    shown.push_back(stages[i]);
+                }
+            }
+        }
+
+        glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_POLYGON_BIT);
+        glUseProgram(0);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glColor3f(1.0f, 1.0f, 0.0f);
+
+        int y = height - 16;
+        for (size_t i = 0; i < shown.size(); i++, y -= 15) {
+            char line[96];
+            snprintf(line, sizeof(line), "%-8s %-12s %8.2f ms  (avg %8.2f ms)",
+                shown[i].category, shown[i].name, shown[i].last / 1000.0, shown[i].average / 1000.0);
+
+            glWindowPos2i(8, y);
+            glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char *)line);
+        }
+
+        glPopAttrib();
+    }
+
+
+    /*
+     * Writes every recorded event to path in Chrome's trace event format.
+     *
+     * Returns true if the file was written; false otherwise.
+     */
+    bool writeTrace(const char *path) {
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+            printf("Can't write \"%s\"\n", path);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(profile_mutex);
+
+        fprintf(fp, "{\"traceEvents\":[\n");
+
+        for (size_t i = 0; i < threads.size(); i++) {
+            fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s\"}},\n", threads[i].id, threads[i].name);
+        }
+
+        for (size_t i = 0; i < events.size(); i++) {
+            const Event &event = events[i];
+            fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":1,\"tid\":%u},\n",
+                event.name, event.category, event.start, event.duration, event.thread);
+        }
+
+        /* Closes the array without a trailing comma */
+        fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ModelViewer\"}}\n");
+        fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+
+        bool ok = (fclose(fp) == 0);
+        if (ok) {
+            printf("Wrote %u trace events to \"%s\"", (unsigned)events.size(), path);
+            if (dropped_events > 0) printf(" (%u dropped)", (unsigned)dropped_events);
+            printf("\n");
+        } else {
+            printf("Can't write \"%s\"\n", path);
+        }
+
+        return ok;
+    }
+
+
+    static void writeTraceAtExit() {
+        writeTrace(trace_path);
+    }
+
+
+    /*
+     * Writes the trace to path when the program exits.
+     */
+    void traceOnExit(const char *path) {
+        if (trace_path[0] == '\0') atexit(writeTraceAtExit);
+        strncpy(trace_path, path, sizeof(trace_path) - 1);
+    }
+
+}
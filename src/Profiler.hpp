@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "GL/freeglut.h"
+
+namespace Profiler {
+
+    /* Views with their own GPU timer and overlay */
+    enum View { FIXED_VIEW, SHADERS_VIEW, NUM_VIEWS };
+
+    /* Times the enclosing block on the CPU; name and category must be
+     * string literals, since only the pointers are kept */
+    class Scope {
+    public:
+        Scope(const char *name, const char *category);
+        ~Scope();
+
+    private:
+        const char *name, *category;
+        double start;
+    };
+
+    extern bool show_overlay;
+
+    double now();
+    void record(const char *name, const char *category, double start, double duration);
+    double average(const char *name, const char *category);
+    void nameThread(const char *name);
+    void beginGpu(View view);
+    void endGpu(View view);
+    void drawOverlay(View view, int height);
+    bool writeTrace(const char *path);
+    void traceOnExit(const char *path);
+
+}
+
+#endif
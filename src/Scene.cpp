@@ -0,0 +1,439 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include "Camera.hpp"
+#include "Constants.hpp"
+#include "Display.hpp"
+#include "MeshClusters.hpp"
+#include "MeshLod.hpp"
+#include "MeshPool.hpp"
+#include "ObjectLoader.hpp"
+#include "Scene.hpp"
+#include "ShaderLoader.hpp"
+
+
+/*
+ * Instances of resident models, each placed by its own model matrix.
+ *
+ * Instances of the same model form a group. In the shader window, each
+ * group's visible instances are written to one per-instance transform
+ * buffer (vertex attributes 2-5, a mat4 advanced once per instance) and
+ * drawn with glDrawElementsInstanced: one draw per level of detail in use,
+ * however many instances there are. Instances are culled against the
+ * frustum by their bounding spheres and given a level of detail each.
+ *
+ * The default scene is a single, untransformed instance of the current
+ * model, which Display draws as before (with cluster culling). The I key
+ * cycles through grids of copies of the current model instead.
+ */
+namespace Scene {
+
+    const bool DEBUG(false);
+
+    /* First of the four attribute locations of the instance matrix */
+    #define INSTANCE_ATTRIB 2
+
+    std::vector<Group> groups;
+    GLuint instanceVBO = 0;
+
+    /* Index into Constants::instance_grid_sizes */
+    int layout = 0;
+
+    static const GLfloat IDENTITY[16] = {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+
+    /* Whether instanceVBO starts with the identity (it is overwritten by
+     * drawShaders) */
+    static bool identity_loaded = false;
+
+    /* Visible instances of the group being drawn, per level of detail, and
+     * the same instances contiguously; reused every frame */
+    static std::vector< std::vector<const Instance *> > buckets;
+    static std::vector<Instance> staged;
+
+
+    /*
+     * Returns the CPU data of the model at path (the current model or a
+     * resident one), or NULL if it isn't loaded.
+     */
+    static const ObjectLoader::Model *modelFor(const char *path) {
+        if (!strcmp(path, ObjectLoader::current.path)) return &ObjectLoader::current;
+
+        MeshPool::Entry *entry = MeshPool::find(path);
+        return entry != NULL ? &entry->model : NULL;
+    }
+
+
+    /*
+     * Returns the instance buffer, creating it on first use.
+     */
+    static GLuint instanceBuffer() {
+        if (instanceVBO == 0) {
+            glGenBuffers(1, &instanceVBO);
+            identity_loaded = false;
+        }
+        return instanceVBO;
+    }
+
+
+    /*
+     * Removes all instances.
+     */
+    void clear() {
+        groups.clear();
+    }
+
+
+    /*
+     * Adds an instance of the model at path, placed by the given column-major
+     * matrix. The model must be current or resident in MeshPool to be drawn.
+     */
+    void addInstance(const char *path, const GLfloat *matrix) {
+        Group *group = NULL;
+
+        for (size_t g = 0; g < groups.size(); g++) {
+            if (!strcmp(groups[g].path, path)) group = &groups[g];
+        }
+
+        if (group == NULL) {
+            groups.push_back(Group());
+            group = &groups.back();
+            strncpy(group->path, path, sizeof(group->path) - 1);
+            group->path[sizeof(group->path) - 1] = '\0';
+        }
+
+        Instance instance;
+        memcpy(instance.matrix, matrix, sizeof(instance.matrix));
+        group->instances.push_back(instance);
+    }
+
+
+    /*
+     * Replaces the scene with size x size copies of the model at path, laid
+     * out in the x-y plane around the model's own position, spaced
+     * Constants::instance_spacing model widths apart.
+     */
+    void layoutGrid(const char *path, int size) {
+        clear();
+
+        const ObjectLoader::Model *model = modelFor(path);
+        if (model == NULL || size < 1) return;
+
+        GLfloat width = std::max(model->bounds.maxx - model->bounds.minx,
+            model->bounds.maxy - model->bounds.miny);
+        GLfloat spacing = Constants::instance_spacing * (width > 0.0f ? width : 1.0f);
+
+        GLfloat matrix[16];
+        memcpy(matrix, IDENTITY, sizeof(matrix));
+
+        for (int row = 0; row < size; row++) {
+            for (int col = 0; col < size; col++) {
+                matrix[12] = (col - (size - 1) / 2.0f) * spacing;
+                matrix[13] = (row - (size - 1) / 2.0f) * spacing;
+                addInstance(path, matrix);
+            }
+        }
+
+        if (DEBUG) printf("Scene: %d x %d grid of \"%s\"\n", size, size, path);
+    }
+
+
+    /*
+     * Switches to the next grid size in Constants::instance_grid_sizes.
+     */
+    void cycleLayout() {
+        layout = (layout + 1) % Constants::instance_layouts;
+        modelChanged();
+    }
+
+
+    /*
+     * Lays the current layout out again for the current model, and frames
+     * it. Called by ObjectLoader whenever a model is installed.
+     */
+    void modelChanged() {
+        layoutGrid(ObjectLoader::current.path, Constants::instance_grid_sizes[layout]);
+        updateBounds();
+    }
+
+
+    /*
+     * Sets the Display bounds (which frame the camera and the frustum) to
+     * those of the whole scene. A single untransformed model keeps its own.
+     */
+    void updateBounds() {
+        if (isSingle()) {
+            const ObjParser::Bounds &bounds = ObjectLoader::current.bounds;
+            Display::maxx = bounds.maxx; Display::maxy = bounds.maxy; Display::maxz = bounds.maxz;
+            Display::minx = bounds.minx; Display::miny = bounds.miny; Display::minz = bounds.minz;
+            Display::max_xy = ObjectLoader::current.max_xy;
+            return;
+        }
+
+        glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+
+        for (size_t g = 0; g < groups.size(); g++) {
+            const ObjectLoader::Model *model = modelFor(groups[g].path);
+            if (model == NULL) continue;
+
+            const ObjParser::Bounds &b = model->bounds;
+
+            for (size_t i = 0; i < groups[g].instances.size(); i++) {
+                glm::mat4 matrix = glm::make_mat4(groups[g].instances[i].matrix);
+
+                for (int corner = 0; corner < 8; corner++) {
+                    glm::vec4 p(corner & 1 ? b.maxx : b.minx,
+                        corner & 2 ? b.maxy : b.miny,
+                        corner & 4 ? b.maxz : b.minz, 1.0f);
+                    glm::vec3 world(matrix * p);
+                    min = glm::min(min, world);
+                    max = glm::max(max, world);
+                }
+            }
+        }
+
+        /* Nothing loaded yet */
+        if (min.x > max.x) return;
+
+        Display::minx = min.x; Display::miny = min.y; Display::minz = min.z;
+        Display::maxx = max.x; Display::maxy = max.y; Display::maxz = max.z;
+        Display::max_xy = std::max(max.x - min.x, max.y - min.y);
+    }
+
+
+    /*
+     * Returns true if the scene has instances of the model at path, which
+     * must then stay resident.
+     */
+    bool uses(const char *path) {
+        for (size_t g = 0; g < groups.size(); g++) {
+            if (!strcmp(groups[g].path, path)) return !groups[g].instances.empty();
+        }
+        return false;
+    }
+
+
+    /*
+     * Returns true if the scene is just the current model, untransformed.
+     */
+    bool isSingle() {
+        return groups.size() == 1 && groups[0].instances.size() == 1
+            && !strcmp(groups[0].path, ObjectLoader::current.path)
+            && !memcmp(groups[0].instances[0].matrix, IDENTITY, sizeof(IDENTITY));
+    }
+
+
+    /*
+     * Returns the number of instances in the scene.
+     */
+    GLuint instanceCount() {
+        GLuint count = 0;
+        for (size_t g = 0; g < groups.size(); g++) count += groups[g].instances.size();
+        return count;
+    }
+
+
+    /*
+     * Points the instance matrix attributes of the bound VAO at the instance
+     * buffer, starting from instance first.
+     */
+    void bindInstances(GLuint first) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer());
+
+        for (GLuint c = 0; c < 4; c++) {
+            glEnableVertexAttribArray(INSTANCE_ATTRIB + c);
+            glVertexAttribPointer(INSTANCE_ATTRIB + c, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                (GLvoid*)((first * 16 + c * 4) * sizeof(GLfloat)));
+            glVertexAttribDivisor(INSTANCE_ATTRIB + c, 1);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+
+    /*
+     * Makes the bound VAO's non-instanced draws use the identity matrix,
+     * reloading it if drawShaders has overwritten the instance buffer.
+     */
+    void useIdentity() {
+        if (!identity_loaded) {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer());
+            glBufferData(GL_ARRAY_BUFFER, sizeof(IDENTITY), IDENTITY, GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            identity_loaded = true;
+        }
+
+        bindInstances(0);
+    }
+
+
+    /*
+     * Culls a group's instances against the frustum planes (in world space)
+     * by their bounding spheres, and sorts the visible ones into buckets by
+     * level of detail.
+     */
+    static void bucketInstances(const Group &group, const ObjectLoader::Model &model,
+        const GLfloat planes[6][4], Stats &stats) {
+
+        buckets.resize(std::max<size_t>(buckets.size(), model.numLodLevels + 1));
+        for (size_t l = 0; l < buckets.size(); l++) buckets[l].clear();
+
+        const ObjParser::Bounds &b = model.bounds;
+        glm::vec4 center((b.minx + b.maxx) / 2, (b.miny + b.maxy) / 2, (b.minz + b.maxz) / 2, 1.0f);
+        GLfloat radius = glm::length(glm::vec3(b.maxx - b.minx, b.maxy - b.miny, b.maxz - b.minz)) / 2;
+
+        for (size_t i = 0; i < group.instances.size(); i++) {
+            const Instance &instance = group.instances[i];
+            const GLfloat *m = instance.matrix;
+            stats.instances_total++;
+
+            glm::vec3 c(glm::make_mat4(m) * center);
+            GLfloat scale = std::max(glm::length(glm::make_vec3(m)),
+                std::max(glm::length(glm::make_vec3(m + 4)), glm::length(glm::make_vec3(m + 8))));
+            GLfloat r = radius * scale;
+
+            bool visible = true;
+            for (int p = 0; p < 6 && visible; p++) {
+                const GLfloat *plane = planes[p];
+                if (plane[0] * c.x + plane[1] * c.y + plane[2] * c.z + plane[3]
+                    < -r * glm::length(glm::make_vec3(plane))) visible = false;
+            }
+
+            if (!visible) {
+                stats.instances_culled++;
+                continue;
+            }
+
+            GLuint level = MeshLod::levelFor(model.max_xy * scale, glm::length(Camera::camera - c),
+                model.lodLevelData, model.numLodLevels);
+            buckets[level].push_back(&instance);
+        }
+    }
+
+
+    /*
+     * Returns the index range of a model's level of detail, as a byte offset
+     * into its element buffer.
+     */
+    static const GLvoid *levelIndices(const ObjectLoader::Model &model, GLuint level, GLuint &count) {
+        if (level == 0) {
+            count = model.numIndices;
+            return NULL;
+        }
+
+        const MeshLod::Level &lod = model.lodLevelData[level - 1];
+        count = lod.num_indices;
+
+        /* Simplified levels follow the full mesh in the element buffer */
+        return (const GLvoid *)((model.numIndices + lod.first_index) * sizeof(GLuint));
+    }
+
+
+    /*
+     * Draws every group with instanced draws, one per level of detail in use,
+     * with the shader program in use. stats receives the instance counts
+     * and the number of draws. Leaves ShaderLoader on the current model.
+     */
+    void drawShaders(const GLfloat *projection, const GLfloat *modelview, Stats &stats) {
+        memset(&stats, 0, sizeof(stats));
+
+        GLfloat planes[6][4];
+        MeshClusters::extractPlanes(projection, modelview, planes);
+
+        for (size_t g = 0; g < groups.size(); g++) {
+            const ObjectLoader::Model *model = modelFor(groups[g].path);
+            MeshPool::Entry *entry = MeshPool::find(groups[g].path);
+            if (model == NULL || entry == NULL) continue;
+
+            bucketInstances(groups[g], *model, planes, stats);
+
+            staged.clear();
+            for (GLuint l = 0; l <= model->numLodLevels; l++) {
+                for (size_t i = 0; i < buckets[l].size(); i++) staged.push_back(*buckets[l][i]);
+            }
+            if (staged.empty()) continue;
+
+            /* Orphaned and refilled each frame */
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer());
+            glBufferData(GL_ARRAY_BUFFER, staged.size() * sizeof(Instance), staged.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            identity_loaded = false;
+
+            ShaderLoader::useMesh(entry->mesh);
+            ShaderLoader::uploadUniforms();
+            glBindVertexArray(entry->mesh.VAO);
+
+            GLuint first = 0;
+            for (GLuint l = 0; l <= model->numLodLevels; l++) {
+                if (buckets[l].empty()) continue;
+
+                GLuint count;
+                const GLvoid *indices = levelIndices(*model, l, count);
+
+                bindInstances(first);
+                glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices, buckets[l].size());
+
+                stats.draw_calls++;
+                first += buckets[l].size();
+            }
+        }
+
+        MeshPool::Entry *current = MeshPool::find(ObjectLoader::current.path);
+        if (current != NULL) ShaderLoader::useMesh(current->mesh);
+        glBindVertexArray(ShaderLoader::VAO);
+    }
+
+
+    /*
+     * Draws every instance in the fixed pipeline window, from the same
+     * buffers as drawShaders, one glDrawElements per instance under its own
+     * modelview matrix. Leaves the last group's buffers bound (see
+     * Display::unbindFixedMesh).
+     */
+    void drawFixed(GLenum mode, const GLfloat *projection, const GLfloat *modelview, Stats &stats) {
+        memset(&stats, 0, sizeof(stats));
+
+        GLfloat planes[6][4];
+        MeshClusters::extractPlanes(projection, modelview, planes);
+
+        for (size_t g = 0; g < groups.size(); g++) {
+            const ObjectLoader::Model *model = modelFor(groups[g].path);
+            MeshPool::Entry *entry = MeshPool::find(groups[g].path);
+            if (model == NULL || entry == NULL) continue;
+
+            bucketInstances(groups[g], *model, planes, stats);
+            Display::bindFixedMesh(entry->mesh);
+
+            for (GLuint l = 0; l <= model->numLodLevels; l++) {
+                GLuint count;
+                const GLvoid *indices = levelIndices(*model, l, count);
+
+                for (size_t i = 0; i < buckets[l].size(); i++) {
+                    glPushMatrix();
+                    glMultMatrixf(buckets[l][i]->matrix);
+                    Display::pushDequantize(entry->mesh);
+                    glDrawElements(mode, count, GL_UNSIGNED_INT, indices);
+                    Display::popDequantize(entry->mesh);
+                    glPopMatrix();
+
+                    stats.draw_calls++;
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+namespace Scene {
+
+    /* One placed copy of a model; column-major model matrix */
+    struct Instance {
+        GLfloat matrix[16];
+    };
+
+    /* All instances of one model, drawn together */
+    struct Group {
+        char path[100];
+        std::vector<Instance> instances;
+    };
+
+    /* Result of drawing the scene once */
+    struct Stats {
+        GLuint instances_culled, instances_total;
+        GLuint draw_calls;
+    };
+
+    extern std::vector<Group> groups;
+    extern GLuint instanceVBO;
+    extern int layout;
+
+    void clear();
+    void addInstance(const char *path, const GLfloat *matrix);
+    void layoutGrid(const char *path, int size);
+    void cycleLayout();
+    void modelChanged();
+    void updateBounds();
+    bool uses(const char *path);
+    bool isSingle();
+    GLuint instanceCount();
+    void bindInstances(GLuint first);
+    void useIdentity();
+    void drawShaders(const GLfloat *projection, const GLfloat *modelview, Stats &stats);
+    void drawFixed(GLenum mode, const GLfloat *projection, const GLfloat *modelview, Stats &stats);
+
+}
+
+#endif
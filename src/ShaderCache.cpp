@@ -0,0 +1,199 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "GL/glew.h"
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "MeshCache.hpp"
+#include "Profiler.hpp"
+#include "ShaderCache.hpp"
+
+
+/*
+ * Cache of linked shader programs (.mvs files in Constants::shader_cache_dir),
+ * saved with glGetProgramBinary and restored with glProgramBinary, so a warm
+ * start skips compiling and linking. Files are named by a key hashed from
+ * the shader sources and the driver's vendor, renderer and version strings;
+ * a driver update or an edited shader simply misses, and a binary the driver
+ * rejects anyway is rebuilt from source and overwritten.
+ */
+namespace ShaderCache {
+
+    const bool DEBUG(false);
+
+    const uint32_t VERSION = 1;
+
+
+    /*
+     * Returns true if program binaries can be saved and restored.
+     */
+    bool available() {
+        static int formats = -1;
+
+        if (!Constants::SHADER_BINARY_CACHE) return false;
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+
+        if (formats < 0) {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+            formats = count;
+        }
+        return formats > 0;
+    }
+
+
+    /*
+     * Returns the cache key of a program built from the given sources with
+     * the current driver.
+     */
+    uint64_t programKey(const std::string &vertex_source, const std::string &fragment_source) {
+        const GLenum names[4] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+
+        std::string identity;
+        for (int i = 0; i < 4; i++) {
+            const GLubyte *name = glGetString(names[i]);
+            if (name != NULL) identity += (const char *)name;
+            identity += '\n';
+        }
+
+        /* Each source ends with a NUL, so moving text from one to the other changes the key */
+        identity.append(vertex_source.c_str(), vertex_source.size() + 1);
+        identity.append(fragment_source.c_str(), fragment_source.size() + 1);
+
+        return MeshCache::hashBytes(identity.data(), identity.size());
+    }
+
+
+    static std::string cachePath(uint64_t key) {
+        char name[32];
+        sprintf(name, "/%016llx.mvs", (unsigned long long)key);
+        return std::string(Constants::shader_cache_dir) + name;
+    }
+
+
+    /*
+     * Asks the driver to keep program's binary retrievable; call before
+     * linking a program that will be stored.
+     */
+    void prepare(GLuint program) {
+        if (available()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+
+    /*
+     * Restores program from the cached binary for key, if there is one and
+     * the driver accepts it.
+     *
+     * Returns true if program is linked and ready; false if it must be built.
+     */
+    bool load(uint64_t key, GLuint program) {
+        if (!available()) return false;
+
+        Profiler::Scope scope("shader cache read", "load");
+
+        std::string path = cachePath(key);
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (fp == NULL) return false;
+
+        Header header;
+        std::vector<char> binary;
+
+        bool ok = fread(&header, sizeof(header), 1, fp) == 1
+            && memcmp(header.magic, "MVS1", 4) == 0
+            && header.version == VERSION
+            && header.key == key
+            && header.size > 0;
+
+        if (ok) {
+            binary.resize(header.size);
+            ok = fread(binary.data(), 1, binary.size(), fp) == binary.size();
+        }
+        fclose(fp);
+
+        if (!ok) {
+            if (DEBUG) printf("Invalid shader cache \"%s\"\n", path.c_str());
+            return false;
+        }
+
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (DEBUG) printf("Shader cache \"%s\" %s\n", path.c_str(), linked ? "loaded" : "rejected by the driver");
+
+        return linked != 0;
+    }
+
+
+    /*
+     * Saves a linked program's binary as the cache for key. The file is
+     * written under a temporary name and renamed, so a partially written
+     * cache is never picked up.
+     *
+     * Returns true if the cache was written; false otherwise.
+     */
+    bool store(uint64_t key, GLuint program) {
+        if (!available()) return false;
+
+        Profiler::Scope scope("shader cache write", "load");
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return false;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "MVS1", 4);
+        header.version = VERSION;
+        header.key = key;
+        header.format = format;
+        header.size = (uint32_t)length;
+
+    #ifdef _WIN32
+        _mkdir(Constants::shader_cache_dir);
+    #else
+        mkdir(Constants::shader_cache_dir, 0755);
+    #endif
+
+        std::string path = cachePath(key);
+        std::string temp_path = path + ".tmp";
+
+        FILE *fp = fopen(temp_path.c_str(), "wb");
+        if (fp == NULL) {
+            printf("Can't write shader cache \"%s\"\n", path.c_str());
+            return false;
+        }
+
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        ok = ok && fwrite(binary.data(), 1, header.size, fp) == header.size;
+        ok = (fclose(fp) == 0) && ok;
+
+        if (ok) {
+            remove(path.c_str());
+            ok = rename(temp_path.c_str(), path.c_str()) == 0;
+        }
+
+        if (!ok) {
+            remove(temp_path.c_str());
+            printf("Can't write shader cache \"%s\"\n", path.c_str());
+        }
+
+        return ok;
+    }
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "GL/freeglut.h"
+
+namespace ShaderCache {
+
+    /* On-disk layout of a .mvs file: the header, then the program binary */
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t size;
+    };
+
+    extern const uint32_t VERSION;
+
+    bool available();
+    uint64_t programKey(const std::string &vertex_source, const std::string &fragment_source);
+    void prepare(GLuint program);
+    bool load(uint64_t key, GLuint program);
+    bool store(uint64_t key, GLuint program);
+
+}
+
+#endif
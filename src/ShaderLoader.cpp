@@ -6,17 +6,97 @@
 #include <string>
 #include <fstream> 
 #include <sstream>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
 
 #include "Camera.hpp"
 #include "Constants.hpp"
 #include "Display.hpp"
+#include "MeshPool.hpp"
+#include "ObjectLoader.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
+#include "ShaderCache.hpp"
+#include "ShaderLoader.hpp"
+#include "ShaderWatcher.hpp"
+#include "VertexPacking.hpp"
 
 
 namespace ShaderLoader {
 
-    GLuint vsID, fsID, pID, pVBO, nVBO, VAO, EBO;
+    GLuint pID, pVBO, nVBO, VAO, EBO;
     GLfloat projectionMat[16], modelViewMat[16];
 
+    /* Maps vertex positions from the VBO into model space (identity for float vertices) */
+    GLfloat positionOffset[3] = { 0.0f, 0.0f, 0.0f };
+    GLfloat positionScale[3] = { 1.0f, 1.0f, 1.0f };
+
+    /* Per-frame matrices and lighting, shared by both shaders through one UBO */
+    GLuint frameUBO = 0;
+    static FrameBlock uploadedFrame;
+
+    static bool frame_uploaded = false;
+
+    /* Loose uniform locations of one program variant, resolved once per
+     * link, and the values last uploaded to it */
+    struct Uniforms {
+        GLint positionOffset, positionScale;
+        GLfloat uploadedOffset[3], uploadedScale[3];
+        bool valid;
+    };
+
+    /* Linked program and uniforms of each variant (see variantIndex); pID
+     * is the variant in use */
+    static GLuint programs[NUM_VARIANTS];
+    static Uniforms uniforms[NUM_VARIANTS];
+    static int current_variant = -1;
+
+    /* Steps of building a program from source (see startBuild) */
+    enum BuildStage { BUILD_NONE, BUILD_COMPILING, BUILD_LINKING, BUILD_DONE, BUILD_FAILED };
+
+    struct ProgramBuild {
+        GLuint program, vs, fs;
+        uint64_t key;               // ShaderCache key of the sources
+        BuildStage stage;
+        std::string errors;         // compile and link logs, if it failed
+    };
+
+    /* Every variant's build: at startup, then on each hot reload; the
+     * programs in use are kept until all variants of a reload are built */
+    static ProgramBuild builds[NUM_VARIANTS];
+
+    /* Errors of the last build, shown in the shader window until one succeeds */
+    static std::string shader_errors;
+
+    /* One range of a new buffer still to be filled by continueUpload */
+    struct UploadRange {
+        GLuint buffer;
+        GLintptr offset;
+        const char *data;
+        size_t size;
+    };
+
+    /* VAO and buffers of the next model, filled a little at a time while
+     * the current VAO is still drawn (see AsyncLoader) */
+    static struct {
+        MeshPool::GpuMesh mesh;
+        std::vector<UploadRange> ranges;
+        size_t next_range, range_done;
+        size_t total_bytes, uploaded_bytes;
+        bool active;
+    } upload;
+
+
+    static void queueRange(GLuint buffer, GLintptr offset, const void *data, size_t size) {
+        UploadRange range = { buffer, offset, (const char *)data, size };
+        upload.ranges.push_back(range);
+        upload.total_bytes += size;
+    }
+
 
      /* 
       * Reads a shader file and stores it as a string at &shaderCode.
@@ -36,87 +116,678 @@ namespace ShaderLoader {
     }
 
 
+    /*
+     * Looks up the locations of a variant's loose uniforms and binds its
+     * frame block, and creates the frame UBO on first use. Must be called
+     * after every (re)link; all values are re-uploaded on the next
+     * uploadUniforms with the variant in use.
+     */
+    static void resolveUniforms(int variant) {
+        GLuint program = programs[variant];
+        Uniforms &u = uniforms[variant];
+
+        u.positionOffset = glGetUniformLocation(program, "positionOffset");
+        u.positionScale = glGetUniformLocation(program, "positionScale");
+
+        GLuint blockIndex = glGetUniformBlockIndex(program, "FrameBlock");
+        if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(program, blockIndex, FRAME_BINDING);
+
+        if (frameUBO == 0) {
+            glGenBuffers(1, &frameUBO);
+            glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), NULL, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frameUBO);
+
+        u.valid = false;
+    }
+
+
+    /*
+     * Uploads the frame block and the loose uniforms of the variant in use
+     * from the current Display and camera state, skipping anything
+     * unchanged since the last upload. The frame block is shared by all
+     * variants; loose uniforms are kept per variant.
+     */
+    void uploadUniforms() {
+        FrameBlock block;
+        memset(&block, 0, sizeof(block));
+
+        memcpy(block.modelViewMatrix, modelViewMat, sizeof(block.modelViewMatrix));
+        memcpy(block.projectionMatrix, projectionMat, sizeof(block.projectionMatrix));
+
+        block.currentColor[0] = Display::red;
+        block.currentColor[1] = Display::green;
+        block.currentColor[2] = Display::blue;
+        block.currentColor[3] = 1.0f;
+
+        memcpy(block.lightDirection, Display::light_position, 3 * sizeof(GLfloat));
+        memcpy(block.halfVector, Display::halfVector, 3 * sizeof(GLfloat));
+
+        if (!frame_uploaded || memcmp(&block, &uploadedFrame, sizeof(block)) != 0) {
+            glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            uploadedFrame = block;
+            frame_uploaded = true;
+        }
+
+        if (current_variant < 0 || pID == 0) return;
+
+        Uniforms &u = uniforms[current_variant];
+        bool upload_all = !u.valid;
+
+        if (upload_all || memcmp(u.uploadedOffset, positionOffset, sizeof(positionOffset)) != 0) {
+            memcpy(u.uploadedOffset, positionOffset, sizeof(positionOffset));
+            glUniform3fv(u.positionOffset, 1, positionOffset);
+        }
+
+        if (upload_all || memcmp(u.uploadedScale, positionScale, sizeof(positionScale)) != 0) {
+            memcpy(u.uploadedScale, positionScale, sizeof(positionScale));
+            glUniform3fv(u.positionScale, 1, positionScale);
+        }
+
+        u.valid = true;
+    }
+
+
+    /*
+     * Returns the program variant for a shading mode, a lighting mode (OFF,
+     * GLOBAL_ON or ALL_ON) and a render mode (SOLID, WIREFRAME or POINTS).
+     */
+    static int variantIndex(bool smooth, unsigned light, char mode) {
+        return ((smooth ? 1 : 0) * 3 + (int)light) * 3 + (mode - SOLID);
+    }
+
+
+    /*
+     * Returns the #defines that specialize both shaders for a variant.
+     */
+    static std::string variantDefines(int variant) {
+        char defines[512];
+        sprintf(defines,
+            "#define LIGHT_OFF %d\n#define LIGHT_GLOBAL %d\n#define LIGHT_ALL %d\n"
+            "#define RENDER_SOLID %d\n#define RENDER_WIREFRAME %d\n#define RENDER_POINTS %d\n"
+            "#define SMOOTH_SHADING %d\n#define LIGHT_MODE %d\n#define RENDER_MODE %d\n",
+            OFF, GLOBAL_ON, ALL_ON, SOLID, WIREFRAME, POINTS,
+            variant / 9, (variant / 3) % 3, SOLID + variant % 3);
+        return defines;
+    }
+
+
+    /*
+     * Inserts defines into a shader's source, after its #version line, and
+     * restores the line numbering, so compile logs still point into the file.
+     */
+    static std::string injectDefines(const std::string &source, const std::string &defines) {
+        size_t start = 0;
+        int next_line = 1;
+
+        if (source.compare(0, 8, "#version") == 0) {
+            start = source.find('\n');
+            start = (start == std::string::npos) ? source.size() : start + 1;
+            next_line = 2;
+        }
+
+        std::string injected = source.substr(0, start);
+        if (!injected.empty() && injected[injected.size() - 1] != '\n') injected += '\n';
+
+        char line[32];
+        sprintf(line, "#line %d\n", next_line);
+
+        return injected + defines + line + source.substr(start);
+    }
+
+
+    /*
+     * Returns true once the driver has finished compiling shader, or
+     * linking program. Without parallel compilation it always does, and
+     * the status queries that follow wait for the driver instead.
+     */
+    static bool shaderReady(GLuint shader) {
+        if (!GLEW_ARB_parallel_shader_compile) return true;
+
+        GLint done = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPLETION_STATUS_ARB, &done);
+        return done == GL_TRUE;
+    }
+
+
+    static bool programReady(GLuint program) {
+        if (!GLEW_ARB_parallel_shader_compile) return true;
+
+        GLint done = GL_FALSE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &done);
+        return done == GL_TRUE;
+    }
+
+
+    /*
+     * Checks that shader compiled, appending its log to errors if not.
+     */
+    static bool checkShader(GLuint shader, const char *path, std::string &errors) {
+        GLint compiled = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (compiled) return true;
+
+        char log[4096] = "";
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        errors += std::string(path) + " failed to compile:\n" + log;
+        return false;
+    }
+
+
+    /*
+     * Deletes a build's shaders and, unless it succeeded, its program.
+     */
+    static void endBuild(ProgramBuild &build, BuildStage stage) {
+        if (build.vs != 0) glDeleteShader(build.vs);
+        if (build.fs != 0) glDeleteShader(build.fs);
+        build.vs = build.fs = 0;
+
+        if (stage == BUILD_FAILED && build.program != 0) {
+            glDeleteProgram(build.program);
+            build.program = 0;
+        }
+        build.stage = stage;
+    }
+
+
+    /*
+     * Starts building a program from the given sources: restored straight
+     * from ShaderCache if it holds it, otherwise compiled (in the
+     * background, with GL_ARB_parallel_shader_compile) and then linked by
+     * continueBuild.
+     */
+    static void startBuild(ProgramBuild &build, const std::string &vertex, const std::string &fragment) {
+        build.errors.clear();
+        build.key = ShaderCache::programKey(vertex, fragment);
+        build.program = glCreateProgram();
+        build.vs = build.fs = 0;
+
+        if (ShaderCache::load(build.key, build.program)) {
+            build.stage = BUILD_DONE;
+            return;
+        }
+
+        const GLchar *vertexSource = vertex.c_str();
+        const GLchar *fragmentSource = fragment.c_str();
+
+        build.vs = glCreateShader(GL_VERTEX_SHADER);
+        build.fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(build.vs, 1, &vertexSource, NULL);
+        glShaderSource(build.fs, 1, &fragmentSource, NULL);
+        glCompileShader(build.vs);
+        glCompileShader(build.fs);
+
+        build.stage = BUILD_COMPILING;
+    }
+
+
+    /*
+     * Advances a build as far as the driver allows: checks the compile logs
+     * and links once both shaders are compiled, then checks the link log
+     * and stores the program in ShaderCache. With wait, goes all the way,
+     * blocking on the driver as needed.
+     *
+     * Returns true once the build is done or has failed (see build.errors).
+     */
+    static bool continueBuild(ProgramBuild &build, bool wait) {
+        if (build.stage == BUILD_COMPILING) {
+            if (!wait && (!shaderReady(build.vs) || !shaderReady(build.fs))) return false;
+
+            bool compiled = checkShader(build.vs, Constants::vertex_shader_path, build.errors);
+            compiled = checkShader(build.fs, Constants::fragment_shader_path, build.errors) && compiled;
+            if (!compiled) {
+                endBuild(build, BUILD_FAILED);
+                return true;
+            }
+
+            glAttachShader(build.program, build.vs);
+            glAttachShader(build.program, build.fs);
+            ShaderCache::prepare(build.program);
+            glLinkProgram(build.program);
+
+            build.stage = BUILD_LINKING;
+        }
+
+        if (build.stage == BUILD_LINKING) {
+            if (!wait && !programReady(build.program)) return false;
+
+            GLint linked = 0;
+            glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                char log[4096] = "";
+                glGetProgramInfoLog(build.program, sizeof(log), NULL, log);
+                build.errors += std::string("Shader program failed to link:\n") + log;
+                endBuild(build, BUILD_FAILED);
+                return true;
+            }
+
+            ShaderCache::store(build.key, build.program);
+            endBuild(build, BUILD_DONE);
+        }
+
+        return true;
+    }
+
+
+    /*
+     * Reads both shader files, which are watched for hot reloading.
+     */
+    static void readSources(std::string &vertex, std::string &fragment) {
+        readShaderFile(Constants::vertex_shader_path, vertex);
+        readShaderFile(Constants::fragment_shader_path, fragment);
+    }
+
+
+    /*
+     * Starts building every variant from the shader files' sources.
+     */
+    static void startBuilds() {
+        std::string vertex, fragment;
+        readSources(vertex, fragment);
+
+        for (int v = 0; v < NUM_VARIANTS; v++) {
+            std::string defines = variantDefines(v);
+            startBuild(builds[v], injectDefines(vertex, defines), injectDefines(fragment, defines));
+        }
+    }
+
+
+    /*
+     * Advances every variant's build (see continueBuild).
+     *
+     * Returns true once all of them are done or have failed.
+     */
+    static bool continueBuilds(bool wait) {
+        bool done = true;
+        for (int v = 0; v < NUM_VARIANTS; v++) {
+            if (!continueBuild(builds[v], wait)) done = false;
+        }
+        return done;
+    }
+
+
+    /*
+     * Swaps in the programs of finished builds, deleting the previous ones,
+     * if every variant was built. Otherwise keeps the previous programs,
+     * drops the new ones and shows the errors of the first variant that
+     * failed.
+     */
+    static void finishBuilds() {
+        int failed = -1;
+        for (int v = 0; v < NUM_VARIANTS && failed < 0; v++) {
+            if (builds[v].stage == BUILD_FAILED) failed = v;
+        }
+
+        if (failed >= 0) {
+            shader_errors = "Shader variant with\n" + variantDefines(failed) + builds[failed].errors;
+            printf("%s", shader_errors.c_str());
+            if (pID != 0) printf("Keeping the last working shader programs\n");
+
+            for (int v = 0; v < NUM_VARIANTS; v++) {
+                if (builds[v].program != 0) glDeleteProgram(builds[v].program);
+                builds[v].program = 0;
+            }
+            return;
+        }
+
+        shader_errors.clear();
+
+        for (int v = 0; v < NUM_VARIANTS; v++) {
+            if (programs[v] != 0) glDeleteProgram(programs[v]);
+            programs[v] = builds[v].program;
+            builds[v].program = 0;
+            resolveUniforms(v);
+        }
+
+        current_variant = -1;
+        useVariant();
+        uploadUniforms();
+    }
+
+
+    /*
+     * Puts the program variant matching Display's shading, lighting and
+     * render modes in use, as pID.
+     */
+    void useVariant() {
+        current_variant = variantIndex(Display::smooth_shading, Display::light_on, Display::render_mode);
+        pID = programs[current_variant];
+        glUseProgram(pID);
+    }
+
+
     /* 
-     * Creates a program with custom vertex and fragment shaders.
+     * Creates the program variants (see variantIndex) from the custom vertex
+     * and fragment shaders, specialized by #defines, from ShaderCache where
+     * possible, and starts watching the shader files for changes (see
+     * pollReload).
      */
     void setShaders() {
-        char *vs = NULL, *fs = NULL;
-
-        vsID = glCreateShader(GL_VERTEX_SHADER);
-        fsID = glCreateShader(GL_FRAGMENT_SHADER);
-
-        /* Get each shader as a string. */
-        std::string vertShaderString;
-        std::string fragShaderString;
-        readShaderFile("vertexshader.txt", vertShaderString);
-        readShaderFile("fragmentshader.txt", fragShaderString);
-        const GLchar *pVertShaderSource = vertShaderString.c_str();
-        const GLchar *pFragShaderSource = fragShaderString.c_str();
-        glShaderSource(vsID, 1, &pVertShaderSource, NULL);
-        glShaderSource(fsID, 1, &pFragShaderSource, NULL);
-
-        /* Compile the shaders and attach them to a new program. */
-        glCompileShader(vsID);
-        glCompileShader(fsID);
-        pID = glCreateProgram();
-        glAttachShader(pID, vsID);
-        glAttachShader(pID, fsID);
-        glLinkProgram(pID);
-        glUseProgram(pID);
+        Profiler::Scope scope("shaders", "load");
 
-        /* Specify uniform locations. */
-        GLint modelViewMatLocation = glGetUniformLocation(pID, "modelViewMatrix");
-        GLint projectionMatLocation = glGetUniformLocation(pID, "projectionMatrix");
-        GLint currentColorLocation = glGetUniformLocation(pID, "currentColor");
-        GLint smoothShadingLocation = glGetUniformLocation(pID, "smoothShading");
-        GLint lightDirectionLocation = glGetUniformLocation(pID, "lightDirection");
-        GLint lightOnLocation = glGetUniformLocation(pID, "lightOn");
-        GLint halfVectorLocation = glGetUniformLocation(pID, "halfVector");
+        /* Let the driver compile on its own threads, for background reloads */
+        if (GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 
-        glUniformMatrix4fv(modelViewMatLocation, 1, GL_FALSE, modelViewMat);
-        glUniformMatrix4fv(projectionMatLocation, 1, GL_FALSE, projectionMat);
-        glUniform4f(currentColorLocation, Display::red, Display::green, Display::blue, 1.0);
-        glUniform1i(smoothShadingLocation, Display::smooth_shading);
-        glUniform3fv(lightDirectionLocation, 1, Display::light_position);
-        glUniform1i(lightOnLocation, Display::light_on);
-        glUniform3fv(halfVectorLocation, 1, Display::halfVector);
+        startBuilds();
+        continueBuilds(true);
+        finishBuilds();
 
-        glDeleteShader(vsID);
-        glDeleteShader(fsID);
+        /* Validate once at link time rather than every frame */
+        for (int v = 0; v < NUM_VARIANTS; v++) {
+            if (programs[v] == 0) continue;
+
+            glValidateProgram(programs[v]);
+            GLint validate = 0;
+            glGetProgramiv(programs[v], GL_VALIDATE_STATUS, &validate);
+            if (!validate) printf("Shader program variant %d failed validation\n", v);
+        }
+
+        if (Constants::SHADER_HOT_RELOAD) {
+            const char *paths[2] = { Constants::vertex_shader_path, Constants::fragment_shader_path };
+            ShaderWatcher::start(paths, 2);
+            glutTimerFunc(Constants::shader_poll_ms, pollReload, 0);
+        }
     }
 
 
-    /* 
-     * Initializes the VAO for the shader display function to use.
+    /*
+     * GL-side timer for hot reloading, running every Constants::shader_poll_ms.
+     * Starts rebuilding the variants when ShaderWatcher has seen a change,
+     * and swaps the new programs in once they are all built; the windows
+     * are redrawn either way, to show them or the errors.
      */
-    void initBufferObject(void) {
-        glGenBuffers(1, &pVBO);
-        glGenBuffers(1, &nVBO);
-        glGenBuffers(1, &EBO);
+    void pollReload(int t) {
+        glutTimerFunc(Constants::shader_poll_ms, pollReload, 0);
+
+        bool building = false;
+        for (int v = 0; v < NUM_VARIANTS; v++) {
+            if (builds[v].stage == BUILD_COMPILING || builds[v].stage == BUILD_LINKING) building = true;
+        }
+        if (!building && !ShaderWatcher::takeChange()) return;
+
+        Profiler::Scope scope("shader reload", "load");
+
+        /* The programs belong to the windows' shared context */
+        int window = glutGetWindow();
+        glutSetWindow(Display::window_shaders);
+
+        if (!building) startBuilds();
+
+        bool done = continueBuilds(false);
+        if (done) finishBuilds();
+
+        if (window) glutSetWindow(window);
+
+        if (done) Display::invalidate();
+    }
+
+
+    /*
+     * Draws the errors of the last failed shader build, if any, in red over
+     * the bottom left corner of the current window. Leaves GL state as it
+     * was, apart from the bound program.
+     */
+    void drawErrors() {
+        if (shader_errors.empty()) return;
 
-        glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
+        glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_POLYGON_BIT);
+        glUseProgram(0);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glColor3f(1.0f, 0.2f, 0.2f);
 
-        /* Buffer vertex coordinates */
+        /* Bottom up, so the first lines stay in view */
+        std::vector<std::string> lines;
+        std::stringstream stream(shader_errors);
+        for (std::string line; std::getline(stream, line); ) lines.push_back(line);
+
+        int y = 8;
+        for (size_t i = lines.size(); i-- > 0; y += 15) {
+            glWindowPos2i(8, y);
+            glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char *)lines[i].c_str());
+        }
+
+        glPopAttrib();
+    }
+
+
+    /*
+     * Converts a model's vertices to the packed GPU format, quantizing
+     * positions to its bounding box, and points model.packedData at them.
+     * Makes no GL calls, so it can run on the loader thread; beginUpload
+     * calls it if it hasn't been done yet.
+     */
+    void prepareVertices(ObjectLoader::Model &model) {
+        Profiler::Scope scope("pack", "load");
+
+        const ObjParser::Bounds &bounds = model.bounds;
+
+        GLfloat *min = model.packMin, *extent = model.packExtent;
+        min[0] = bounds.minx; min[1] = bounds.miny; min[2] = bounds.minz;
+        extent[0] = bounds.maxx - bounds.minx;
+        extent[1] = bounds.maxy - bounds.miny;
+        extent[2] = bounds.maxz - bounds.minz;
+
+        VertexPacking::pack(model.vertexData, model.normalData, model.numVertices,
+            min, extent, model.packedVertices);
+        model.packedData = model.packedVertices.data();
+    }
+
+
+    /*
+     * Allocates positions and normals as two tightly packed float VBOs
+     * (24 bytes per vertex), and queues them for upload.
+     */
+    static void bufferFloatVertices(const ObjectLoader::Model &model) {
+        GLsizeiptr size = model.numVertices * 3 * sizeof(GLfloat);
+
+        for (int i = 0; i < 3; i++) {
+            upload.mesh.positionOffset[i] = 0.0f;
+            upload.mesh.positionScale[i] = 1.0f;
+        }
+        upload.mesh.packed = false;
+
+        /* Vertex coordinates */
         glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, pVBO);
-        glBufferData(GL_ARRAY_BUFFER, (Display::vertexCoords).size() * sizeof(GLfloat),
-            &(Display::vertexCoords[0]), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, upload.mesh.pVBO);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+        queueRange(upload.mesh.pVBO, 0, model.vertexData, size);
 
-        /* Buffer vertex normals */
+        /* Vertex normals */
         glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, nVBO);
-        glBufferData(GL_ARRAY_BUFFER, (Display::vertexNormals).size() * sizeof(GLfloat),
-            &(Display::vertexNormals[0]), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, upload.mesh.nVBO);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+        queueRange(upload.mesh.nVBO, 0, model.normalData, size);
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (Display::faceVertices).size() * sizeof(GLuint),
-            &(Display::faceVertices[0]), GL_STATIC_DRAW);
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    /*
+     * Allocates positions and normals interleaved in one VBO, with positions
+     * quantized to the model's bounding box (12 bytes per vertex), and
+     * queues them for upload, straight from a mapped mesh cache if they
+     * came from one.
+     */
+    static void bufferPackedVertices(const ObjectLoader::Model &model) {
+        GLsizeiptr size = model.numVertices * sizeof(VertexPacking::PackedVertex);
+
+        for (int i = 0; i < 3; i++) {
+            upload.mesh.positionOffset[i] = model.packMin[i];
+            upload.mesh.positionScale[i] = model.packExtent[i];
+        }
+        upload.mesh.packed = true;
+
+        glBindBuffer(GL_ARRAY_BUFFER, upload.mesh.pVBO);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+        queueRange(upload.mesh.pVBO, 0, model.packedData, size);
+
+        /* Normalized attributes: positions arrive in [0, 1], normals in [-1, 1] */
+        GLsizei stride = sizeof(VertexPacking::PackedVertex);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+            (GLvoid*)offsetof(VertexPacking::PackedVertex, position));
+
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+            (GLvoid*)offsetof(VertexPacking::PackedVertex, normal));
+    }
+
+
+    /*
+     * Creates the VAO and buffers for a model and queues its data for
+     * continueUpload, either as float vertices or in the packed format
+     * (Constants::PACKED_VERTICES). The current VAO keeps being drawn until
+     * the finished mesh is handed to MeshPool. The model's arrays must stay
+     * valid until finishUpload.
+     */
+    void beginUpload(ObjectLoader::Model &model) {
+        Profiler::Scope scope("allocate", "upload");
+
+        cancelUpload();
+
+        if (Constants::PACKED_VERTICES && model.packedData == NULL) {
+            prepareVertices(model);
+        }
+
+        upload.mesh.create();
+        glBindVertexArray(upload.mesh.VAO);
+
+        if (Constants::PACKED_VERTICES) {
+            bufferPackedVertices(model);
+        } else {
+            bufferFloatVertices(model);
+        }
+
+        /* Full mesh followed by the simplified levels (see Display::drawMesh) */
+        GLsizeiptr mesh_size = model.numIndices * sizeof(GLuint);
+        GLsizeiptr lod_size = model.numLodIndices * sizeof(GLuint);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload.mesh.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh_size + lod_size, NULL, GL_STATIC_DRAW);
+        queueRange(upload.mesh.EBO, 0, model.indexData, mesh_size);
+        queueRange(upload.mesh.EBO, mesh_size, model.lodIndexData, lod_size);
+
+        /* Per-instance model matrices (see Scene) */
+        Scene::bindInstances(0);
+
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        upload.mesh.bytes = upload.total_bytes;
+
+        upload.active = true;
+    }
+
+
+    /*
+     * Copies up to max_bytes more of the queued data into the new buffers.
+     * Writes go through GL_COPY_WRITE_BUFFER, so no drawing binding changes.
+     *
+     * Returns true once everything has been uploaded.
+     */
+    bool continueUpload(size_t max_bytes) {
+        Profiler::Scope scope("copy", "upload");
+
+        while (upload.next_range < upload.ranges.size() && max_bytes > 0) {
+            const UploadRange &range = upload.ranges[upload.next_range];
+            size_t size = std::min(range.size - upload.range_done, max_bytes);
+
+            if (size > 0) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, range.buffer);
+                glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset + upload.range_done, size,
+                    range.data + upload.range_done);
+            }
+
+            upload.range_done += size;
+            upload.uploaded_bytes += size;
+            max_bytes -= size;
+
+            if (upload.range_done == range.size) {
+                upload.next_range++;
+                upload.range_done = 0;
+            }
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return upload.next_range == upload.ranges.size();
+    }
+
+
+    /*
+     * Returns how much of the upload in progress is done, in percent.
+     */
+    unsigned uploadPercent() {
+        if (upload.total_bytes == 0) return 100;
+        return (unsigned)(upload.uploaded_bytes * 100 / upload.total_bytes);
+    }
+
+
+    /*
+     * Hands the completed upload over to mesh.
+     */
+    void finishUpload(MeshPool::GpuMesh &mesh) {
+        mesh = std::move(upload.mesh);
+
+        upload.ranges.clear();
+        upload.active = false;
+    }
+
+
+    /*
+     * Abandons the upload in progress, if any, deleting its buffers.
+     */
+    void cancelUpload() {
+        upload.mesh.reset();
+        upload.ranges.clear();
+        upload.next_range = upload.range_done = 0;
+        upload.total_bytes = upload.uploaded_bytes = 0;
+        upload.active = false;
+    }
+
+
+    /*
+     * Makes mesh the VAO drawn by the shader window. The buffers stay
+     * owned by MeshPool.
+     */
+    void useMesh(const MeshPool::GpuMesh &mesh) {
+        VAO = mesh.VAO;
+        pVBO = mesh.pVBO;
+        nVBO = mesh.nVBO;
+        EBO = mesh.EBO;
+        memcpy(positionOffset, mesh.positionOffset, sizeof(positionOffset));
+        memcpy(positionScale, mesh.positionScale, sizeof(positionScale));
+    }
+
+
+    /*
+     * Uploads a model in one go, for a synchronous load.
+     */
+    void uploadModel(ObjectLoader::Model &model, MeshPool::GpuMesh &mesh) {
+        beginUpload(model);
+        continueUpload((size_t)-1);
+        finishUpload(mesh);
+    }
+
+
+    /* 
+     * Initializes the VAO for the shader display function to use, uploading
+     * the current model (ObjectLoader::current) at startup. Its arrays may
+     * point straight into a mapped mesh cache.
+     */
+    void initBufferObject(void) {
+        MeshPool::GpuMesh mesh;
+        uploadModel(ObjectLoader::current, mesh);
+        MeshPool::addCurrent(mesh);
+
+        /* Only needed for the upload */
+        ObjectLoader::releasePacked(ObjectLoader::current);
 
         glEnable(GL_DEPTH_TEST);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -3,13 +3,45 @@
 #ifndef SHADERLOADER_H
 #define SHADERLOADER_H
 
+#include "MeshPool.hpp"
+#include "ObjectLoader.hpp"
+
 namespace ShaderLoader {
 
-    extern GLuint vsID, fsID, pID, pVBO, VAO, EBO;
+    /* std140 layout of the FrameBlock uniform block in both shaders */
+    struct FrameBlock {
+        GLfloat modelViewMatrix[16];
+        GLfloat projectionMatrix[16];
+        GLfloat currentColor[4];
+        GLfloat lightDirection[4];
+        GLfloat halfVector[4];
+    };
+
+    /* Uniform buffer binding of the frame block, in every program using it */
+    const GLuint FRAME_BINDING = 0;
+
+    /* Program variants: shading (flat, smooth) x lighting (OFF, GLOBAL_ON,
+     * ALL_ON) x render mode (SOLID, WIREFRAME, POINTS) */
+    const int NUM_VARIANTS = 2 * 3 * 3;
+
+    extern GLuint pID, pVBO, nVBO, VAO, EBO, frameUBO;
     extern GLfloat projectionMat[16], modelViewMat[16];
+    extern GLfloat positionOffset[3], positionScale[3];
 
     void readShaderFile(const GLchar* shaderPath, std::string& shaderCode);
+    void uploadUniforms();
+    void useVariant();
     void setShaders();
+    void pollReload(int t);
+    void drawErrors();
+    void prepareVertices(ObjectLoader::Model &model);
+    void beginUpload(ObjectLoader::Model &model);
+    bool continueUpload(size_t max_bytes);
+    unsigned uploadPercent();
+    void finishUpload(MeshPool::GpuMesh &mesh);
+    void cancelUpload();
+    void useMesh(const MeshPool::GpuMesh &mesh);
+    void uploadModel(ObjectLoader::Model &model, MeshPool::GpuMesh &mesh);
     void initBufferObject(void);
 
 }
@@ -0,0 +1,184 @@
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "MeshCache.hpp"
+#include "Profiler.hpp"
+#include "ShaderWatcher.hpp"
+
+
+/*
+ * Watches the shader sources for changes on a thread of its own, for hot
+ * reloading (see ShaderLoader::pollReload). On Linux it waits on inotify
+ * events for the files' directories, so edits saved by renaming a new file
+ * over the old one are seen too; elsewhere, or if inotify is unavailable,
+ * it compares the files' modification times and sizes every
+ * Constants::shader_poll_ms. It only raises a flag: the GL thread reads and
+ * rebuilds the shaders.
+ */
+namespace ShaderWatcher {
+
+    const bool DEBUG(false);
+
+    /* One watched file, split into its directory and name */
+    struct Watched {
+        std::string directory, name, path;
+        int64_t mtime;
+        uint64_t size;
+        int wd;
+    };
+
+    static std::vector<Watched> watched;    // set before the thread starts
+    static std::atomic<bool> changed(false);
+    static std::atomic<bool> stopping(false);
+    static std::thread watcher;
+
+
+    static void statFile(Watched &file) {
+        file.mtime = 0;
+        file.size = 0;
+        MeshCache::sourceStat(file.path.c_str(), file.mtime, file.size);
+    }
+
+
+    /*
+     * Compares every file's modification time and size against those last
+     * seen, until stopped.
+     */
+    static void pollLoop() {
+        while (!stopping) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(Constants::shader_poll_ms));
+
+            for (size_t i = 0; i < watched.size(); i++) {
+                int64_t mtime = watched[i].mtime;
+                uint64_t size = watched[i].size;
+                statFile(watched[i]);
+
+                if (watched[i].mtime != mtime || watched[i].size != size) {
+                    if (DEBUG) printf("\"%s\" changed\n", watched[i].path.c_str());
+                    changed = true;
+                }
+            }
+        }
+    }
+
+
+#ifdef __linux__
+    /*
+     * Waits for inotify events on the watched files' directories, until
+     * stopped. Returns false, without watching anything, if inotify can't
+     * be used.
+     */
+    static bool inotifyLoop() {
+        int fd = inotify_init1(IN_NONBLOCK);
+        if (fd < 0) return false;
+
+        for (size_t i = 0; i < watched.size(); i++) {
+            watched[i].wd = inotify_add_watch(fd, watched[i].directory.c_str(),
+                IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+
+            if (watched[i].wd < 0) {
+                close(fd);
+                return false;
+            }
+        }
+
+        /* Wakes up every shader_poll_ms to check for shutdown */
+        struct pollfd waiting = { fd, POLLIN, 0 };
+        alignas(struct inotify_event) char buffer[4096];
+
+        while (!stopping) {
+            if (poll(&waiting, 1, Constants::shader_poll_ms) <= 0) continue;
+
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+                for (char *p = buffer; p < buffer + length; ) {
+                    const struct inotify_event *event = (const struct inotify_event *)p;
+                    p += sizeof(struct inotify_event) + event->len;
+                    if (event->len == 0) continue;
+
+                    for (size_t i = 0; i < watched.size(); i++) {
+                        if (event->wd != watched[i].wd || watched[i].name != event->name) continue;
+
+                        if (DEBUG) printf("\"%s\" changed\n", watched[i].path.c_str());
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        close(fd);
+        return true;
+    }
+#endif
+
+
+    static void watchLoop() {
+        Profiler::nameThread("shader watcher");
+
+    #ifdef __linux__
+        if (inotifyLoop()) return;
+    #endif
+        pollLoop();
+    }
+
+
+    /*
+     * Starts watching the files at paths for changes, on a new thread.
+     * Does nothing if already watching.
+     */
+    void start(const char *const *paths, size_t count) {
+        if (watcher.joinable()) return;
+
+        for (size_t i = 0; i < count; i++) {
+            Watched file;
+            file.path = paths[i];
+
+            size_t slash = file.path.find_last_of("/\\");
+            file.directory = slash == std::string::npos ? "." : file.path.substr(0, slash);
+            file.name = slash == std::string::npos ? file.path : file.path.substr(slash + 1);
+            file.wd = -1;
+            statFile(file);
+
+            watched.push_back(file);
+        }
+
+        watcher = std::thread(watchLoop);
+        atexit(shutdown);
+    }
+
+
+    /*
+     * Returns true if a watched file has changed since the last call that
+     * returned true.
+     */
+    bool takeChange() {
+        return changed.exchange(false);
+    }
+
+
+    /*
+     * Stops and joins the watcher thread. Registered with atexit when the
+     * thread is started.
+     */
+    void shutdown() {
+        stopping = true;
+        if (watcher.joinable()) watcher.join();
+    }
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#ifndef SHADERWATCHER_H
+#define SHADERWATCHER_H
+
+#include <stddef.h>
+
+namespace ShaderWatcher {
+
+    void start(const char *const *paths, size_t count);
+    bool takeChange();
+    void shutdown();
+
+}
+
+#endif
@@ -0,0 +1,783 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTER_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include "GL/freeglut.h"
+#include "glm/glm.hpp"
+
+#include "Camera.hpp"
+#include "Display.hpp"
+#include "ObjectLoader.hpp"
+#include "Profiler.hpp"
+#include "ShaderLoader.hpp"
+#include "SoftwareRenderer.hpp"
+#include "WorkerPool.hpp"
+
+
+/*
+ * CPU rasterizer that renders the current model without a GL context, for
+ * machines with no GPU. Uses the same mesh arrays and camera matrices as
+ * the shader window, and reproduces its render modes and the lighting of
+ * fragmentshader.txt.
+ *
+ * Vertices are transformed in parallel, triangles are clipped against the
+ * near plane, culled and binned into screen tiles, and tiles are then
+ * rasterized in parallel with SIMD edge functions.
+ */
+namespace SoftwareRenderer {
+
+    static const int TILE_SIZE = 64;
+
+    /* Triangles are set up in this many independent blocks; bins are kept
+     * per block so that binning needs no locks and preserves draw order */
+    static const size_t NUM_BLOCKS = 64;
+
+    /* Window-space position (y up) and 1/w for perspective correction */
+    struct ScreenVertex {
+        GLfloat x, y, z, invw;
+    };
+
+    /* Vertex created by near-plane clipping */
+    struct ClippedVertex {
+        ScreenVertex screen;
+        GLfloat position[3];
+        GLfloat normal[3];
+    };
+
+    /* Triangle that survived clipping and culling; ids at or above the
+     * model's vertex count refer to the block's clipped vertices */
+    struct Triangle {
+        GLuint v[3];
+    };
+
+    struct Block {
+        std::vector<Triangle> triangles;
+        std::vector<ClippedVertex> clipped;
+        std::vector< std::vector<GLuint> > bins;
+    };
+
+    /* Everything a tile needs to shade its pixels */
+    struct Frame {
+        int width, height;
+        int tiles_x, tiles_y;
+
+        std::vector<ScreenVertex> screen;
+        std::vector<GLfloat> clip; // x, y, z, w per vertex
+        std::vector<Block> blocks;
+
+        std::vector<GLfloat> depth;
+        std::vector<unsigned char> color; // window rows, bottom to top
+
+        GLfloat light_color[3];
+        GLfloat light_direction[3];
+        GLfloat half_vector[3];
+        unsigned light_on;
+        bool smooth;
+        char mode;
+    };
+
+    /* Attributes of one triangle corner, wherever it is stored */
+    struct Corner {
+        const ScreenVertex *screen;
+        const GLfloat *position;
+        const GLfloat *normal;
+    };
+
+
+    /********************************************************************************
+     *                                    SETUP                                     *
+     ********************************************************************************/
+
+    static Corner fetchCorner(const Frame &frame, const Block &block, GLuint id) {
+        Corner corner;
+        if (id < Display::numVertices) {
+            corner.screen = &frame.screen[id];
+            corner.position = Display::vertexData + id * 3;
+            corner.normal = Display::normalData + id * 3;
+        } else {
+            const ClippedVertex &v = block.clipped[id - Display::numVertices];
+            corner.screen = &v.screen;
+            corner.position = v.position;
+            corner.normal = v.normal;
+        }
+        return corner;
+    }
+
+
+    static ScreenVertex toScreen(const Frame &frame, const GLfloat *clip) {
+        ScreenVertex s;
+        s.invw = 1.0f / clip[3];
+        s.x = (clip[0] * s.invw * 0.5f + 0.5f) * frame.width;
+        s.y = (clip[1] * s.invw * 0.5f + 0.5f) * frame.height;
+        s.z = clip[2] * s.invw * 0.5f + 0.5f;
+        return s;
+    }
+
+
+    /*
+     * Transforms every vertex to clip space (P * MV * position) and, for
+     * those in front of the near plane, to window space.
+     */
+    static void transformVertices(Frame &frame) {
+        glm::mat4 mv, p;
+        for (int i = 0; i < 16; i++) {
+            mv[i / 4][i % 4] = ShaderLoader::modelViewMat[i];
+            p[i / 4][i % 4] = ShaderLoader::projectionMat[i];
+        }
+        glm::mat4 mvp = p * mv;
+
+        frame.screen.resize(Display::numVertices);
+        frame.clip.resize(Display::numVertices * 4);
+
+        WorkerPool::parallelFor(Display::numVertices, 65536, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                const GLfloat *position = Display::vertexData + v * 3;
+                glm::vec4 c = mvp * glm::vec4(position[0], position[1], position[2], 1.0f);
+
+                GLfloat *clip = &frame.clip[v * 4];
+                clip[0] = c.x; clip[1] = c.y; clip[2] = c.z; clip[3] = c.w;
+
+                if (c.z >= -c.w && c.w > 0.0f) frame.screen[v] = toScreen(frame, clip);
+            }
+        });
+    }
+
+
+    /*
+     * Culls back-facing and off-screen triangles and adds the rest to the
+     * bins of every tile their bounding box touches.
+     */
+    static void binTriangle(const Frame &frame, Block &block, const Triangle &triangle) {
+        Corner c0 = fetchCorner(frame, block, triangle.v[0]);
+        Corner c1 = fetchCorner(frame, block, triangle.v[1]);
+        Corner c2 = fetchCorner(frame, block, triangle.v[2]);
+
+        const ScreenVertex &s0 = *c0.screen, &s1 = *c1.screen, &s2 = *c2.screen;
+
+        /* Back faces are culled in every mode, as in setPolygonMode */
+        GLfloat area = (s1.x - s0.x) * (s2.y - s0.y) - (s2.x - s0.x) * (s1.y - s0.y);
+        if (!(area > 0.0f)) return;
+
+        /* Entirely beyond the far plane */
+        if (s0.z > 1.0f && s1.z > 1.0f && s2.z > 1.0f) return;
+
+        GLfloat minx = std::min(s0.x, std::min(s1.x, s2.x));
+        GLfloat maxx = std::max(s0.x, std::max(s1.x, s2.x));
+        GLfloat miny = std::min(s0.y, std::min(s1.y, s2.y));
+        GLfloat maxy = std::max(s0.y, std::max(s1.y, s2.y));
+
+        if (maxx < 0.0f || maxy < 0.0f || minx >= frame.width || miny >= frame.height) return;
+
+        int tx0 = std::max(0, (int)minx / TILE_SIZE);
+        int ty0 = std::max(0, (int)miny / TILE_SIZE);
+        int tx1 = std::min(frame.tiles_x - 1, (int)maxx / TILE_SIZE);
+        int ty1 = std::min(frame.tiles_y - 1, (int)maxy / TILE_SIZE);
+
+        GLuint index = block.triangles.size();
+        block.triangles.push_back(triangle);
+
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                block.bins[ty * frame.tiles_x + tx].push_back(index);
+            }
+        }
+    }
+
+
+    /*
+     * Clips a triangle that crosses the near plane (z >= -w) and bins the
+     * resulting one or two triangles, with new vertices stored in the block.
+     */
+    static void clipTriangle(Frame &frame, Block &block, const GLuint *face) {
+        struct PolyVertex {
+            GLfloat clip[4];
+            GLfloat position[3];
+            GLfloat normal[3];
+        };
+
+        PolyVertex in[3], out[4];
+        for (int i = 0; i < 3; i++) {
+            memcpy(in[i].clip, &frame.clip[face[i] * 4], 4 * sizeof(GLfloat));
+            memcpy(in[i].position, Display::vertexData + face[i] * 3, 3 * sizeof(GLfloat));
+            memcpy(in[i].normal, Display::normalData + face[i] * 3, 3 * sizeof(GLfloat));
+        }
+
+        /* Sutherland-Hodgman against the single plane z + w = 0 */
+        int count = 0;
+        for (int i = 0; i < 3; i++) {
+            const PolyVertex &a = in[i];
+            const PolyVertex &b = in[(i + 1) % 3];
+            GLfloat da = a.clip[2] + a.clip[3];
+            GLfloat db = b.clip[2] + b.clip[3];
+
+            if (da >= 0.0f) out[count++] = a;
+
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                GLfloat t = da / (da - db);
+                PolyVertex &v = out[count++];
+                for (int k = 0; k < 4; k++) v.clip[k] = a.clip[k] + t * (b.clip[k] - a.clip[k]);
+                for (int k = 0; k < 3; k++) {
+                    v.position[k] = a.position[k] + t * (b.position[k] - a.position[k]);
+                    v.normal[k] = a.normal[k] + t * (b.normal[k] - a.normal[k]);
+                }
+            }
+        }
+
+        if (count < 3) return;
+
+        GLuint first = Display::numVertices + block.clipped.size();
+        for (int i = 0; i < count; i++) {
+            ClippedVertex v;
+            if (out[i].clip[3] <= 0.0f) return; // degenerate at the eye
+            v.screen = toScreen(frame, out[i].clip);
+            memcpy(v.position, out[i].position, sizeof(v.position));
+            memcpy(v.normal, out[i].normal, sizeof(v.normal));
+            block.clipped.push_back(v);
+        }
+
+        for (int i = 1; i + 1 < count; i++) {
+            Triangle triangle = { { first, first + i, first + i + 1 } };
+            binTriangle(frame, block, triangle);
+        }
+    }
+
+
+    /*
+     * Sets up and bins all faces, in NUM_BLOCKS parallel blocks.
+     */
+    static void binTriangles(Frame &frame) {
+        GLuint num_faces = Display::numIndices / 3;
+        size_t num_tiles = frame.tiles_x * frame.tiles_y;
+
+        frame.blocks.resize(NUM_BLOCKS);
+
+        WorkerPool::parallelFor(NUM_BLOCKS, 1, [&](size_t first, size_t last) {
+            for (size_t b = first; b < last; b++) {
+                Block &block = frame.blocks[b];
+                block.bins.assign(num_tiles, std::vector<GLuint>());
+
+                GLuint begin = (GLuint)(num_faces * b / NUM_BLOCKS);
+                GLuint end = (GLuint)(num_faces * (b + 1) / NUM_BLOCKS);
+
+                for (GLuint f = begin; f < end; f++) {
+                    const GLuint *face = Display::indexData + f * 3;
+
+                    int in_front = 0;
+                    for (int i = 0; i < 3; i++) {
+                        const GLfloat *clip = &frame.clip[face[i] * 4];
+                        if (clip[2] >= -clip[3] && clip[3] > 0.0f) in_front++;
+                    }
+
+                    if (in_front == 3) {
+                        Triangle triangle = { { face[0], face[1], face[2] } };
+                        binTriangle(frame, block, triangle);
+                    } else if (in_front > 0) {
+                        clipTriangle(frame, block, face);
+                    }
+                }
+            }
+        });
+    }
+
+
+    /********************************************************************************
+     *                                   SHADING                                    *
+     ********************************************************************************/
+
+    /*
+     * Lighting model of fragmentshader.txt, for normal n.
+     */
+    static void shade(const Frame &frame, const GLfloat *n, unsigned char *rgb) {
+        if (frame.light_on == OFF) {
+            rgb[0] = rgb[1] = rgb[2] = 0;
+            return;
+        }
+
+        const GLfloat ka = 0.3f, kd = 0.8f, ks = 0.3f, shininess = 50.0f;
+        GLfloat result[3];
+
+        if (frame.light_on == GLOBAL_ON) {
+            for (int i = 0; i < 3; i++) result[i] = frame.light_color[i] * ka;
+        } else {
+            const GLfloat *l = frame.light_direction;
+            const GLfloat *h = frame.half_vector;
+
+            GLfloat diffuse = std::max(0.0f, n[0] * l[0] + n[1] * l[1] + n[2] * l[2]);
+            GLfloat specular = std::max(0.0f, n[0] * h[0] + n[1] * h[1] + n[2] * h[2]);
+            specular = (diffuse == 0.0f) ? 0.0f : powf(specular, shininess);
+
+            for (int i = 0; i < 3; i++) {
+                GLfloat c = frame.light_color[i];
+                GLfloat global_ambient = c * ka;
+                GLfloat scattered = kd * (c * 0.8f) * diffuse + ka * (c * 0.2f);
+                GLfloat reflected = ks * (c * 0.5f) * specular;
+                result[i] = global_ambient + scattered + reflected;
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            GLfloat c = std::min(1.0f, std::max(0.0f, result[i]));
+            rgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+        }
+    }
+
+
+    static void faceNormal(const Corner &c0, const Corner &c1, const Corner &c2, GLfloat *n) {
+        glm::vec3 p0(c0.position[0], c0.position[1], c0.position[2]);
+        glm::vec3 p1(c1.position[0], c1.position[1], c1.position[2]);
+        glm::vec3 p2(c2.position[0], c2.position[1], c2.position[2]);
+
+        glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+        GLfloat length = glm::length(cross);
+        if (length > 0.0f) cross = cross / length;
+
+        n[0] = cross.x; n[1] = cross.y; n[2] = cross.z;
+    }
+
+
+    /*
+     * Depth-tests and shades one pixel. b holds the perspective-corrected
+     * barycentric weights of the three corners (used for smooth normals).
+     */
+    static inline void writePixel(Frame &frame, int x, int y, GLfloat z,
+        const Corner *corners, const GLfloat *b, const GLfloat *flat_normal) {
+
+        if (z < 0.0f || z > 1.0f) return;
+
+        size_t pixel = (size_t)y * frame.width + x;
+        if (z >= frame.depth[pixel]) return;
+        frame.depth[pixel] = z;
+
+        GLfloat n[3];
+        if (frame.smooth) {
+            for (int i = 0; i < 3; i++) {
+                n[i] = b[0] * corners[0].normal[i] + b[1] * corners[1].normal[i] + b[2] * corners[2].normal[i];
+            }
+        } else {
+            n[0] = flat_normal[0]; n[1] = flat_normal[1]; n[2] = flat_normal[2];
+        }
+
+        shade(frame, n, &frame.color[pixel * 3]);
+    }
+
+
+    /********************************************************************************
+     *                                RASTERIZATION                                 *
+     ********************************************************************************/
+
+    /*
+     * Fills the part of a triangle inside the tile [x0, x1) x [y0, y1).
+     * Edge functions are evaluated at pixel centers, four pixels at a time.
+     */
+    static void fillTriangle(Frame &frame, const Corner *c, const GLfloat *flat_normal,
+        int x0, int y0, int x1, int y1) {
+
+        const ScreenVertex &s0 = *c[0].screen, &s1 = *c[1].screen, &s2 = *c[2].screen;
+
+        /* E(x, y) = A x + B y + C; weight of each corner is its opposite edge */
+        GLfloat A[3] = { s1.y - s2.y, s2.y - s0.y, s0.y - s1.y };
+        GLfloat B[3] = { s2.x - s1.x, s0.x - s2.x, s1.x - s0.x };
+        GLfloat C[3] = { s1.x * s2.y - s2.x * s1.y, s2.x * s0.y - s0.x * s2.y, s0.x * s1.y - s1.x * s0.y };
+        GLfloat inv_area = 1.0f / (C[0] + C[1] + C[2]);
+
+        int minx = std::max(x0, (int)floorf(std::min(s0.x, std::min(s1.x, s2.x))));
+        int maxx = std::min(x1 - 1, (int)ceilf(std::max(s0.x, std::max(s1.x, s2.x))));
+        int miny = std::max(y0, (int)floorf(std::min(s0.y, std::min(s1.y, s2.y))));
+        int maxy = std::min(y1 - 1, (int)ceilf(std::max(s0.y, std::max(s1.y, s2.y))));
+
+        for (int y = miny; y <= maxy; y++) {
+            GLfloat py = y + 0.5f;
+
+            for (int x = minx; x <= maxx; x += 4) {
+                int mask;
+
+            #ifdef RASTER_SSE
+                __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+                __m128 zero = _mm_setzero_ps();
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+                for (int e = 0; e < 3; e++) {
+                    __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[e]), px),
+                        _mm_set1_ps(B[e] * py + C[e]));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(value, zero));
+                }
+                mask = _mm_movemask_ps(inside);
+            #else
+                mask = 0;
+                for (int lane = 0; lane < 4; lane++) {
+                    GLfloat px = x + lane + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++) inside = inside && (A[e] * px + B[e] * py + C[e] >= 0.0f);
+                    if (inside) mask |= 1 << lane;
+                }
+            #endif
+
+                for (int lane = 0; lane < 4 && mask; lane++, mask >>= 1) {
+                    if (!(mask & 1) || x + lane > maxx) continue;
+
+                    GLfloat px = x + lane + 0.5f;
+                    GLfloat w[3];
+                    for (int e = 0; e < 3; e++) w[e] = (A[e] * px + B[e] * py + C[e]) * inv_area;
+
+                    GLfloat z = w[0] * s0.z + w[1] * s1.z + w[2] * s2.z;
+
+                    /* Perspective-correct weights for attribute interpolation */
+                    GLfloat b[3] = { w[0] * s0.invw, w[1] * s1.invw, w[2] * s2.invw };
+                    GLfloat inv_sum = 1.0f / (b[0] + b[1] + b[2]);
+                    b[0] *= inv_sum; b[1] *= inv_sum; b[2] *= inv_sum;
+
+                    writePixel(frame, x + lane, y, z, c, b, flat_normal);
+                }
+            }
+        }
+    }
+
+
+    /*
+     * Draws the part of edge (a, b) inside the tile [x0, x1) x [y0, y1),
+     * stepping one pixel at a time along its major axis.
+     */
+    static void drawEdge(Frame &frame, const Corner *c, int a, int b, const GLfloat *flat_normal,
+        int x0, int y0, int x1, int y1) {
+
+        const ScreenVertex &sa = *c[a].screen, &sb = *c[b].screen;
+        GLfloat dx = sb.x - sa.x, dy = sb.y - sa.y;
+        int steps = (int)ceilf(std::max(fabsf(dx), fabsf(dy)));
+        if (steps == 0) steps = 1;
+
+        /* Restrict the parameter range to the tile (Liang-Barsky) */
+        GLfloat t0 = 0.0f, t1 = 1.0f;
+        GLfloat p[4] = { -dx, dx, -dy, dy };
+        GLfloat q[4] = { sa.x - x0, x1 - sa.x, sa.y - y0, y1 - sa.y };
+
+        for (int i = 0; i < 4; i++) {
+            if (p[i] == 0.0f) {
+                if (q[i] < 0.0f) return;
+            } else {
+                GLfloat t = q[i] / p[i];
+                if (p[i] < 0.0f) t0 = std::max(t0, t);
+                else t1 = std::min(t1, t);
+            }
+        }
+        if (t0 > t1) return;
+
+        int first = (int)floorf(t0 * steps), last = (int)ceilf(t1 * steps);
+
+        for (int i = first; i <= last && i <= steps; i++) {
+            GLfloat t = (GLfloat)i / steps;
+            int x = (int)floorf(sa.x + dx * t);
+            int y = (int)floorf(sa.y + dy * t);
+            if (x < x0 || x >= x1 || y < y0 || y >= y1) continue;
+
+            GLfloat z = sa.z + (sb.z - sa.z) * t;
+
+            GLfloat weight[3] = { 0.0f, 0.0f, 0.0f };
+            GLfloat wa = (1.0f - t) * sa.invw, wb = t * sb.invw;
+            weight[a] = wa / (wa + wb);
+            weight[b] = wb / (wa + wb);
+
+            writePixel(frame, x, y, z, c, weight, flat_normal);
+        }
+    }
+
+
+    /*
+     * Rasterizes every triangle binned to one tile, in draw order.
+     */
+    static void rasterizeTile(Frame &frame, int tile) {
+        int x0 = (tile % frame.tiles_x) * TILE_SIZE;
+        int y0 = (tile / frame.tiles_x) * TILE_SIZE;
+        int x1 = std::min(x0 + TILE_SIZE, frame.width);
+        int y1 = std::min(y0 + TILE_SIZE, frame.height);
+
+        for (size_t b = 0; b < frame.blocks.size(); b++) {
+            const Block &block = frame.blocks[b];
+            const std::vector<GLuint> &bin = block.bins[tile];
+
+            for (size_t i = 0; i < bin.size(); i++) {
+                const Triangle &triangle = block.triangles[bin[i]];
+
+                Corner c[3];
+                for (int k = 0; k < 3; k++) c[k] = fetchCorner(frame, block, triangle.v[k]);
+
+                GLfloat flat_normal[3] = { 0.0f, 0.0f, 0.0f };
+                if (!frame.smooth) faceNormal(c[0], c[1], c[2], flat_normal);
+
+                if (frame.mode == SOLID) {
+                    fillTriangle(frame, c, flat_normal, x0, y0, x1, y1);
+                } else if (frame.mode == WIREFRAME) {
+                    drawEdge(frame, c, 0, 1, flat_normal, x0, y0, x1, y1);
+                    drawEdge(frame, c, 1, 2, flat_normal, x0, y0, x1, y1);
+                    drawEdge(frame, c, 2, 0, flat_normal, x0, y0, x1, y1);
+                } else if (frame.mode == POINTS) {
+                    for (int k = 0; k < 3; k++) {
+                        const ScreenVertex &s = *c[k].screen;
+                        int x = (int)floorf(s.x), y = (int)floorf(s.y);
+                        if (x < x0 || x >= x1 || y < y0 || y >= y1) continue;
+
+                        GLfloat weight[3] = { 0.0f, 0.0f, 0.0f };
+                        weight[k] = 1.0f;
+                        writePixel(frame, x, y, s.z, c, weight, flat_normal);
+                    }
+                }
+            }
+        }
+    }
+
+
+    /********************************************************************************
+     *                                    OUTPUT                                    *
+     ********************************************************************************/
+
+    /*
+     * Renders the current model with the current camera, lighting and render
+     * mode into image.
+     */
+    void render(int width, int height, Image &image) {
+        Frame frame;
+        frame.width = width;
+        frame.height = height;
+        frame.tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+        frame.tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+        Camera::calcProjectionMat();
+        Camera::calcModelViewMat();
+        Display::updateHalfVector();
+
+        frame.light_color[0] = Display::red;
+        frame.light_color[1] = Display::green;
+        frame.light_color[2] = Display::blue;
+
+        glm::vec3 l = glm::normalize(glm::vec3(Display::light_position[0],
+            Display::light_position[1], Display::light_position[2]));
+        frame.light_direction[0] = l.x; frame.light_direction[1] = l.y; frame.light_direction[2] = l.z;
+        memcpy(frame.half_vector, Display::halfVector, sizeof(frame.half_vector));
+
+        frame.light_on = Display::light_on;
+        frame.smooth = Display::smooth_shading;
+        frame.mode = Display::render_mode;
+
+        frame.depth.assign((size_t)width * height, 1.0f);
+        frame.color.assign((size_t)width * height * 3, 0);
+
+        transformVertices(frame);
+        binTriangles(frame);
+
+        WorkerPool::parallelFor(frame.tiles_x * frame.tiles_y, 1, [&](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++) rasterizeTile(frame, (int)tile);
+        });
+
+        /* Window rows run bottom to top; images top to bottom */
+        image.width = width;
+        image.height = height;
+        image.rgb.resize((size_t)width * height * 3);
+        for (int y = 0; y < height; y++) {
+            memcpy(&image.rgb[(size_t)(height - 1 - y) * width * 3],
+                &frame.color[(size_t)y * width * 3], (size_t)width * 3);
+        }
+    }
+
+
+    static void putBigEndian(std::vector<unsigned char> &out, unsigned value) {
+        out.push_back((value >> 24) & 0xFF);
+        out.push_back((value >> 16) & 0xFF);
+        out.push_back((value >> 8) & 0xFF);
+        out.push_back(value & 0xFF);
+    }
+
+
+    static unsigned crc32(const unsigned char *data, size_t size) {
+        static unsigned table[256];
+        static bool initialized = false;
+
+        if (!initialized) {
+            for (unsigned n = 0; n < 256; n++) {
+                unsigned c = n;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            initialized = true;
+        }
+
+        unsigned c = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; i++) c = table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+        return c ^ 0xFFFFFFFFu;
+    }
+
+
+    static void writeChunk(FILE *fp, const char *type, const std::vector<unsigned char> &data) {
+        std::vector<unsigned char> chunk;
+        putBigEndian(chunk, (unsigned)data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        putBigEndian(chunk, crc32(&chunk[4], chunk.size() - 4));
+        fwrite(&chunk[0], 1, chunk.size(), fp);
+    }
+
+
+    /*
+     * Writes an RGB PNG using uncompressed (stored) deflate blocks, so no
+     * compression library is needed.
+     */
+    static bool writePng(FILE *fp, const Image &image) {
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        fwrite(signature, 1, 8, fp);
+
+        std::vector<unsigned char> header;
+        putBigEndian(header, image.width);
+        putBigEndian(header, image.height);
+        header.push_back(8);    // bit depth
+        header.push_back(2);    // RGB
+        header.push_back(0);    // deflate
+        header.push_back(0);    // adaptive filtering
+        header.push_back(0);    // no interlace
+        writeChunk(fp, "IHDR", header);
+
+        /* Scanlines, each prefixed with filter type 0 */
+        size_t row_bytes = (size_t)image.width * 3;
+        std::vector<unsigned char> raw;
+        raw.reserve((row_bytes + 1) * image.height);
+        for (int y = 0; y < image.height; y++) {
+            raw.push_back(0);
+            raw.insert(raw.end(), image.rgb.begin() + y * row_bytes, image.rgb.begin() + (y + 1) * row_bytes);
+        }
+
+        std::vector<unsigned char> zlib;
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+
+        for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535) {
+            size_t length = std::min((size_t)65535, raw.size() - offset);
+            bool last = offset + length >= raw.size();
+
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(length & 0xFF);
+            zlib.push_back((length >> 8) & 0xFF);
+            zlib.push_back(~length & 0xFF);
+            zlib.push_back((~length >> 8) & 0xFF);
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+            if (last) break;
+        }
+
+        unsigned a = 1, b = 0;
+        for (size_t i = 0; i < raw.size(); i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        putBigEndian(zlib, (b << 16) | a);
+
+        writeChunk(fp, "IDAT", zlib);
+        writeChunk(fp, "IEND", std::vector<unsigned char>());
+        return !ferror(fp);
+    }
+
+
+    /*
+     * Writes image to path, as PNG if the path ends in .png and as binary
+     * PPM otherwise.
+     *
+     * Returns true if the file was written; false otherwise.
+     */
+    bool writeImage(const char *path, const Image &image) {
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL) {
+            printf("Can't write \"%s\"\n", path);
+            return false;
+        }
+
+        std::string name(path);
+        bool png = name.size() >= 4 && (name.compare(name.size() - 4, 4, ".png") == 0
+            || name.compare(name.size() - 4, 4, ".PNG") == 0);
+
+        bool ok;
+        if (png) {
+            ok = writePng(fp, image);
+        } else {
+            fprintf(fp, "P6\n%d %d\n255\n", image.width, image.height);
+            ok = fwrite(&image.rgb[0], 1, image.rgb.size(), fp) == image.rgb.size();
+        }
+
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) printf("Can't write \"%s\"\n", path);
+        return ok;
+    }
+
+
+    /*
+     * Entry point for rendering without a window:
+     *
+     *   --headless <out.png|out.ppm> [--model <file.obj>] [--size <w>x<h>]
+     *              [--mode solid|wireframe|points] [--flat] [--light 0|1|2]
+     *              [--trace <trace.json>]
+     *
+     * Returns the process exit status.
+     */
+    int headlessMain(int argc, char **argv) {
+        const char *output = NULL;
+        int width = 500, height = 500;
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg(argv[i]);
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--headless" && has_value) {
+                output = argv[++i];
+            } else if (arg == "--model" && has_value) {
+                strncpy(Display::current_model, argv[++i], sizeof(Display::current_model) - 1);
+            } else if (arg == "--size" && has_value) {
+                if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                    printf("Invalid size \"%s\"\n", argv[i]);
+                    return 1;
+                }
+            } else if (arg == "--mode" && has_value) {
+                std::string mode(argv[++i]);
+                if (mode == "wireframe") Display::render_mode = WIREFRAME;
+                else if (mode == "points") Display::render_mode = POINTS;
+                else Display::render_mode = SOLID;
+            } else if (arg == "--flat") {
+                Display::smooth_shading = false;
+            } else if (arg == "--light" && has_value) {
+                Display::light_on = (unsigned)atoi(argv[++i]) % 3;
+            } else if (arg == "--trace" && has_value) {
+                Profiler::traceOnExit(argv[++i]);
+            } else {
+                printf("Unknown argument \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }
+
+        if (output == NULL) {
+            printf("Usage: --headless <out.png|out.ppm> [--model <file.obj>] [--size <w>x<h>]\n"
+                "       [--mode solid|wireframe|points] [--flat] [--light 0|1|2]\n"
+                "       [--trace <trace.json>]\n");
+            return 1;
+        }
+
+        if (!ObjectLoader::loadObject(Display::current_model)) return 1;
+        Camera::resetCamera();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        Image image;
+        {
+            Profiler::Scope scope("render", "headless");
+            render(width, height, image);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Rendered %dx%d (%u triangles) in %.3f s\n", width, height, Display::numIndices / 3, seconds);
+
+        return writeImage(output, image) ? 0 : 1;
+    }
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#ifndef SOFTWARERENDERER_H
+#define SOFTWARERENDERER_H
+
+#include <vector>
+
+namespace SoftwareRenderer {
+
+    /* 8-bit RGB image, rows stored top to bottom */
+    struct Image {
+        int width, height;
+        std::vector<unsigned char> rgb;
+    };
+
+    void render(int width, int height, Image &image);
+    bool writeImage(const char *path, const Image &image);
+    int headlessMain(int argc, char **argv);
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "VertexPacking.hpp"
+#include "WorkerPool.hpp"
+
+
+/*
+ * Compact vertex format for the shader window: 12 bytes per vertex instead
+ * of the 24 used by separate float position and normal buffers. The vertex
+ * shader maps positions back into model space with the positionOffset and
+ * positionScale uniforms.
+ */
+namespace VertexPacking {
+
+    const bool DEBUG(false);
+
+    static const GLfloat QUANT_MAX = 65535.0f;
+    static const GLfloat NORMAL_MAX = 511.0f;
+
+
+    /*
+     * Maps value from [min, min + extent] onto the full 16-bit range.
+     */
+    GLushort quantize(GLfloat value, GLfloat min, GLfloat extent) {
+        if (extent <= 0.0f) return 0;
+
+        GLfloat t = (value - min) / extent;
+        if (t < 0.0f) t = 0.0f;
+        if (t > 1.0f) t = 1.0f;
+        return (GLushort)(t * QUANT_MAX + 0.5f);
+    }
+
+
+    /*
+     * Inverse of quantize, as evaluated by the vertex shader.
+     */
+    GLfloat dequantize(GLushort value, GLfloat min, GLfloat extent) {
+        return min + (value / QUANT_MAX) * extent;
+    }
+
+
+    /*
+     * Packs a unit normal into signed 10-bit x, y and z fields (w unused).
+     */
+    GLuint packNormal(GLfloat x, GLfloat y, GLfloat z) {
+        GLfloat v[3] = { x, y, z };
+        GLuint packed = 0;
+
+        for (int i = 0; i < 3; i++) {
+            GLfloat c = v[i];
+            if (c < -1.0f) c = -1.0f;
+            if (c > 1.0f) c = 1.0f;
+
+            int q = (int)floorf(c * NORMAL_MAX + 0.5f);
+            packed |= ((GLuint)q & 0x3FF) << (10 * i);
+        }
+        return packed;
+    }
+
+
+    /*
+     * Inverse of packNormal, using the GL 4.2+ signed normalized conversion.
+     */
+    void unpackNormal(GLuint packed, GLfloat *normal) {
+        for (int i = 0; i < 3; i++) {
+            int q = (packed >> (10 * i)) & 0x3FF;
+            if (q & 0x200) q -= 0x400; // sign extend
+
+            GLfloat c = q / NORMAL_MAX;
+            normal[i] = c < -1.0f ? -1.0f : c;
+        }
+    }
+
+
+    /*
+     * Builds interleaved packed vertices from float positions and normals.
+     * min/extent describe the model's bounding box on each axis.
+     */
+    void pack(const GLfloat *positions, const GLfloat *normals, GLuint num_vertices,
+        const GLfloat *min, const GLfloat *extent, std::vector<PackedVertex> &packed) {
+
+        packed.resize(num_vertices);
+
+        WorkerPool::parallelFor(num_vertices, 65536, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                const GLfloat *p = positions + v * 3;
+                const GLfloat *n = normals + v * 3;
+
+                packed[v].position[0] = quantize(p[0], min[0], extent[0]);
+                packed[v].position[1] = quantize(p[1], min[1], extent[1]);
+                packed[v].position[2] = quantize(p[2], min[2], extent[2]);
+                packed[v].position[3] = 0;
+                packed[v].normal = packNormal(n[0], n[1], n[2]);
+            }
+        });
+    }
+
+
+    /*
+     * Decodes every packed vertex and compares it against the float data.
+     * Positions must be within half a quantization step on each axis, and
+     * normal components (clamped to [-1, 1], as packNormal does) within one
+     * 10-bit step. Run on every model by the benchmarks.
+     *
+     * Returns true if all vertices are within those bounds; false otherwise.
+     */
+    bool checkRoundTrip(const GLfloat *positions, const GLfloat *normals, GLuint num_vertices,
+        const GLfloat *min, const GLfloat *extent, const PackedVertex *packed) {
+
+        GLfloat max_position_error[3] = { 0.0f, 0.0f, 0.0f };
+        GLfloat max_normal_error = 0.0f;
+
+        for (GLuint v = 0; v < num_vertices; v++) {
+            for (int i = 0; i < 3; i++) {
+                GLfloat decoded = dequantize(packed[v].position[i], min[i], extent[i]);
+                GLfloat error = fabsf(decoded - positions[v * 3 + i]);
+                if (error > max_position_error[i]) max_position_error[i] = error;
+            }
+
+            GLfloat normal[3];
+            unpackNormal(packed[v].normal, normal);
+            for (int i = 0; i < 3; i++) {
+                GLfloat expected = std::max(-1.0f, std::min(1.0f, normals[v * 3 + i]));
+                GLfloat error = fabsf(normal[i] - expected);
+                if (error > max_normal_error) max_normal_error = error;
+            }
+        }
+
+        bool ok = max_normal_error <= 1.0f / NORMAL_MAX;
+        for (int i = 0; i < 3; i++) {
+            /* Half a step, plus float rounding relative to the coordinates */
+            GLfloat bound = 0.5f * extent[i] / QUANT_MAX
+                + 4e-7f * (fabsf(min[i]) + fabsf(extent[i]));
+            if (max_position_error[i] > bound) ok = false;
+        }
+
+        if (DEBUG || !ok) {
+            printf("Packed vertex error: position %.3g %.3g %.3g, normal %.3g (%s)\n",
+                max_position_error[0], max_position_error[1], max_position_error[2],
+                max_normal_error, ok ? "ok" : "out of bounds");
+        }
+        return ok;
+    }
+
+}
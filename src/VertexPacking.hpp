@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef VERTEXPACKING_H
+#define VERTEXPACKING_H
+
+#include <vector>
+
+#include "GL/freeglut.h"
+
+namespace VertexPacking {
+
+    /* Interleaved GPU vertex: position quantized to 16 bits per axis within
+     * the model's bounding box, normal packed as GL_INT_2_10_10_10_REV */
+    struct PackedVertex {
+        GLushort position[4];
+        GLuint normal;
+    };
+
+    GLushort quantize(GLfloat value, GLfloat min, GLfloat extent);
+    GLfloat dequantize(GLushort value, GLfloat min, GLfloat extent);
+    GLuint packNormal(GLfloat x, GLfloat y, GLfloat z);
+    void unpackNormal(GLuint packed, GLfloat *normal);
+    void pack(const GLfloat *positions, const GLfloat *normals, GLuint num_vertices,
+        const GLfloat *min, const GLfloat *extent, std::vector<PackedVertex> &packed);
+    bool checkRoundTrip(const GLfloat *positions, const GLfloat *normals, GLuint num_vertices,
+        const GLfloat *min, const GLfloat *extent, const PackedVertex *packed);
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GL/freeglut.h"
+
+#include "Constants.hpp"
+#include "Profiler.hpp"
+#include "WorkerPool.hpp"
+
+
+/*
+ * Persistent pool of worker threads for the data-parallel load stages
+ * (parsing, normal generation, mesh optimization). Threads are started on
+ * first use and sleep between jobs. Only one job runs at a time, and jobs
+ * must not call parallelFor themselves.
+ */
+namespace WorkerPool {
+
+    /* Current job: blocks of [0, count) handed out through next_block */
+    static const std::function<void(size_t, size_t)> *job_body = NULL;
+    static size_t job_count = 0, job_grain = 1;
+    static std::atomic<size_t> next_block(0);
+    static unsigned job_generation = 0;
+    static unsigned busy_workers = 0;
+    static bool stopping = false;
+
+    static std::vector<std::thread> workers;
+    static std::mutex pool_mutex, job_mutex;
+    static std::condition_variable job_ready, job_done;
+
+
+    /*
+     * Claims and runs blocks of the current job until none are left.
+     */
+    static void runBlocks() {
+        size_t num_blocks = (job_count + job_grain - 1) / job_grain;
+
+        for (size_t block = next_block++; block < num_blocks; block = next_block++) {
+            size_t begin = block * job_grain;
+            size_t end = std::min(begin + job_grain, job_count);
+            (*job_body)(begin, end);
+        }
+    }
+
+
+    static void workerLoop() {
+        Profiler::nameThread("worker");
+
+        unsigned seen_generation = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex);
+                job_ready.wait(lock, [&]() { return stopping || job_generation != seen_generation; });
+                if (stopping) return;
+                seen_generation = job_generation;
+            }
+
+            runBlocks();
+
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if (--busy_workers == 0) job_done.notify_one();
+        }
+    }
+
+
+    /*
+     * Returns the number of threads that share a job, including the caller.
+     * Constants::loader_threads of 0 means one per hardware thread.
+     */
+    unsigned threadCount() {
+        unsigned count = Constants::loader_threads;
+        if (count == 0) count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : count;
+    }
+
+
+    /*
+     * Calls body on consecutive ranges of at most grain items covering
+     * [0, count), spread over the pool. The calling thread takes part, and
+     * the call returns once every range has been processed.
+     */
+    void parallelFor(size_t count, size_t grain,
+        const std::function<void(size_t begin, size_t end)> &body) {
+
+        if (count == 0) return;
+        if (grain == 0) grain = 1;
+
+        /* Small jobs, or a single-threaded configuration, run inline */
+        if (count <= grain || threadCount() == 1) {
+            body(0, count);
+            return;
+        }
+
+        std::lock_guard<std::mutex> job_lock(job_mutex);
+        std::unique_lock<std::mutex> lock(pool_mutex);
+
+        /* Workers must be joined before the statics they wait on are destroyed */
+        if (workers.empty()) atexit(shutdown);
+
+        while (workers.size() + 1 < threadCount()) {
+            workers.push_back(std::thread(workerLoop));
+        }
+
+        job_body = &body;
+        job_count = count;
+        job_grain = grain;
+        next_block = 0;
+        busy_workers = (unsigned)workers.size();
+        job_generation++;
+
+        lock.unlock();
+        job_ready.notify_all();
+
+        runBlocks();
+
+        lock.lock();
+        job_done.wait(lock, []() { return busy_workers == 0; });
+        job_body = NULL;
+    }
+
+
+    /*
+     * Stops and joins all worker threads. Registered with atexit once the
+     * first worker is started.
+     */
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            stopping = true;
+        }
+        job_ready.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+        workers.clear();
+        stopping = false;
+    }
+
+}
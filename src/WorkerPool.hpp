@@ -0,0 +1,18 @@
+#pragma once
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <stddef.h>
+#include <functional>
+
+namespace WorkerPool {
+
+    unsigned threadCount();
+    void parallelFor(size_t count, size_t grain,
+        const std::function<void(size_t begin, size_t end)> &body);
+    void shutdown();
+
+}
+
+#endif